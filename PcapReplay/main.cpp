@@ -0,0 +1,424 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Replays the BPDUs of a pcap or pcapng capture against one bridge and reports how fast the library processed them.
+// The capture timestamps drive both STP_OnBpduReceived and STP_OnOneSecondTick, so a storm recorded in production
+// can be reproduced, and its processing cost measured, without the hardware.
+//
+// Build (Linux): g++ -std=c++17 -O2 -I ../mstp-lib -o stp-replay main.cpp pcap.cpp ../mstp-lib/internal/*.cpp
+
+#include "pcap.h"
+#include "../mstp-lib/stp.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static constexpr uint8_t bpdu_dest_address[6] = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 };
+static constexpr uint8_t bpdu_llc[3] = { 0x42, 0x42, 0x03 };
+
+enum class port_mapping { interface, source, dsa, edsa };
+
+struct options
+{
+	const char*  input_path = nullptr;
+	const char*  output_path = nullptr;
+	port_mapping mapping = port_mapping::interface;
+	unsigned int port_count = 0; // 0 = highest port index found in the capture, plus one
+	unsigned int msti_count = 0;
+	STP_VERSION  version = STP_VERSION_MSTP;
+	bool         logging = false;
+};
+
+struct replayed_bpdu
+{
+	uint64_t timestamp_ns;
+	unsigned int port_index;
+	const uint8_t* bpdu;
+	unsigned int bpdu_size;
+};
+
+struct transmitted_bpdu
+{
+	uint64_t timestamp_ns;
+	unsigned int port_index;
+	std::vector<uint8_t> frame;
+};
+
+static uint8_t bridge_address[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 }; // locally administered
+static uint64_t current_timestamp_ns;
+static std::vector<uint8_t> tx_frame;
+static unsigned int tx_port_index;
+static std::vector<transmitted_bpdu> transmitted_bpdus;
+
+// ============================================================================
+
+static void* StpCallback_AllocAndZeroMemory (unsigned int size)
+{
+	return calloc (1, size);
+}
+
+static void StpCallback_FreeMemory (void* p)
+{
+	free (p);
+}
+
+static void* StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	// Same framing as the simulator: the source address is the bridge address plus one plus the port index.
+	tx_frame.assign (17 + bpduSize, 0);
+	memcpy (&tx_frame[0], bpdu_dest_address, 6);
+	memcpy (&tx_frame[6], bridge_address, 6);
+	unsigned int low = bridge_address[4] * 256 + bridge_address[5] + 1 + portIndex;
+	tx_frame[10] = (uint8_t) (low >> 8);
+	tx_frame[11] = (uint8_t) low;
+	tx_frame[12] = (uint8_t) ((bpduSize + 3) >> 8);
+	tx_frame[13] = (uint8_t) (bpduSize + 3);
+	memcpy (&tx_frame[14], bpdu_llc, 3);
+	tx_port_index = portIndex;
+	return &tx_frame[17];
+}
+
+static void StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	// Kept in memory and written after the replay, so that file I/O doesn't show in the measurements.
+	transmitted_bpdus.push_back ({ current_timestamp_ns, tx_port_index, std::move(tx_frame) });
+}
+
+static void StpCallback_EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp)
+{
+}
+
+static void StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+	fwrite (nullTerminatedString, 1, stringLength, stdout);
+}
+
+static void StpCallback_OnTopologyChange (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
+{
+}
+
+static void StpCallback_OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp)
+{
+}
+
+static const STP_CALLBACKS callbacks =
+{
+	&StpCallback_EnableBpduTrapping,
+	&StpCallback_EnableLearning,
+	&StpCallback_EnableForwarding,
+	&StpCallback_TransmitGetBuffer,
+	&StpCallback_TransmitReleaseBuffer,
+	&StpCallback_FlushFdb,
+	&StpCallback_DebugStrOut,
+	&StpCallback_OnTopologyChange,
+	&StpCallback_OnPortRoleChanged,
+	&StpCallback_AllocAndZeroMemory,
+	&StpCallback_FreeMemory,
+	nullptr,
+};
+
+// ============================================================================
+
+static void print_usage()
+{
+	printf ("Usage: stp-replay [options] capture.pcap|capture.pcapng\n"
+			"  -o FILE     Write the BPDUs transmitted by the bridge to FILE (pcap).\n"
+			"  -m MAPPING  How the port index of a received BPDU is found:\n"
+			"                interface  pcapng interface ID (default; always 0 for pcap files)\n"
+			"                source     source MAC addresses, numbered in order of first appearance\n"
+			"                dsa, edsa  Source Port field of a Marvell DSA / EtherType DSA tag\n"
+			"  -p COUNT    Port count (default: highest port index found, plus one).\n"
+			"  -v VERSION  stp, rstp or mstp (default mstp).\n"
+			"  -n COUNT    MSTI count (default 0).\n"
+			"  -l          Enable logging, to stdout. The log is written between the timed calls.\n");
+}
+
+static options parse_options (int argc, char* argv[])
+{
+	options o;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+		if ((arg == "-o") && has_value)
+			o.output_path = argv[++i];
+		else if ((arg == "-m") && has_value)
+		{
+			std::string m = argv[++i];
+			if (m == "interface")
+				o.mapping = port_mapping::interface;
+			else if (m == "source")
+				o.mapping = port_mapping::source;
+			else if (m == "dsa")
+				o.mapping = port_mapping::dsa;
+			else if (m == "edsa")
+				o.mapping = port_mapping::edsa;
+			else
+				throw std::runtime_error ("Unknown port mapping " + m + ".");
+		}
+		else if ((arg == "-p") && has_value)
+			o.port_count = (unsigned int) strtoul (argv[++i], nullptr, 10);
+		else if ((arg == "-n") && has_value)
+			o.msti_count = (unsigned int) strtoul (argv[++i], nullptr, 10);
+		else if ((arg == "-v") && has_value)
+		{
+			std::string v = argv[++i];
+			if (v == "stp")
+				o.version = STP_VERSION_LEGACY_STP;
+			else if (v == "rstp")
+				o.version = STP_VERSION_RSTP;
+			else if (v == "mstp")
+				o.version = STP_VERSION_MSTP;
+			else
+				throw std::runtime_error ("Unknown STP version " + v + ".");
+		}
+		else if (arg == "-l")
+			o.logging = true;
+		else if ((arg[0] != '-') && (o.input_path == nullptr))
+			o.input_path = argv[i];
+		else
+			throw std::runtime_error ("Bad command line argument " + arg + ".");
+	}
+
+	if (o.input_path == nullptr)
+		throw std::runtime_error ("No capture file given.");
+
+	return o;
+}
+
+// Picks the BPDU frames out of the capture and gives each one a port index.
+static std::vector<replayed_bpdu> select_bpdus (const std::vector<captured_frame>& frames, port_mapping mapping, size_t* skipped_frames)
+{
+	STP_FRAME_TAG_FORMAT tag_format = (mapping == port_mapping::dsa) ? STP_FRAME_TAG_FORMAT_DSA
+		: ((mapping == port_mapping::edsa) ? STP_FRAME_TAG_FORMAT_EDSA : STP_FRAME_TAG_FORMAT_NONE);
+
+	std::map<std::vector<uint8_t>, unsigned int> source_addresses;
+	std::vector<replayed_bpdu> bpdus;
+	*skipped_frames = 0;
+	for (const captured_frame& frame : frames)
+	{
+		replayed_bpdu b;
+		unsigned int dsa_source_port = 0;
+		b.bpdu = STP_GetBpduFromFrame (frame.data.data(), (unsigned int) frame.data.size(), tag_format, &b.bpdu_size, &dsa_source_port);
+		if (b.bpdu == nullptr)
+		{
+			(*skipped_frames)++;
+			continue;
+		}
+
+		b.timestamp_ns = frame.timestamp_ns;
+		if (mapping == port_mapping::interface)
+			b.port_index = frame.interface_id;
+		else if (mapping == port_mapping::source)
+		{
+			std::vector<uint8_t> sa (&frame.data[6], &frame.data[12]);
+			auto it = source_addresses.insert ({ sa, (unsigned int) source_addresses.size() }).first;
+			b.port_index = it->second;
+		}
+		else
+			b.port_index = dsa_source_port;
+
+		bpdus.push_back (b);
+	}
+
+	return bpdus;
+}
+
+static uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1'000'000'000ull + (uint64_t) ts.tv_nsec;
+}
+
+static double percentile_us (const std::vector<uint64_t>& sorted_ns, double percentile)
+{
+	if (sorted_ns.empty())
+		return 0;
+	size_t index = (size_t) (percentile / 100 * (sorted_ns.size() - 1) + 0.5);
+	return sorted_ns[index] / 1000.0;
+}
+
+static int replay (const options& o)
+{
+	std::vector<captured_frame> frames = read_capture_file (o.input_path);
+	size_t skipped_frames;
+	std::vector<replayed_bpdu> bpdus = select_bpdus (frames, o.mapping, &skipped_frames);
+	if (bpdus.empty())
+	{
+		printf ("The capture contains no BPDUs.\n");
+		return 1;
+	}
+
+	unsigned int port_count = o.port_count;
+	if (port_count == 0)
+	{
+		for (const replayed_bpdu& b : bpdus)
+			port_count = std::max (port_count, b.port_index + 1);
+	}
+
+	size_t skipped_bpdus = 0;
+	bpdus.erase (std::remove_if (bpdus.begin(), bpdus.end(), [&](const replayed_bpdu& b)
+	{
+		bool skip = (b.port_index >= port_count);
+		skipped_bpdus += skip;
+		return skip;
+	}), bpdus.end());
+	if (bpdus.empty())
+	{
+		printf ("The capture contains no BPDUs on ports 0..%u.\n", port_count - 1);
+		return 1;
+	}
+
+	// The frames of a pcapng file with several interfaces are not necessarily in time order.
+	std::stable_sort (bpdus.begin(), bpdus.end(), [](const replayed_bpdu& a, const replayed_bpdu& b) { return a.timestamp_ns < b.timestamp_ns; });
+
+	// Library timestamps are milliseconds since the first BPDU; one-second ticks are counted from it too.
+	uint64_t start_ns = bpdus.front().timestamp_ns;
+	auto timestamp_ms = [start_ns](uint64_t ns) { return (unsigned int) ((ns - start_ns) / 1'000'000); };
+
+	unsigned int max_vlan_number = (o.msti_count > 0) ? 4094 : 0;
+	STP_BRIDGE* bridge = STP_CreateBridge (port_count, o.msti_count, max_vlan_number, &callbacks, bridge_address, 4096);
+	STP_SetStpVersion (bridge, o.version, 0);
+	STP_EnableLogging (bridge, o.logging);
+
+	// The log goes to stdout between the timed calls, so console I/O doesn't count as processing time.
+	std::vector<unsigned char> log_ring;
+	if (o.logging)
+	{
+		log_ring.resize (1 << 20);
+		STP_EnableDeferredLog (bridge, log_ring.data(), (unsigned int) log_ring.size());
+	}
+	auto drain_log = [bridge]
+	{
+		unsigned int lost;
+		STP_DrainLog (bridge, 0xFFFFFFFF, &lost);
+		if (lost > 0)
+			printf ("\n[%u characters of log text lost]\n", lost);
+	};
+
+	current_timestamp_ns = start_ns;
+	STP_StartBridge (bridge, 0);
+	for (unsigned int portIndex = 0; portIndex < port_count; portIndex++)
+		STP_OnPortEnabled (bridge, portIndex, 1000, true, 0);
+	size_t startup_transmitted = transmitted_bpdus.size();
+	drain_log();
+
+	std::vector<uint64_t> bpdu_latencies_ns;
+	bpdu_latencies_ns.reserve (bpdus.size());
+	uint64_t tick_total_ns = 0;
+	uint64_t tick_max_ns = 0;
+	unsigned int tick_count = 0;
+	uint64_t next_tick_ns = start_ns + 1'000'000'000;
+
+	for (const replayed_bpdu& b : bpdus)
+	{
+		while (b.timestamp_ns >= next_tick_ns)
+		{
+			current_timestamp_ns = next_tick_ns;
+			uint64_t t0 = now_ns();
+			STP_OnOneSecondTick (bridge, timestamp_ms(next_tick_ns));
+			uint64_t elapsed = now_ns() - t0;
+			tick_total_ns += elapsed;
+			tick_max_ns = std::max (tick_max_ns, elapsed);
+			tick_count++;
+			next_tick_ns += 1'000'000'000;
+			drain_log();
+		}
+
+		current_timestamp_ns = b.timestamp_ns;
+		uint64_t t0 = now_ns();
+		STP_OnBpduReceived (bridge, b.port_index, b.bpdu, b.bpdu_size, timestamp_ms(b.timestamp_ns));
+		bpdu_latencies_ns.push_back (now_ns() - t0);
+		drain_log();
+	}
+
+	STP_BRIDGE_STATISTICS statistics;
+	STP_GetStatistics (bridge, &statistics);
+	unsigned int transitions = 0;
+	for (unsigned int i = 0; i < STP_STATE_MACHINE_COUNT; i++)
+		transitions += statistics.transitions[i];
+	unsigned int invalid_bpdus = 0;
+	for (unsigned int portIndex = 0; portIndex < port_count; portIndex++)
+	{
+		STP_PORT_STATISTICS port_statistics;
+		STP_GetPortStatistics (bridge, portIndex, &port_statistics);
+		invalid_bpdus += port_statistics.rxInvalidBpdus;
+	}
+	STP_TREE_STATISTICS cist_statistics;
+	STP_GetTreeStatistics (bridge, 0, &cist_statistics);
+	unsigned int convergences = 0;
+	for (unsigned int i = 0; i < STP_CONVERGENCE_HISTOGRAM_SIZE; i++)
+		convergences += cist_statistics.convergenceHistogram[i];
+
+	STP_DestroyBridge (bridge);
+
+	if (o.output_path != nullptr)
+	{
+		pcap_writer writer (o.output_path);
+		for (const transmitted_bpdu& t : transmitted_bpdus)
+			writer.write (t.timestamp_ns, t.frame.data(), t.frame.size());
+	}
+
+	uint64_t bpdu_total_ns = 0;
+	for (uint64_t l : bpdu_latencies_ns)
+		bpdu_total_ns += l;
+	std::sort (bpdu_latencies_ns.begin(), bpdu_latencies_ns.end());
+
+	double capture_seconds = (bpdus.back().timestamp_ns - start_ns) / 1e9;
+	printf ("Capture:     %zu frames, %zu BPDUs replayed, %zu non-BPDU frames skipped, %zu BPDUs on ports >= %u skipped\n",
+		frames.size(), bpdus.size(), skipped_frames, skipped_bpdus, port_count);
+	printf ("             %.3f s, %.1f BPDUs/s on average\n", capture_seconds, (capture_seconds > 0) ? bpdus.size() / capture_seconds : 0.0);
+	printf ("Bridge:      %u ports, %u MSTIs, %s\n", port_count, o.msti_count, STP_GetVersionString(o.version));
+	printf ("Transmitted: %zu BPDUs (%zu at startup)\n", transmitted_bpdus.size(), startup_transmitted);
+	printf ("Processing:  %.0f BPDUs/s (%.3f ms total in STP_OnBpduReceived)\n",
+		(bpdu_total_ns > 0) ? bpdus.size() * 1e9 / bpdu_total_ns : 0.0, bpdu_total_ns / 1e6);
+	printf ("Latency:     p50 %.2f us, p90 %.2f us, p99 %.2f us, p99.9 %.2f us, max %.2f us\n",
+		percentile_us (bpdu_latencies_ns, 50), percentile_us (bpdu_latencies_ns, 90), percentile_us (bpdu_latencies_ns, 99),
+		percentile_us (bpdu_latencies_ns, 99.9), bpdu_latencies_ns.back() / 1000.0);
+	printf ("Ticks:       %u, %.2f us average, %.2f us max\n",
+		tick_count, tick_count ? tick_total_ns / 1000.0 / tick_count : 0.0, tick_max_ns / 1000.0);
+	printf ("Runs:        %u, %.2f iterations on average, %u max, %u state transitions, %u invalid BPDUs\n",
+		statistics.stateMachineRuns, statistics.stateMachineRuns ? (double) statistics.stateMachineIterations / statistics.stateMachineRuns : 0.0,
+		statistics.maxStateMachineIterations, transitions, invalid_bpdus);
+	printf ("Convergence: %u on the CIST, last %u ms, max %u ms\n",
+		convergences, cist_statistics.lastConvergenceTime, cist_statistics.maxConvergenceTime);
+	return 0;
+}
+
+int main (int argc, char* argv[])
+{
+	try
+	{
+		if (argc < 2)
+		{
+			print_usage();
+			return 1;
+		}
+
+		return replay (parse_options (argc, argv));
+	}
+	catch (const std::exception& ex)
+	{
+		fprintf (stderr, "%s\n", ex.what());
+		return 1;
+	}
+}
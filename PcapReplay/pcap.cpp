@@ -0,0 +1,305 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "pcap.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+static constexpr uint32_t linktype_ethernet = 1;
+
+// pcap: https://www.tcpdump.org/manpages/pcap-savefile.5.html
+static constexpr uint32_t pcap_magic_us = 0xA1B2C3D4;
+static constexpr uint32_t pcap_magic_ns = 0xA1B23C4D;
+
+// pcapng: https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-00.html
+static constexpr uint32_t pcapng_section_header_block   = 0x0A0D0D0A;
+static constexpr uint32_t pcapng_interface_block        = 1;
+static constexpr uint32_t pcapng_packet_block           = 2; // obsolete, but still written by some tools
+static constexpr uint32_t pcapng_simple_packet_block    = 3;
+static constexpr uint32_t pcapng_enhanced_packet_block  = 6;
+static constexpr uint32_t pcapng_byte_order_magic       = 0x1A2B3C4D;
+static constexpr uint16_t pcapng_option_end             = 0;
+static constexpr uint16_t pcapng_option_if_tsresol      = 9;
+
+// ============================================================================
+
+class byte_reader
+{
+	const std::vector<uint8_t>& _buffer;
+	bool _swap = false;
+
+public:
+	explicit byte_reader (const std::vector<uint8_t>& buffer)
+		: _buffer(buffer)
+	{ }
+
+	void set_swap (bool swap) { _swap = swap; }
+
+	void check (size_t offset, size_t size) const
+	{
+		if ((offset > _buffer.size()) || (size > _buffer.size() - offset))
+			throw std::runtime_error ("Truncated capture file.");
+	}
+
+	uint16_t u16 (size_t offset) const
+	{
+		check (offset, 2);
+		const uint8_t* p = &_buffer[offset];
+		return _swap ? ((p[0] << 8) | p[1]) : ((p[1] << 8) | p[0]);
+	}
+
+	uint32_t u32 (size_t offset) const
+	{
+		check (offset, 4);
+		const uint8_t* p = &_buffer[offset];
+		if (_swap)
+			return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		else
+			return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+	}
+
+	std::vector<uint8_t> bytes (size_t offset, size_t size) const
+	{
+		check (offset, size);
+		return std::vector<uint8_t> (_buffer.begin() + offset, _buffer.begin() + offset + size);
+	}
+};
+
+static std::vector<uint8_t> read_whole_file (const char* path)
+{
+	FILE* file = fopen (path, "rb");
+	if (file == nullptr)
+		throw std::runtime_error (std::string("Cannot open ") + path + ".");
+
+	std::vector<uint8_t> buffer;
+	uint8_t chunk[65536];
+	size_t read;
+	while ((read = fread (chunk, 1, sizeof(chunk), file)) > 0)
+		buffer.insert (buffer.end(), chunk, chunk + read);
+
+	bool error = ferror(file);
+	fclose (file);
+	if (error)
+		throw std::runtime_error (std::string("Cannot read ") + path + ".");
+
+	return buffer;
+}
+
+// ============================================================================
+
+static std::vector<captured_frame> read_pcap (const std::vector<uint8_t>& buffer)
+{
+	byte_reader reader (buffer);
+	uint32_t magic = reader.u32(0);
+	if ((magic != pcap_magic_us) && (magic != pcap_magic_ns))
+	{
+		reader.set_swap(true);
+		magic = reader.u32(0);
+	}
+
+	uint64_t ns_per_fraction_unit = (magic == pcap_magic_ns) ? 1 : 1000;
+
+	if ((reader.u32(20) & 0x0FFFFFFF) != linktype_ethernet)
+		throw std::runtime_error ("The capture file does not contain Ethernet frames.");
+
+	std::vector<captured_frame> frames;
+	size_t offset = 24;
+	while (offset < buffer.size())
+	{
+		captured_frame frame;
+		frame.timestamp_ns = reader.u32(offset) * 1'000'000'000ull + reader.u32(offset + 4) * ns_per_fraction_unit;
+		frame.interface_id = 0;
+		uint32_t captured_length = reader.u32(offset + 8);
+		frame.data = reader.bytes (offset + 16, captured_length);
+		frames.push_back (std::move(frame));
+		offset += 16 + captured_length;
+	}
+
+	return frames;
+}
+
+// ============================================================================
+
+struct pcapng_interface
+{
+	uint16_t link_type;
+	bool     binary_resolution; // if_tsresol with the MSB set: the timestamp unit is 2^-exponent seconds
+	uint8_t  exponent;          // otherwise it is 10^-exponent seconds
+};
+
+static uint64_t pcapng_timestamp_to_ns (const pcapng_interface& interface, uint64_t ts)
+{
+	if (interface.binary_resolution)
+		return (uint64_t) ((long double) ts * 1e9L / (long double) (1ull << interface.exponent));
+
+	uint64_t ns = ts;
+	for (unsigned int e = interface.exponent; e < 9; e++)
+		ns *= 10;
+	for (unsigned int e = 9; e < interface.exponent; e++)
+		ns /= 10;
+	return ns;
+}
+
+static std::vector<captured_frame> read_pcapng (const std::vector<uint8_t>& buffer)
+{
+	byte_reader reader (buffer);
+	std::vector<captured_frame> frames;
+	std::vector<pcapng_interface> interfaces;
+	uint32_t section_first_interface_id = 0;
+	uint64_t last_timestamp_ns = 0;
+
+	size_t offset = 0;
+	while (offset < buffer.size())
+	{
+		uint32_t block_type = reader.u32(offset);
+		if (block_type == pcapng_section_header_block)
+		{
+			// The byte order of the whole section, this block included, is given by its Byte-Order Magic.
+			reader.set_swap(false);
+			if (reader.u32(offset + 8) != pcapng_byte_order_magic)
+				reader.set_swap(true);
+			if (reader.u32(offset + 8) != pcapng_byte_order_magic)
+				throw std::runtime_error ("Bad pcapng Byte-Order Magic.");
+
+			// Interface IDs are per section; we number them across sections.
+			section_first_interface_id = (uint32_t) interfaces.size();
+		}
+
+		uint32_t block_length = reader.u32(offset + 4);
+		if ((block_length < 12) || (block_length % 4 != 0))
+			throw std::runtime_error ("Bad pcapng block length.");
+		reader.check (offset, block_length);
+
+		if (block_type == pcapng_interface_block)
+		{
+			pcapng_interface interface = { reader.u16(offset + 8), false, 6 };
+
+			size_t option = offset + 16;
+			while (option + 4 <= offset + block_length - 4)
+			{
+				uint16_t code = reader.u16(option);
+				uint16_t length = reader.u16(option + 2);
+				if (code == pcapng_option_end)
+					break;
+				if ((code == pcapng_option_if_tsresol) && (length == 1))
+				{
+					uint8_t value = buffer[option + 4];
+					interface.binary_resolution = (value & 0x80) != 0;
+					interface.exponent = value & 0x7F;
+				}
+				option += 4 + ((length + 3) & ~3u);
+			}
+
+			interfaces.push_back (interface);
+		}
+		else if ((block_type == pcapng_enhanced_packet_block) || (block_type == pcapng_packet_block) || (block_type == pcapng_simple_packet_block))
+		{
+			uint32_t interface_id;
+			uint32_t captured_length;
+			size_t data_offset;
+			uint64_t timestamp_ns;
+			if (block_type == pcapng_simple_packet_block)
+			{
+				// No timestamp and no interface ID; the original length is the captured length unless it exceeds the block.
+				interface_id = section_first_interface_id;
+				captured_length = std::min (reader.u32(offset + 8), block_length - 16);
+				data_offset = offset + 12;
+				timestamp_ns = last_timestamp_ns;
+			}
+			else
+			{
+				interface_id = section_first_interface_id + ((block_type == pcapng_packet_block) ? reader.u16(offset + 8) : reader.u32(offset + 8));
+				captured_length = reader.u32(offset + 20);
+				data_offset = offset + 28;
+				if (interface_id >= interfaces.size())
+					throw std::runtime_error ("pcapng packet block refers to an unknown interface.");
+
+				uint64_t ts = ((uint64_t)reader.u32(offset + 12) << 32) | reader.u32(offset + 16);
+				timestamp_ns = pcapng_timestamp_to_ns (interfaces[interface_id], ts);
+			}
+
+			if (interface_id >= interfaces.size())
+				throw std::runtime_error ("pcapng packet block refers to an unknown interface.");
+			if (data_offset + captured_length > offset + block_length - 4)
+				throw std::runtime_error ("Bad pcapng packet length.");
+			if (interfaces[interface_id].link_type == linktype_ethernet)
+			{
+				captured_frame frame;
+				frame.timestamp_ns = timestamp_ns;
+				frame.interface_id = interface_id;
+				frame.data = reader.bytes (data_offset, captured_length);
+				frames.push_back (std::move(frame));
+			}
+
+			last_timestamp_ns = timestamp_ns;
+		}
+
+		offset += block_length;
+	}
+
+	return frames;
+}
+
+// ============================================================================
+
+std::vector<captured_frame> read_capture_file (const char* path)
+{
+	std::vector<uint8_t> buffer = read_whole_file(path);
+	if (buffer.size() < 24)
+		throw std::runtime_error ("Not a pcap or pcapng file.");
+
+	byte_reader reader (buffer);
+	uint32_t magic = reader.u32(0);
+	if (magic == pcapng_section_header_block)
+		return read_pcapng (buffer);
+
+	reader.set_swap(true);
+	uint32_t swapped_magic = reader.u32(0);
+	if ((magic == pcap_magic_us) || (magic == pcap_magic_ns) || (swapped_magic == pcap_magic_us) || (swapped_magic == pcap_magic_ns))
+		return read_pcap (buffer);
+
+	throw std::runtime_error ("Not a pcap or pcapng file.");
+}
+
+// ============================================================================
+
+static void write_u32 (FILE* file, uint32_t value)
+{
+	fwrite (&value, 4, 1, file);
+}
+
+static void write_u16 (FILE* file, uint16_t value)
+{
+	fwrite (&value, 2, 1, file);
+}
+
+pcap_writer::pcap_writer (const char* path)
+{
+	_file = fopen (path, "wb");
+	if (_file == nullptr)
+		throw std::runtime_error (std::string("Cannot create ") + path + ".");
+
+	// Written in host byte order, which readers detect from the magic number.
+	write_u32 (_file, pcap_magic_ns);
+	write_u16 (_file, 2); // version major
+	write_u16 (_file, 4); // version minor
+	write_u32 (_file, 0); // thiszone
+	write_u32 (_file, 0); // sigfigs
+	write_u32 (_file, 65535); // snaplen
+	write_u32 (_file, linktype_ethernet);
+}
+
+pcap_writer::~pcap_writer()
+{
+	fclose (_file);
+}
+
+void pcap_writer::write (uint64_t timestamp_ns, const uint8_t* data, size_t size)
+{
+	write_u32 (_file, (uint32_t) (timestamp_ns / 1'000'000'000));
+	write_u32 (_file, (uint32_t) (timestamp_ns % 1'000'000'000));
+	write_u32 (_file, (uint32_t) size);
+	write_u32 (_file, (uint32_t) size);
+	fwrite (data, 1, size, _file);
+}
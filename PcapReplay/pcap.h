@@ -0,0 +1,33 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct captured_frame
+{
+	uint64_t timestamp_ns;  // as recorded in the capture file
+	uint32_t interface_id;  // pcapng interface ID, counted across sections; always 0 for pcap files
+	std::vector<uint8_t> data;
+};
+
+// Reads all frames of a pcap or pcapng file, in file order. Frames captured on interfaces with
+// a link type other than Ethernet are skipped. Throws std::runtime_error if the file can't be
+// read or is not a capture file.
+std::vector<captured_frame> read_capture_file (const char* path);
+
+// Writes Ethernet frames to a pcap file with nanosecond timestamps.
+class pcap_writer
+{
+	FILE* _file;
+
+public:
+	explicit pcap_writer (const char* path);
+	pcap_writer (const pcap_writer&) = delete;
+	pcap_writer& operator= (const pcap_writer&) = delete;
+	~pcap_writer();
+
+	void write (uint64_t timestamp_ns, const uint8_t* data, size_t size);
+};
@@ -346,8 +346,9 @@ static void process_received_frames()
 
 		if (memcmp (frame, bpdu_dest_address, 6) == 0)
 		{
-			if ((frame_size > 14 + sizeof(bpdu_llc_field))
-				&& (memcmp(&frame[14], bpdu_llc_field, sizeof(bpdu_llc_field)) == 0)
+			unsigned int bpdu_size;
+			const uint8_t* bpdu = STP_GetBpduFromFrame (frame, frame_size, STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr);
+			if ((bpdu != nullptr)
 				&& STP_IsBridgeStarted(bridge)
 				&& (port_index != -1))
 			{
@@ -359,7 +360,7 @@ static void process_received_frames()
 					STP_OnPortEnabled(bridge, port_index, speed, duplex, timestamp);
 				}
 
-				STP_OnBpduReceived(bridge, port_index, &frame[17], frame_size - 17, timestamp);
+				STP_OnBpduReceived(bridge, port_index, bpdu, bpdu_size, timestamp);
 			}
 		}
 		else
@@ -426,11 +426,13 @@ static void poll_port_status_and_call_library (unsigned int timestamp)
 static void validate_and_process_bpdu (const uint8_t* data, size_t size)
 {
 	// Let's make some sanity checks on the received BPDU and ignore it if it's malformed.
-
-	// 25 is the size of headers before the BPDU: DA(6), SA(6), Marvell EtherType DSA tag(4), Marvell To_CPU DSA tag(4), EtherType/Size(2), LLC(3)
-	if (size < 25)
+	// Headers before the BPDU: DA(6), SA(6), Marvell EtherType DSA tag(4), Marvell To_CPU DSA tag(4), EtherType/Size(2), LLC(3)
+	unsigned int bpdu_size;
+	unsigned int switch_port_index;
+	const uint8_t* bpdu = STP_GetBpduFromFrame (data, size, STP_FRAME_TAG_FORMAT_EDSA, &bpdu_size, &switch_port_index);
+	if (bpdu == nullptr)
 	{
-		printf ("BPDU len < 25\r\n");
+		printf ("BPDU headers\r\n");
 		return;
 	}
 
@@ -442,23 +444,6 @@ static void validate_and_process_bpdu (const uint8_t* data, size_t size)
 		data[6], data[7], data[8], data[9], data[10], data[11],
 		data[12], data[13]);
 
-	unsigned int etherTypeOrSize = (data[20] << 8) | data[21];
-
-	// 3 is the size of the LLC field
-	if ((etherTypeOrSize < 3) || (etherTypeOrSize > 1536))
-	{
-		printf ("BPDU etherTypeOrSize\r\n");
-		return;
-	}
-
-	if (memcmp (data, bpdu_dest_address, 6) != 0)
-	{
-		printf ("BPDU bad DA\r\n");
-		return;
-	}
-
-	// We ignore the four-byte EtherType tag that starts at index 12.
-
 	// See Figure 29 on page 90 in 88E6352_Functional_Specification-Rev0-08.pdf.
 	const uint8_t* tag = &data[16];
 
@@ -469,15 +454,6 @@ static void validate_and_process_bpdu (const uint8_t* data, size_t size)
 		return;
 	}
 
-	if (memcmp (&data[22], bpdu_llc, 3) != 0)
-	{
-		printf ("BPDU LLC\r\n");
-		return;
-	}
-
-	const uint8_t* bpdu = &data[25];
-	size_t bpdu_size = etherTypeOrSize - 3;
-	size_t switch_port_index = tag[1] >> 3;
 	size_t stp_port_index = get_stp_port_from_switch_port(switch_port_index);
 
 	if (!STP_GetPortEnabled(stp_bridge, stp_port_index))
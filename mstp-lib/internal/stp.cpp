@@ -4,17 +4,117 @@
 
 #include "../stp.h"
 #include "stp_bridge.h"
+#include "stp_conditions_and_params.h"
 #include "stp_log.h"
 #include "stp_md5.h"
+#include "stp_procedures.h"
 #include <string.h>
 
 static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp);
 static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp);
 static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp);
+static void ClearSelectedAndSetReselect (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp);
+static void LogMstConfigDigest (STP_BRIDGE* bridge);
 static void ComputeMstConfigDigest (STP_BRIDGE* bridge);
 
 // ============================================================================
 
+// Not in the standard. STP_CreateBridge allocates the bridge and all its variables in a single memory block.
+// This structure holds the offsets of the various parts within that block. The parts are placed in the order
+// in which RunStateMachines walks them: the bridge, the per-tree variables and bitsets, then each port
+// immediately followed by its trees, their timers and its last transmitted BPDU, then the transmit batch.
+// The MST Config Table with its digest midstates and the debug log buffer, seldom accessed, come last.
+struct BRIDGE_MEMORY_LAYOUT
+{
+	unsigned int treePointers;
+	unsigned int portPointers;
+	unsigned int dirtyPorts;
+	unsigned int trees;
+	unsigned int treeSize;
+	unsigned int portFlags;
+	unsigned int ports;
+	unsigned int portSize;
+	unsigned int portTreePointers; // relative to the start of the port
+	unsigned int portTrees;        // relative to the start of the port
+	unsigned int portTreeTimers;   // relative to the start of the port
+	unsigned int portTxBpdu;       // relative to the start of the port
+	unsigned int portLastRcvdBpdu; // relative to the start of the port
+	unsigned int portTreeSize;
+	unsigned int transmitBatchEntries;
+	unsigned int transmitBatchBuffer;
+	unsigned int mstConfigTable;
+	unsigned int mstConfigDigestMidstates;
+	unsigned int logBuffer;
+	unsigned int totalSize;
+};
+
+// The reservations made in stp.h for the internal structures, checked at compile time. If one of these fails
+// after adding a member variable, enlarge the corresponding reservation.
+typedef char BridgeMustFitInItsReservation   [(sizeof (STP_BRIDGE)  <= STP_RESERVED_BRIDGE_SIZE)    ? 1 : -1];
+typedef char TreeMustFitInItsReservation     [(sizeof (BRIDGE_TREE) <= STP_RESERVED_TREE_SIZE)      ? 1 : -1];
+typedef char PortMustFitInItsReservation     [(sizeof (PORT)        <= STP_RESERVED_PORT_SIZE)      ? 1 : -1];
+typedef char PortTreeMustFitInItsReservation [(sizeof (PORT_TREE)   <= STP_RESERVED_PORT_TREE_SIZE) ? 1 : -1];
+typedef char PortFlagCountMustMatch          [(PORT_FLAG_COUNT  == STP_RESERVED_PORT_FLAG_COUNT)  ? 1 : -1];
+typedef char TreeTimerCountMustMatch         [(TREE_TIMER_COUNT == STP_RESERVED_TREE_TIMER_COUNT) ? 1 : -1];
+typedef char BpduSizeMustMatch               [(sizeof (MSTP_BPDU) + sizeof (MSTI_CONFIG_MESSAGE) == STP_RESERVED_BPDU_SIZE (1)) ? 1 : -1];
+
+// Rounds up so that every part of the block is suitably aligned for any of the types we place in it.
+static unsigned int AlignMemoryOffset (unsigned int offset)
+{
+	return STP_ALIGN_MEMORY_SIZE (offset);
+}
+
+static void ComputeBridgeMemoryLayout (unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber,
+									   unsigned int debugLogBufferSize, BRIDGE_MEMORY_LAYOUT* layout)
+{
+	unsigned int treeCount = 1 + mstiCount;
+	unsigned int wordCount = GetPortBitsetWordCount (portCount);
+
+	layout->treeSize         = AlignMemoryOffset (STP_RESERVED_TREE_SIZE);
+	layout->portTreeSize     = AlignMemoryOffset (STP_RESERVED_PORT_TREE_SIZE);
+	layout->portTreePointers = AlignMemoryOffset (STP_RESERVED_PORT_SIZE);
+	layout->portTrees        = AlignMemoryOffset (layout->portTreePointers + treeCount * sizeof (PORT_TREE*));
+	layout->portTreeTimers   = layout->portTrees + treeCount * layout->portTreeSize;
+	layout->portTxBpdu       = AlignMemoryOffset (layout->portTreeTimers + TREE_TIMER_COUNT * treeCount * sizeof (unsigned short));
+	layout->portLastRcvdBpdu = AlignMemoryOffset (layout->portTxBpdu + sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE));
+	layout->portSize         = AlignMemoryOffset (layout->portLastRcvdBpdu + sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE));
+
+	unsigned int offset = AlignMemoryOffset (STP_RESERVED_BRIDGE_SIZE);
+	layout->treePointers   = offset; offset = AlignMemoryOffset (offset + treeCount * sizeof (BRIDGE_TREE*));
+	layout->portPointers   = offset; offset = AlignMemoryOffset (offset + portCount * sizeof (PORT*));
+	layout->dirtyPorts     = offset; offset = AlignMemoryOffset (offset + 2 * wordCount * sizeof (unsigned int));
+	layout->trees          = offset; offset = offset + treeCount * layout->treeSize;
+	layout->portFlags      = offset; offset = AlignMemoryOffset (offset + treeCount * PORT_FLAG_COUNT * wordCount * sizeof (unsigned int));
+	layout->ports          = offset; offset = offset + portCount * layout->portSize;
+#if STP_USE_TRANSMIT_BATCH
+	layout->transmitBatchEntries = offset; offset = AlignMemoryOffset (offset + portCount * sizeof (STP_TRANSMIT_BATCH_ENTRY));
+	layout->transmitBatchBuffer  = offset; offset = AlignMemoryOffset (offset + portCount * (sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE)));
+#endif
+	layout->mstConfigTable = offset; offset = AlignMemoryOffset (offset + (1 + maxVlanNumber) * 2);
+	layout->mstConfigDigestMidstates = offset; offset = offset + GetMstConfigTableBlockCount (maxVlanNumber) * 4 * sizeof (unsigned int);
+	layout->logBuffer      = offset;
+#if STP_USE_LOG
+	offset = AlignMemoryOffset (offset + debugLogBufferSize);
+#endif
+	layout->totalSize      = offset;
+
+	assert (layout->totalSize == STP_BRIDGE_MEMORY_SIZE (portCount, mstiCount, maxVlanNumber, debugLogBufferSize));
+}
+
+// ============================================================================
+
+unsigned int STP_GetBridgeMemorySize (unsigned int portCount,
+									  unsigned int mstiCount,
+									  unsigned int maxVlanNumber,
+									  unsigned int debugLogBufferSize)
+{
+	BRIDGE_MEMORY_LAYOUT layout;
+	ComputeBridgeMemoryLayout (portCount, mstiCount, maxVlanNumber, debugLogBufferSize, &layout);
+	return layout.totalSize;
+}
+
+// ============================================================================
+
 STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 							  unsigned int mstiCount,
 							  unsigned int maxVlanNumber,
@@ -50,38 +150,66 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 
 	assert (maxVlanNumber <= 4094);
 
-	STP_BRIDGE* bridge = (STP_BRIDGE*) callbacks->allocAndZeroMemory (sizeof (STP_BRIDGE));
-	assert (bridge != NULL);
+	// The whole bridge lives in a single memory block; see BRIDGE_MEMORY_LAYOUT.
+	BRIDGE_MEMORY_LAYOUT layout;
+	ComputeBridgeMemoryLayout (portCount, mstiCount, maxVlanNumber, debugLogBufferSize, &layout);
+
+	unsigned char* memory = (unsigned char*) callbacks->allocAndZeroMemory (layout.totalSize);
+	assert (memory != NULL);
+
+	STP_BRIDGE* bridge = (STP_BRIDGE*) memory;
 
 	// See "13.6.2 Force Protocol Version" on page 332
 	bridge->ForceProtocolVersion = STP_VERSION_RSTP;
 	bridge->TxHoldCount = 6;
 	bridge->callbacks = *callbacks;
+#ifdef STP_FIXED_PORT_COUNT
+	assert (portCount == STP_FIXED_PORT_COUNT);
+#else
 	bridge->portCount = portCount;
+#endif
+#ifdef STP_FIXED_MSTI_COUNT
+	assert (mstiCount == STP_FIXED_MSTI_COUNT);
+#else
 	bridge->mstiCount = mstiCount;
+#endif
 	bridge->maxVlanNumber = maxVlanNumber;
 
 #if STP_USE_LOG
 	assert (debugLogBufferSize >= 2); // one byte for the data, one for the null terminator of the string passed to the callback
-	bridge->logBuffer = (char*) callbacks->allocAndZeroMemory (debugLogBufferSize);
-	assert (bridge->logBuffer != NULL);
+	bridge->logBuffer = (char*) (memory + layout.logBuffer);
 	bridge->logBufferMaxSize = debugLogBufferSize;
 	bridge->logBufferUsedSize = 0;
 	bridge->logCurrentPort = -1;
 	bridge->logCurrentTree = -1;
+	bridge->logCategories = STP_LOG_CATEGORY_ALL;
 #endif
 
 	// ------------------------------------------------------------------------
 
-	bridge->trees = (BRIDGE_TREE**) callbacks->allocAndZeroMemory ((1 + bridge->mstiCount) * sizeof (BRIDGE_TREE*));
-	assert (bridge->trees != NULL);
+	bridge->trees = (BRIDGE_TREE**) (memory + layout.treePointers);
+	bridge->ports = (PORT**) (memory + layout.portPointers);
+
+	bridge->dirtyPorts = (unsigned int*) (memory + layout.dirtyPorts);
+	bridge->dirtyTransmitPorts = bridge->dirtyPorts + bridge->portBitsetWordCount();
 
-	bridge->ports = (PORT**) callbacks->allocAndZeroMemory (portCount * sizeof (PORT*));
-	assert (bridge->ports != NULL);
+#if STP_USE_TRANSMIT_BATCH
+	bridge->transmitBatchEntries = (STP_TRANSMIT_BATCH_ENTRY*) (memory + layout.transmitBatchEntries);
+	bridge->transmitBatchBuffer = memory + layout.transmitBatchBuffer;
+#else
+	assert (callbacks->transmitBatch == NULL);
+#endif
+
+	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+	{
+		bridge->trees [treeIndex] = (BRIDGE_TREE*) (memory + layout.trees + treeIndex * layout.treeSize);
+		bridge->trees [treeIndex]->portFlags = (unsigned int*) (memory + layout.portFlags) + treeIndex * PORT_FLAG_COUNT * bridge->portBitsetWordCount();
+		#if STP_USE_LOG
+			bridge->trees [treeIndex]->logEnabled = true;
+		#endif
+	}
 
 	// per-bridge CIST vars
-	bridge->trees [CIST_INDEX] = (BRIDGE_TREE*) callbacks->allocAndZeroMemory (sizeof (BRIDGE_TREE));
-	assert (bridge->trees [CIST_INDEX] != NULL);
 	bridge->trees [CIST_INDEX]->SetBridgeIdentifier (0x8000, CIST_INDEX, bridgeAddress);
 	// 13.26.4 in 802.1Q-2018
 	// Defaults from Table 13-5 on page 510 in 802.1Q-2018
@@ -93,8 +221,6 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// per-bridge MSTI vars
 	for (unsigned int treeIndex = 1; treeIndex < (1 + bridge->mstiCount); treeIndex++)
 	{
-		bridge->trees [treeIndex] = (BRIDGE_TREE*) callbacks->allocAndZeroMemory (sizeof (BRIDGE_TREE));
-		assert (bridge->trees [treeIndex] != NULL);
 		bridge->trees [treeIndex]->SetBridgeIdentifier (0x8000, treeIndex, bridgeAddress);
 		bridge->trees [treeIndex]->BridgeTimes.remainingHops = 20;
 	}
@@ -102,28 +228,38 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// per-port vars
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
-		bridge->ports [portIndex] = (PORT*) callbacks->allocAndZeroMemory (sizeof (PORT));
-		assert (bridge->ports [portIndex] != NULL);
+		unsigned char* portMemory = memory + layout.ports + portIndex * layout.portSize;
+
+		bridge->ports [portIndex] = (PORT*) portMemory;
 
 		PORT* port = bridge->ports [portIndex];
 
-		port->trees = (PORT_TREE**) callbacks->allocAndZeroMemory ((1 + bridge->mstiCount) * sizeof (PORT_TREE*));
-		assert (port->trees != NULL);
+		port->trees = (PORT_TREE**) (portMemory + layout.portTreePointers);
+		port->treeTimers = (unsigned short*) (portMemory + layout.portTreeTimers);
+		port->txBpdu = (MSTP_BPDU*) (portMemory + layout.portTxBpdu);
+		port->lastRcvdBpdu = portMemory + layout.portLastRcvdBpdu;
 
 		// per-port CIST and MSTI vars
 		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
 		{
-			port->trees[treeIndex] = (PORT_TREE*) callbacks->allocAndZeroMemory (sizeof (PORT_TREE));
-			assert (port->trees[treeIndex] != NULL);
+			port->trees[treeIndex] = (PORT_TREE*) (portMemory + layout.portTrees + treeIndex * layout.portTreeSize);
 			port->trees[treeIndex]->portId.Set (0x80, (unsigned short) portIndex + 1);
 			port->trees[treeIndex]->portTimes = bridge->trees[treeIndex]->BridgeTimes;
 			port->trees[treeIndex]->pseudoRootId = bridge->trees[treeIndex]->GetBridgeIdentifier();
+			port->trees[treeIndex]->flagWords  = bridge->trees[treeIndex]->portFlags + portIndex / 32;
+			port->trees[treeIndex]->flagMask   = 1u << (portIndex % 32);
+			port->trees[treeIndex]->flagStride = bridge->portBitsetWordCount();
+			port->trees[treeIndex]->timers      = port->treeTimers + treeIndex;
+			port->trees[treeIndex]->timerStride = 1 + bridge->mstiCount;
 		}
 
 		port->adminPointToPointMAC = STP_ADMIN_P2P_AUTO;
 		port->AutoEdge = true;
 		port->enableBPDUrx = true;
 		port->enableBPDUtx = true;
+		#if STP_USE_LOG
+			port->logEnabled = true;
+		#endif
 	}
 
 	bridge->receivedBpduContent = NULL; // see comment at declaration of receivedBpduContent
@@ -135,8 +271,9 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// Let's set a default name for the MST Config.
 	STP_GetDefaultMstConfigName (bridgeAddress, bridge->MstConfigId.ConfigurationName);
 
-	bridge->mstConfigTable = (uint16_nbo*) callbacks->allocAndZeroMemory ((1 + maxVlanNumber) * 2);
-	assert (bridge->mstConfigTable != NULL);
+	bridge->mstConfigTable = (uint16_nbo*) (memory + layout.mstConfigTable);
+	bridge->mstConfigDigestMidstates = (unsigned int (*)[4]) (memory + layout.mstConfigDigestMidstates);
+	bridge->mstConfigDigestValidMidstates = 0;
 
 	// The config table is all zeroes now, so all VIDs map to the CIST, no VID mapped to any MSTI.
 	ComputeMstConfigDigest (bridge);
@@ -148,26 +285,7 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 
 void STP_DestroyBridge (STP_BRIDGE* bridge)
 {
-	bridge->callbacks.freeMemory (bridge->mstConfigTable);
-
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-	{
-		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
-			bridge->callbacks.freeMemory (bridge->ports [portIndex]->trees [treeIndex]);
-
-		bridge->callbacks.freeMemory (bridge->ports [portIndex]->trees);
-
-		bridge->callbacks.freeMemory (bridge->ports [portIndex]);
-	}
-
-	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
-		bridge->callbacks.freeMemory (bridge->trees [treeIndex]);
-
-	bridge->callbacks.freeMemory (bridge->ports);
-	bridge->callbacks.freeMemory (bridge->trees);
-#if STP_USE_LOG
-	bridge->callbacks.freeMemory (bridge->logBuffer);
-#endif
+	// Everything was allocated in a single block by STP_CreateBridge.
 	bridge->callbacks.freeMemory (bridge);
 }
 
@@ -219,6 +337,12 @@ void STP_StopBridge (STP_BRIDGE* bridge, unsigned int timestamp)
 		}
 	}
 
+	#if STP_USE_STATISTICS
+		// A stopped bridge doesn't converge; drop the measurements in progress.
+		for (unsigned int treeIndex = 0; treeIndex < 1 + bridge->mstiCount; treeIndex++)
+			bridge->trees[treeIndex]->convergencePending = false;
+	#endif
+
 	// This one last, to allow the callbacks to still call "const" library functions.
 	bridge->started = false;
 
@@ -229,6 +353,74 @@ void STP_StopBridge (STP_BRIDGE* bridge, unsigned int timestamp)
 
 // ============================================================================
 
+void STP_BeginConfigTransaction (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	assert (!bridge->configTransaction);
+
+	LOG (bridge, -1, -1, "{T}: Beginning configuration transaction.\r\n", timestamp);
+
+	bridge->configTransaction = true;
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
+
+// ============================================================================
+
+void STP_CommitConfigTransaction (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	assert (bridge->configTransaction);
+
+	LOG (bridge, -1, -1, "{T}: Committing configuration transaction...\r\n", timestamp);
+
+	bridge->configTransaction = false;
+
+	if (bridge->mstConfigDigestPending)
+	{
+		bridge->mstConfigDigestPending = false;
+		ComputeMstConfigDigest (bridge);
+		LogMstConfigDigest (bridge);
+	}
+
+	if (bridge->started)
+	{
+		if (bridge->restartPending)
+		{
+			// A restart reinitializes all state machines, so it subsumes any pending recomputation.
+			RestartStateMachines (bridge, timestamp);
+		}
+		else
+		{
+			for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+			{
+				if (bridge->trees[treeIndex]->recomputePending)
+					ClearSelectedAndSetReselect (bridge, treeIndex, timestamp);
+			}
+
+			// Also runs whatever was marked dirty by the configuration functions called during the transaction.
+			RunStateMachines (bridge, timestamp);
+		}
+	}
+
+	// All trees, also the MSTIs not in use if the transaction switched away from MSTP after changing one of them.
+	bridge->restartPending = false;
+	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+		bridge->trees[treeIndex]->recomputePending = false;
+
+	LOG (bridge, -1, -1, "Configuration transaction committed.\r\n");
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
+
+// ============================================================================
+
+bool STP_IsConfigTransactionActive (const STP_BRIDGE* bridge)
+{
+	return bridge->configTransaction;
+}
+
+// ============================================================================
+
 void STP_SetBridgeAddress (STP_BRIDGE* bridge, const unsigned char* address, unsigned int timestamp)
 {
 	LOG (bridge, -1, -1, "{T}: Setting bridge MAC address to {BA}...", timestamp, address);
@@ -248,6 +440,7 @@ void STP_SetBridgeAddress (STP_BRIDGE* bridge, const unsigned char* address, uns
 			BRIDGE_ID bid = bridge->trees[treeIndex]->GetBridgeIdentifier();
 			bid.SetAddress (address);
 			bridge->trees[treeIndex]->SetBridgeIdentifier(bid);
+			bridge->InvalidateTxBpdus (treeIndex);
 		}
 
 		if (bridge->started)
@@ -290,6 +483,8 @@ static unsigned int GetDefaultPortPathCost (unsigned int speedMegabitsPerSecond)
 
 void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int speedMegabitsPerSecond, bool detectedPointToPointMAC, unsigned int timestamp)
 {
+	assert (!bridge->configTransaction);
+
 	LOG (bridge, -1, -1, "{T}: Port {D} good\r\n", timestamp, 1 + portIndex);
 
 	PORT* port = bridge->ports [portIndex];
@@ -320,7 +515,13 @@ void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int
 	}
 
 	if (bridge->started)
+	{
+		for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+			bridge->StartConvergenceMeasurement (treeIndex, timestamp);
+
+		bridge->MarkAllDirty();
 		RunStateMachines (bridge, timestamp);
+	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
 	FLUSH_LOG (bridge);
@@ -330,6 +531,8 @@ void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int
 
 void STP_OnPortDisabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int timestamp)
 {
+	assert (!bridge->configTransaction);
+
 	LOG (bridge, -1, -1, "{T}: Port {D} down\r\n", timestamp, 1 + portIndex);
 
 	PORT* port = bridge->ports[portIndex];
@@ -345,7 +548,13 @@ void STP_OnPortDisabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned in
 		port->portEnabled = false;
 
 		if (bridge->started)
+		{
+			for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+				bridge->StartConvergenceMeasurement (treeIndex, timestamp);
+
+			bridge->MarkAllDirty();
 			RunStateMachines (bridge, timestamp);
+		}
 	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
@@ -354,133 +563,742 @@ void STP_OnPortDisabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned in
 
 // ============================================================================
 
-void STP_OnOneSecondTick (STP_BRIDGE* bridge, unsigned int timestamp)
+static void RunOneSecondTick (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	LOG (bridge, -1, -1, "{T}: One second:\r\n", timestamp);
+
+	bridge->tickCounter++;
+
+	// Only the PortTimers state machines read tick. They mark whatever else is affected by the timers they decrement.
+	for (unsigned int givenPort = 0; givenPort < bridge->portCount; givenPort++)
+	{
+		bridge->ports [givenPort]->tick = true;
+		bridge->ports [givenPort]->smDirty = true;
+		bridge->dirtyPorts [givenPort / 32] |= (1u << (givenPort % 32));
+	}
+
+	RunStateMachines (bridge, timestamp);
+}
+
+void STP_OnOneSecondTick (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	// The state machines must not run while a configuration transaction is open.
+	assert (!bridge->configTransaction);
+
+	if (bridge->started)
+	{
+		RunOneSecondTick (bridge, timestamp);
+
+		LOG (bridge, -1, -1, "------------------------------------\r\n");
+		FLUSH_LOG (bridge);
+	}
+}
+
+// ============================================================================
+
+// Returns how many of the coming one-second ticks would only decrement timers, without any state machine
+// having something to do.
+static unsigned int GetQuietTickCount (const STP_BRIDGE* bridge)
+{
+	// Some configuration functions (STP_SetPortAdminEdge for instance) only mark state machines dirty,
+	// leaving their evaluation to the next tick.
+	if (IsAnyPortBitSet (bridge->dirtyPorts, bridge->portCount) || IsAnyPortBitSet (bridge->dirtyTransmitPorts, bridge->portCount))
+		return 0;
+
+	unsigned int res = 0xFFFFFFFF;
+	for (unsigned int givenPort = 0; (givenPort < bridge->portCount) && (res > 0); givenPort++)
+	{
+		unsigned int portRes = PortTimers::GetQuietTickCount (bridge, (PortIndex)givenPort);
+		if (portRes < res)
+			res = portRes;
+	}
+
+	return res;
+}
+
+unsigned int STP_GetNextTimerDeadline (const STP_BRIDGE* bridge)
+{
+	assert (!bridge->configTransaction);
+
+	if (!bridge->started)
+		return STP_NO_TIMER_DEADLINE;
+
+	unsigned int quietTickCount = GetQuietTickCount (bridge);
+	if (quietTickCount == 0xFFFFFFFF)
+		return STP_NO_TIMER_DEADLINE;
+
+	return 1 + quietTickCount;
+}
+
+// ============================================================================
+
+void STP_AdvanceTime (STP_BRIDGE* bridge, unsigned int seconds, unsigned int timestamp)
+{
+	assert (!bridge->configTransaction);
+
+	if (bridge->started && (seconds > 0))
+	{
+		LOG (bridge, -1, -1, "{T}: Advancing time by {D} seconds.\r\n", timestamp, seconds);
+
+		while (seconds > 0)
+		{
+			// Ticks during which no timer reaches a value that some state machine checks are applied in bulk.
+			unsigned int skip = GetQuietTickCount (bridge);
+			if (skip > seconds)
+				skip = seconds;
+
+			if (skip > 0)
+			{
+				for (unsigned int givenPort = 0; givenPort < bridge->portCount; givenPort++)
+					PortTimers::SkipQuietTicks (bridge, (PortIndex)givenPort, skip);
+
+				bridge->tickCounter += skip;
+				seconds -= skip;
+			}
+
+			if (seconds > 0)
+			{
+				RunOneSecondTick (bridge, timestamp);
+				seconds--;
+			}
+		}
+
+		LOG (bridge, -1, -1, "------------------------------------\r\n");
+		FLUSH_LOG (bridge);
+	}
+}
+
+// ============================================================================
+
+// Not in the standard. Counts a received BPDU in the statistics of the port, by type; see STP_GetPortStatistics.
+static void CountReceivedBpdu (STP_BRIDGE* bridge, unsigned int portIndex, enum VALIDATED_BPDU_TYPE type)
+{
+	#if STP_USE_STATISTICS
+		STP_PORT_STATISTICS* statistics = &bridge->ports[portIndex]->statistics;
+		switch (type)
+		{
+			case VALIDATED_BPDU_TYPE_STP_CONFIG: statistics->rxConfigBpdus++; break;
+			case VALIDATED_BPDU_TYPE_RST:        statistics->rxRstBpdus++; break;
+			case VALIDATED_BPDU_TYPE_MST:
+			case VALIDATED_BPDU_TYPE_SPT:        statistics->rxMstBpdus++; break;
+			case VALIDATED_BPDU_TYPE_STP_TCN:    statistics->rxTcnBpdus++; break;
+			default:                             statistics->rxInvalidBpdus++; break;
+		}
+	#endif
+}
+
+// Not in the standard. In a stable network nearly every BPDU received on a port repeats the previous one. On a port
+// that is not Designated such a BPDU conveys the same designated bridge and port as the port priority vector, so rcvInfo
+// finds it superior (see PRIORITY_VECTOR::IsSuperiorTo) and PortInformation goes through SUPERIOR_DESIGNATED, which
+// has Port Role Selection run again for the tree. On a Designated port it usually comes from a Root or Alternate port,
+// and PortInformation goes through NOT_DESIGNATED. When the state machines of the port are at rest, the procedures
+// invoked by PortReceive and PortInformation write again the values the variables already have, except for the
+// edgeDelayWhile and rcvdInfoWhile timers. This function checks that this is the case, and if so restarts those timers,
+// does the role selection that SUPERIOR_DESIGNATED would have triggered, runs whatever that marked dirty and returns
+// true. Otherwise it changes nothing and returns false, and the BPDU must go through the state machines.
+//
+// Since the BPDU is identical to PORT::lastRcvdBpdu, rcvMsgs would decode it into the values the msg* variables already
+// hold; that's why the checks below can read them. Restarting the two timers can only make conditions false that the
+// state machines found false already, so it needs nothing marked dirty.
+static bool ProcessRepeatedBpdu (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	PORT* port = bridge->ports[portIndex];
+
+	#if STP_USE_LOG
+		// With logging enabled every BPDU goes through the state machines, so that the log shows their transitions.
+		if (bridge->loggingEnabled)
+			return false;
+	#endif
+
+	if ((port->lastRcvdBpduSize == 0) || (bpduSize != port->lastRcvdBpduSize))
+		return false;
+
+	unsigned int compareSize = (bpduSize < bridge->GetMaxBpduSize()) ? bpduSize : bridge->GetMaxBpduSize();
+	if (memcmp (bpdu, port->lastRcvdBpdu, compareSize) != 0)
+		return false;
+
+	// PortReceive must take the RECEIVE -> RECEIVE transition, without changing what updtBPDUVersion or its own
+	// entry block change. (Only Config, RST and MST BPDUs are ever stored in lastRcvdBpdu.)
+	enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bridge->ForceProtocolVersion, bpdu, bpduSize);
+	bool rstpBpdu = (type == VALIDATED_BPDU_TYPE_RST) || (type == VALIDATED_BPDU_TYPE_MST);
+	if ((!rstpBpdu && (type != VALIDATED_BPDU_TYPE_STP_CONFIG))
+		|| (port->portReceiveState != PortReceive::RECEIVE)
+		|| !port->enableBPDUrx || port->isL2gp || port->rcvdBpdu || rcvdAnyMsg (bridge, (PortIndex) portIndex)
+		|| (rstpBpdu ? !port->rcvdRSTP : !port->rcvdSTP)
+		|| port->operEdge || port->isolate)
+	{
+		return false;
+	}
+
+	bridge->receivedBpduContent = (MSTP_BPDU*) bpdu;
+	bridge->receivedBpduType = type;
+	bridge->receivedBpduPort = port;
+	bool rcvdInternal = fromSameRegion (bridge, (PortIndex) portIndex);
+	bridge->receivedBpduContent = NULL;
+	bridge->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN;
+	bridge->receivedBpduPort = NULL;
+
+	if (rcvdInternal != port->rcvdInternal)
+		return false;
+
+	// rcvMsgs would set rcvdMsg for the CIST, and for the MSTIs that have a message in the BPDU if it came from our region.
+	unsigned int msgTreeCount = 1;
+	if (rcvdInternal)
+	{
+		unsigned int mstiMessageCount = (unsigned int) GetMstiMessageCount ((const MSTP_BPDU*) bpdu);
+		msgTreeCount += (mstiMessageCount < bridge->mstiCount) ? mstiMessageCount : bridge->mstiCount;
+	}
+	else if (port->mastered)
+	{
+		// recordMastered would clear it.
+		return false;
+	}
+
+	const PORT_TREE* cistTree = port->trees[CIST_INDEX];
+	bool superiorInfo = false;
+
+	for (unsigned int treeIndex = 0; treeIndex < msgTreeCount; treeIndex++)
+	{
+		PORT_TREE* portTree = port->trees[treeIndex];
+
+		// PortInformation must go to RECEIVE, then to SUPERIOR_DESIGNATED or NOT_DESIGNATED. None of the
+		// procedures invoked on the way must have anything to record about proposals or topology changes.
+		if ((portTree->portInformationState != PortInformation::CURRENT)
+			|| (portTree->GetSelected() && portTree->GetUpdtInfo())
+			|| updtXstInfo (bridge, (PortIndex) portIndex, (TreeIndex) treeIndex)
+			|| portTree->msgFlagsProposal || portTree->msgFlagsTc
+			|| ((treeIndex == CIST_INDEX) && portTree->msgFlagsTcAckOrMaster))
+		{
+			return false;
+		}
+
+		RCVD_INFO rcvdInfo = rcvInfo (bridge, (PortIndex) portIndex, (TreeIndex) treeIndex);
+		if (rcvdInfo == RCVD_INFO_SUPERIOR_DESIGNATED)
+		{
+			// recordPriority and recordTimes must write the values already there, and Port Role Selection,
+			// done already with this port priority vector, must find the same roles again.
+			if (!(portTree->msgPriority == portTree->portPriority)
+				|| (portTree->msgTimes.remainingHops != portTree->portTimes.remainingHops)
+				|| (port->infoInternal != rcvdInternal)
+				|| (portTree->infoIs != INFO_IS_RECEIVED)
+				|| !portTree->GetSelected() || portTree->GetReselect())
+			{
+				return false;
+			}
+
+			if ((treeIndex == CIST_INDEX)
+				&& ((portTree->msgTimes.MessageAge   != portTree->portTimes.MessageAge)
+				 || (portTree->msgTimes.MaxAge       != portTree->portTimes.MaxAge)
+				 || (portTree->msgTimes.ForwardDelay != portTree->portTimes.ForwardDelay)
+				 || (portTree->portTimes.HelloTime   != 2)))
+			{
+				return false;
+			}
+
+			superiorInfo = true;
+		}
+		else if (rcvdInfo != RCVD_INFO_INFERIOR_ROOT_ALTERNATE)
+			return false;
+
+		// recordAgreement must give agreed the value it has, and leave proposing as it is. SUPERIOR_DESIGNATED
+		// also clears proposing beforehand, and leaves synced set only if agreed is set.
+		bool agreed;
+		if (treeIndex == CIST_INDEX)
+			agreed = rstpVersion (bridge) && port->operPointToPointMAC && portTree->msgFlagsAgreement;
+		else
+			agreed = port->operPointToPointMAC
+				&& (cistTree->msgPriority.RootId               == cistTree->portPriority.RootId)
+				&& (cistTree->msgPriority.ExternalRootPathCost == cistTree->portPriority.ExternalRootPathCost)
+				&& (cistTree->msgPriority.RegionalRootId       == cistTree->portPriority.RegionalRootId)
+				&& portTree->msgFlagsAgreement;
+
+		if ((portTree->GetAgreed() != agreed)
+			|| (portTree->proposing && (agreed || (rcvdInfo == RCVD_INFO_SUPERIOR_DESIGNATED)))
+			|| (portTree->GetSynced() && !agreed && (rcvdInfo == RCVD_INFO_SUPERIOR_DESIGNATED)))
+		{
+			return false;
+		}
+
+		// recordMastered
+		if ((treeIndex != CIST_INDEX) && ((port->operPointToPointMAC && portTree->msgFlagsTcAckOrMaster) != port->mastered))
+			return false;
+	}
+
+	if (!rcvdInternal)
+	{
+		// recordAgreement for the CIST would copy agreed and proposing to all MSTIs.
+		for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
+		{
+			if ((port->trees[treeIndex]->GetAgreed() != cistTree->GetAgreed()) || (port->trees[treeIndex]->proposing != cistTree->proposing))
+				return false;
+		}
+	}
+
+	// updtRcvdInfoWhile must not find the information expired; rcvdInfoWhile reaching zero would age it out.
+	const TIMES* cistTimes = &cistTree->portTimes;
+	if (superiorInfo && (rcvdInternal ? ((int)cistTimes->remainingHops - 1 <= 0) : (cistTimes->MessageAge + 1 > cistTimes->MaxAge)))
+		return false;
+
+	port->edgeDelayWhile = bridge->MigrateTime;
+	for (unsigned int treeIndex = 0; treeIndex < msgTreeCount; treeIndex++)
+	{
+		if (rcvInfo (bridge, (PortIndex) portIndex, (TreeIndex) treeIndex) == RCVD_INFO_SUPERIOR_DESIGNATED)
+			updtRcvdInfoWhile (bridge, (PortIndex) portIndex, (TreeIndex) treeIndex);
+	}
+
+	// Role selection isn't necessarily a no-op: some of the variables updtRolesTree reads (sendRSTP, for instance)
+	// change without reselect being set, and the new values are taken into account only at the next role selection.
+	// This is the entry block of ROLE_SELECTION, with reselect already clear and selected already set for this port.
+	if (superiorInfo)
+	{
+		for (unsigned int treeIndex = 0; treeIndex < msgTreeCount; treeIndex++)
+		{
+			if (rcvInfo (bridge, (PortIndex) portIndex, (TreeIndex) treeIndex) == RCVD_INFO_SUPERIOR_DESIGNATED)
+			{
+				clearReselectTree (bridge, (TreeIndex) treeIndex);
+				updtRolesTree (bridge, (TreeIndex) treeIndex);
+				setSelectedTree (bridge, (TreeIndex) treeIndex);
+			}
+		}
+	}
+
+	CountReceivedBpdu (bridge, portIndex, type);
+	RunStateMachines (bridge, timestamp);
+	return true;
+}
+
+// Handles one received BPDU, without flushing the log. Called only while the bridge is started.
+static void ProcessReceivedBpdu (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bridge->ports [portIndex]->portEnabled == false)
+	{
+		LOG (bridge, -1, -1, "{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n", timestamp, 1 + portIndex);
+		COUNT_STATISTIC (bridge->ports [portIndex]->statistics.rxDiscardedBpdus);
+	}
+	else if (!ProcessRepeatedBpdu (bridge, portIndex, bpdu, bpduSize, timestamp))
+	{
+		LOG (bridge, -1, -1, "{T}: BPDU received on Port {D}:\r\n", timestamp, 1 + portIndex);
+
+		enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bridge->ForceProtocolVersion, bpdu, bpduSize);
+		CountReceivedBpdu (bridge, portIndex, type);
+		switch (type)
+		{
+			case VALIDATED_BPDU_TYPE_STP_CONFIG:
+				#if STP_USE_LOG
+					if (LOG_CATEGORY_ENABLED (bridge, STP_LOG_CATEGORY_RX_BPDU_DUMP))
+					{
+						LOG (bridge, portIndex, -1, "Config BPDU:\r\n");
+						LOG_INDENT (bridge);
+						DumpConfigBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+						LOG_UNINDENT (bridge);
+					}
+				#endif
+				break;
+
+			case VALIDATED_BPDU_TYPE_RST:
+				#if STP_USE_LOG
+					if (LOG_CATEGORY_ENABLED (bridge, STP_LOG_CATEGORY_RX_BPDU_DUMP))
+					{
+						LOG (bridge, portIndex, -1, "RSTP BPDU:\r\n");
+						LOG_INDENT (bridge);
+						DumpRstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+						LOG_UNINDENT (bridge);
+					}
+				#endif
+				break;
+
+			case VALIDATED_BPDU_TYPE_MST:
+			case VALIDATED_BPDU_TYPE_SPT:
+				#if STP_USE_LOG
+					if (LOG_CATEGORY_ENABLED (bridge, STP_LOG_CATEGORY_RX_BPDU_DUMP))
+					{
+						if (type == VALIDATED_BPDU_TYPE_MST)
+							LOG (bridge, portIndex, -1, "MSTP BPDU:\r\n");
+						else
+							LOG (bridge, portIndex, -1, "SPT BPDU (processed as MSTP):\r\n");
+						LOG_INDENT (bridge);
+						DumpMstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+						LOG_UNINDENT (bridge);
+					}
+				#endif
+				break;
+
+			case VALIDATED_BPDU_TYPE_STP_TCN:
+				LOG (bridge, portIndex, -1, "TCN BPDU.\r\n");
+				break;
+
+			case VALIDATED_BPDU_TYPE_UNKNOWN:
+				LOG (bridge, portIndex, -1, "Invalid BPDU received. Discarding it.\r\n");
+				break;
+
+			default:
+				assert(false);
+		}
+
+		if (type != VALIDATED_BPDU_TYPE_UNKNOWN)
+		{
+			assert (bridge->receivedBpduContent == NULL);
+			assert (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_UNKNOWN);
+			assert (bridge->ports [portIndex]->rcvdBpdu == false);
+
+			bridge->receivedBpduContent = (MSTP_BPDU*) bpdu;
+			bridge->receivedBpduType = type;
+			bridge->receivedBpduPort = bridge->ports[portIndex];
+			bridge->ports [portIndex]->rcvdBpdu = true;
+
+			// Only the PortReceive state machine of this port reads rcvdBpdu. We start from the state machines
+			// of this port, and those of other ports will be evaluated only if something they read is changed.
+			bridge->MarkPortDirty (portIndex);
+			RunStateMachines (bridge, timestamp);
+
+			bridge->receivedBpduContent = NULL; // to cause an exception on access
+			bridge->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN; // to cause asserts on access
+			bridge->receivedBpduPort = NULL;
+
+			// Check that the state machines did process the BPDU.
+			assert (bridge->ports [portIndex]->rcvdBpdu == false);
+
+			// Remember it for ProcessRepeatedBpdu. TCN BPDUs have no repeat processing.
+			PORT* port = bridge->ports [portIndex];
+			if (type == VALIDATED_BPDU_TYPE_STP_TCN)
+				port->lastRcvdBpduSize = 0;
+			else
+			{
+				unsigned int maxBpduSize = bridge->GetMaxBpduSize();
+				memcpy (port->lastRcvdBpdu, bpdu, (bpduSize < maxBpduSize) ? bpduSize : maxBpduSize);
+				port->lastRcvdBpduSize = bpduSize;
+			}
+		}
+	}
+
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+}
+
+void STP_OnBpduReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	assert (!bridge->configTransaction);
+
+	if (bridge->started)
+	{
+		ProcessReceivedBpdu (bridge, portIndex, bpdu, bpduSize, timestamp);
+		FLUSH_LOG (bridge);
+	}
+	else
+		COUNT_STATISTIC (bridge->ports [portIndex]->statistics.rxDiscardedBpdus);
+}
+
+// Not in the standard. Processes the BPDUs in order, each one as STP_OnBpduReceived would, except that the
+// PortTransmit state machines are evaluated, and the log is flushed, only once at the end. This way ports don't
+// transmit information that the next BPDUs of the batch would supersede right away.
+void STP_OnBpdusReceived (STP_BRIDGE* bridge, const STP_RECEIVED_BPDU* bpdus, unsigned int bpduCount)
+{
+	assert (!bridge->configTransaction);
+
+	if (bridge->started && (bpduCount > 0))
+	{
+		bridge->transmitDeferred = true;
+
+		for (unsigned int i = 0; i < bpduCount; i++)
+			ProcessReceivedBpdu (bridge, bpdus[i].portIndex, bpdus[i].bpdu, bpdus[i].bpduSize, bpdus[i].timestamp);
+
+		bridge->transmitDeferred = false;
+
+		RunStateMachines (bridge, bpdus[bpduCount - 1].timestamp);
+
+		FLUSH_LOG (bridge);
+	}
+	else
+	{
+		for (unsigned int i = 0; i < bpduCount; i++)
+			COUNT_STATISTIC (bridge->ports [bpdus[i].portIndex]->statistics.rxDiscardedBpdus);
+	}
+}
+
+// ============================================================================
+
+static const unsigned char BpduDestinationAddress[6] = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 };
+static const unsigned char BpduLlcHeader[3] = { 0x42, 0x42, 0x03 };
+
+// Not in the standard. Returns a pointer to the BPDU within a frame addressed to the Bridge Group Address
+// and encapsulated with an 802.3 Length field followed by the LLC header 42-42-03.
+// Any number of 802.1Q (8100) and 802.1ad (88A8, 9100) tags may precede the Length field;
+// DSA and EDSA tags, when expected, sit right after the source address. Returns NULL for any other frame.
+const unsigned char* STP_GetBpduFromFrame (const unsigned char* frame, unsigned int frameSize, enum STP_FRAME_TAG_FORMAT tagFormat,
+                                           unsigned int* bpduSizeOut, unsigned int* dsaSourcePortOutOrNull)
+{
+	unsigned int offset = 12;
+	if (tagFormat == STP_FRAME_TAG_FORMAT_DSA)
+		offset += 4;
+	else if (tagFormat == STP_FRAME_TAG_FORMAT_EDSA)
+		offset += 8;
+	else
+		assert (tagFormat == STP_FRAME_TAG_FORMAT_NONE);
+
+	// Destination address, tags, Length field and LLC header, all at fixed offsets except for the VLAN tags.
+	// These are a few word-sized compares once the compiler inlines the constant-size memcmp calls.
+	if ((frameSize < offset + 5) || (memcmp (frame, BpduDestinationAddress, 6) != 0))
+		return NULL;
+
+	if (dsaSourcePortOutOrNull != NULL)
+	{
+		// The source port is in bits 7:3 of the second byte of the DSA tag; in an EDSA tag the DSA tag follows
+		// the EtherType and two reserved bytes. See 88E6352_Functional_Specification-Rev0-08.pdf, Figure 29.
+		if (tagFormat == STP_FRAME_TAG_FORMAT_DSA)
+			*dsaSourcePortOutOrNull = frame[13] >> 3;
+		else if (tagFormat == STP_FRAME_TAG_FORMAT_EDSA)
+			*dsaSourcePortOutOrNull = frame[17] >> 3;
+	}
+
+	unsigned int lengthOrType = (frame[offset] << 8) | frame[offset + 1];
+	while ((lengthOrType == 0x8100) || (lengthOrType == 0x88A8) || (lengthOrType == 0x9100))
+	{
+		offset += 4;
+		if (frameSize < offset + 5)
+			return NULL;
+		lengthOrType = (frame[offset] << 8) | frame[offset + 1];
+	}
+
+	// A Length (not an EtherType, nor a value in the undefined range 1501..1535) that covers at least the LLC header
+	// and doesn't go past the end of the frame. Frames shorter than 64 bytes are padded, so the BPDU size comes
+	// from the Length field, not from frameSize.
+	if ((lengthOrType < 3) || (lengthOrType > 1500) || (lengthOrType > frameSize - offset - 2))
+		return NULL;
+
+	if (memcmp (&frame[offset + 2], BpduLlcHeader, 3) != 0)
+		return NULL;
+
+	*bpduSizeOut = lengthOrType - 3;
+	return &frame[offset + 5];
+}
+
+// Not in the standard. Calls STP_OnBpduReceived with the BPDU within the frame, if the frame is a BPDU frame.
+// Returns whether it was one.
+bool STP_OnFrameReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* frame, unsigned int frameSize,
+                          enum STP_FRAME_TAG_FORMAT tagFormat, unsigned int timestamp)
+{
+	unsigned int bpduSize;
+	const unsigned char* bpdu = STP_GetBpduFromFrame (frame, frameSize, tagFormat, &bpduSize, NULL);
+	if (bpdu == NULL)
+		return false;
+
+	STP_OnBpduReceived (bridge, portIndex, bpdu, bpduSize, timestamp);
+	return true;
+}
+
+// ============================================================================
+
+bool STP_IsBridgeStarted (const STP_BRIDGE* bridge)
+{
+	return bridge->started;
+}
+
+// ============================================================================
+
+void STP_EnableLogging (STP_BRIDGE* bridge, bool enable)
+{
+	#if STP_USE_LOG
+		bridge->loggingEnabled = enable;
+	#endif
+}
+
+// ============================================================================
+
+bool STP_IsLoggingEnabled (const STP_BRIDGE* bridge)
+{
+	#if STP_USE_LOG
+		return bridge->loggingEnabled;
+	#else
+		return false;
+	#endif
+}
+
+// ============================================================================
+
+void STP_SetLogCategories (STP_BRIDGE* bridge, unsigned int categories)
+{
+	#if STP_USE_LOG
+		assert ((categories & ~STP_LOG_CATEGORY_ALL) == 0);
+		bridge->logCategories = categories;
+	#endif
+}
+
+// ============================================================================
+
+unsigned int STP_GetLogCategories (const STP_BRIDGE* bridge)
+{
+	#if STP_USE_LOG
+		return bridge->logCategories;
+	#else
+		return 0;
+	#endif
+}
+
+// ============================================================================
+
+void STP_EnablePortLogging (STP_BRIDGE* bridge, unsigned int portIndex, bool enable)
+{
+	#if STP_USE_LOG
+		assert (portIndex < bridge->portCount);
+		PORT* port = bridge->ports [portIndex];
+		if (port->logEnabled != enable)
+		{
+			port->logEnabled = enable;
+			if (enable)
+				bridge->logFilteredCount--;
+			else
+				bridge->logFilteredCount++;
+		}
+	#endif
+}
+
+// ============================================================================
+
+void STP_EnableTreeLogging (STP_BRIDGE* bridge, unsigned int treeIndex, bool enable)
+{
+	#if STP_USE_LOG
+		assert (treeIndex <= bridge->mstiCount);
+		BRIDGE_TREE* tree = bridge->trees [treeIndex];
+		if (tree->logEnabled != enable)
+		{
+			tree->logEnabled = enable;
+			if (enable)
+				bridge->logFilteredCount--;
+			else
+				bridge->logFilteredCount++;
+		}
+	#endif
+}
+
+// ============================================================================
+
+void STP_StartTrace (STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize)
 {
-	if (bridge->started)
-	{
-		LOG (bridge, -1, -1, "{T}: One second:\r\n", timestamp);
-
-		for (unsigned int givenPort = 0; givenPort < bridge->portCount; givenPort++)
-			bridge->ports [givenPort]->tick = true;
-
-		RunStateMachines (bridge, timestamp);
+	#if STP_USE_LOG
+		assert (bridge->traceBuffer == NULL);
+		assert (sizeof (TRACE_ENTRY_HEADER) <= STP_TRACE_RECORD_SIZE);
+		assert (bufferSize >= STP_TRACE_MAX_ENTRY_SIZE);
 
-		LOG (bridge, -1, -1, "------------------------------------\r\n");
+		// Text logged until now goes to the debugStrOut callback; from here on the LOG calls produce trace entries.
 		FLUSH_LOG (bridge);
-	}
+
+		bridge->traceBuffer = (unsigned char*) buffer;
+		bridge->traceRecordCount = bufferSize / STP_TRACE_RECORD_SIZE;
+		bridge->traceReadIndex = 0;
+		bridge->traceUsedCount = 0;
+		bridge->traceLostCount = 0;
+	#endif
 }
 
 // ============================================================================
 
-void STP_OnBpduReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+void STP_StopTrace (STP_BRIDGE* bridge)
 {
-	if (bridge->started)
-	{
-		if (bridge->ports [portIndex]->portEnabled == false)
-		{
-			LOG (bridge, -1, -1, "{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n", timestamp, 1 + portIndex);
-		}
-		else
-		{
-			LOG (bridge, -1, -1, "{T}: BPDU received on Port {D}:\r\n", timestamp, 1 + portIndex);
-
-			enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bridge->ForceProtocolVersion, bpdu, bpduSize);
-			switch (type)
-			{
-				case VALIDATED_BPDU_TYPE_STP_CONFIG:
-					#if STP_USE_LOG
-						LOG (bridge, portIndex, -1, "Config BPDU:\r\n");
-						LOG_INDENT (bridge);
-						DumpConfigBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-						LOG_UNINDENT (bridge);
-					#endif
-					break;
-
-				case VALIDATED_BPDU_TYPE_RST:
-					#if STP_USE_LOG
-						LOG (bridge, portIndex, -1, "RSTP BPDU:\r\n");
-						LOG_INDENT (bridge);
-						DumpRstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-						LOG_UNINDENT (bridge);
-					#endif
-					break;
+	#if STP_USE_LOG
+		bridge->traceBuffer = NULL;
+	#endif
+}
 
-				case VALIDATED_BPDU_TYPE_MST:
-				case VALIDATED_BPDU_TYPE_SPT:
-					#if STP_USE_LOG
-						if (type == VALIDATED_BPDU_TYPE_MST)
-							LOG (bridge, portIndex, -1, "MSTP BPDU:\r\n");
-						else
-							LOG (bridge, portIndex, -1, "SPT BPDU (processed as MSTP):\r\n");
-						LOG_INDENT (bridge);
-						DumpMstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-						LOG_UNINDENT (bridge);
-					#endif
-					break;
+// ============================================================================
 
-				case VALIDATED_BPDU_TYPE_STP_TCN:
-					LOG (bridge, portIndex, -1, "TCN BPDU.\r\n");
-					break;
+bool STP_IsTraceActive (const STP_BRIDGE* bridge)
+{
+	#if STP_USE_LOG
+		return bridge->traceBuffer != NULL;
+	#else
+		return false;
+	#endif
+}
 
-				case VALIDATED_BPDU_TYPE_UNKNOWN:
-					LOG (bridge, portIndex, -1, "Invalid BPDU received. Discarding it.\r\n");
-					break;
+// ============================================================================
 
-				default:
-					assert(false);
-			}
+unsigned int STP_ReadTrace (STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize, unsigned int* lostEntryCountOutOrNull)
+{
+	#if STP_USE_LOG
+		assert (bridge->traceBuffer != NULL);
 
-			if (type != VALIDATED_BPDU_TYPE_UNKNOWN)
-			{
-				assert (bridge->receivedBpduContent == NULL);
-				assert (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_UNKNOWN);
-				assert (bridge->ports [portIndex]->rcvdBpdu == false);
+		if (lostEntryCountOutOrNull != NULL)
+			*lostEntryCountOutOrNull = bridge->traceLostCount;
+		bridge->traceLostCount = 0;
 
-				bridge->receivedBpduContent = (MSTP_BPDU*) bpdu;
-				bridge->receivedBpduType = type;
-				bridge->receivedBpduPort = bridge->ports[portIndex];
-				bridge->ports [portIndex]->rcvdBpdu = true;
+		return STP_ReadTraceEntries (bridge, (unsigned char*) buffer, bufferSize);
+	#else
+		if (lostEntryCountOutOrNull != NULL)
+			*lostEntryCountOutOrNull = 0;
+		return 0;
+	#endif
+}
 
-				RunStateMachines (bridge, timestamp);
+// ============================================================================
 
-				bridge->receivedBpduContent = NULL; // to cause an exception on access
-				bridge->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN; // to cause asserts on access
-				bridge->receivedBpduPort = NULL;
+void STP_DecodeTrace (STP_BRIDGE* bridge, const void* trace, unsigned int traceSize)
+{
+	#if STP_USE_LOG
+		STP_DecodeTraceEntries (bridge, (const unsigned char*) trace, traceSize);
+	#endif
+}
 
-				// Check that the state machines did process the BPDU.
-				assert (bridge->ports [portIndex]->rcvdBpdu == false);
-			}
-		}
+// ============================================================================
 
-		LOG (bridge, -1, -1, "------------------------------------\r\n");
-		FLUSH_LOG (bridge);
-	}
+void STP_EnableDeferredLog (STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize)
+{
+	#if STP_USE_LOG
+		assert (bridge->logRing == NULL);
+
+		// Any piece of text the log writer produces must fit in the empty ring,
+		// and the last byte of the buffer is the zero after the end of the ring.
+		assert (bufferSize >= sizeof (LOG_RING_ENTRY_HEADER) + bridge->logBufferMaxSize + 1);
+
+		bridge->logRing = (char*) buffer;
+		bridge->logRingSize = bufferSize - 1;
+		bridge->logRing[bridge->logRingSize] = 0;
+		bridge->logRingReadOffset = 0;
+		bridge->logRingUsedSize = 0;
+		bridge->logRingLostSize = 0;
+	#endif
 }
 
 // ============================================================================
 
-bool STP_IsBridgeStarted (const STP_BRIDGE* bridge)
+void STP_DisableDeferredLog (STP_BRIDGE* bridge)
 {
-	return bridge->started;
+	#if STP_USE_LOG
+		assert (bridge->logRing != NULL);
+
+		// What the ring still holds goes to the debugStrOut callback now, in order.
+		STP_DrainLogRing (bridge, bridge->logRingUsedSize);
+
+		bridge->logRing = NULL;
+	#endif
 }
 
 // ============================================================================
 
-void STP_EnableLogging (STP_BRIDGE* bridge, bool enable)
+bool STP_IsLogDeferred (const STP_BRIDGE* bridge)
 {
 	#if STP_USE_LOG
-		bridge->loggingEnabled = enable;
+		return bridge->logRing != NULL;
+	#else
+		return false;
 	#endif
 }
 
 // ============================================================================
 
-bool STP_IsLoggingEnabled (const STP_BRIDGE* bridge)
+unsigned int STP_DrainLog (STP_BRIDGE* bridge, unsigned int maxSize, unsigned int* lostSizeOutOrNull)
 {
 	#if STP_USE_LOG
-		return bridge->loggingEnabled;
+		if (lostSizeOutOrNull != NULL)
+			*lostSizeOutOrNull = bridge->logRingLostSize;
+		bridge->logRingLostSize = 0;
+
+		if (bridge->logRing == NULL)
+			return 0;
+
+		return STP_DrainLogRing (bridge, maxSize);
 	#else
-		return false;
+		if (lostSizeOutOrNull != NULL)
+			*lostSizeOutOrNull = 0;
+		return 0;
 	#endif
 }
 
@@ -541,11 +1359,15 @@ rep:
 	if (newState != 0)
 	{
 		#if STP_USE_LOG
-			const char* newStateName = smInfo.getStateName(newState);
-			LogTransition (bridge, smInfo.smName, newStateName, portTreeArgs);
+			if (LOG_CATEGORY_ENABLED (bridge, STP_LOG_CATEGORY_TRANSITIONS))
+			{
+				const char* newStateName = smInfo.getStateName(newState);
+				LogTransition (bridge, smInfo.smName, newStateName, portTreeArgs);
+			}
 		#endif
 
 		smInfo.initState (bridge, portTreeArgs, newState, timestamp);
+		COUNT_STATISTIC (bridge->statistics.transitions [smInfo.id]);
 
 		state = newState;
 		changed = true;
@@ -557,56 +1379,264 @@ rep:
 
 // ============================================================================
 
+// Packs the variables of a port/tree that the state machines of other ports read (through allSynced,
+// reRooted and the PortRoleSelection state machine).
+static unsigned int GetCrossPortVariables (const PORT_TREE* portTree)
+{
+	return (portTree->GetSelected() ? 1 : 0)
+		| (portTree->GetUpdtInfo() ? 2 : 0)
+		| (portTree->GetSynced()   ? 4 : 0)
+		| (portTree->GetReselect() ? 8 : 0)
+		| ((portTree->GetRrWhile() != 0) ? 0x10 : 0)
+		| ((unsigned int) portTree->role << 8)
+		| ((unsigned int) portTree->selectedRole << 16);
+}
+
+// Tells whether a change in the value returned by GetCrossPortVariables may cause a transition in the state machines
+// of other ports for the same tree. allSynced and reRooted appear in the transition conditions only as terms that
+// enable a transition, so we care only about the changes that can make them go from FALSE to TRUE. For example,
+// selected going to FALSE when a BPDU is received cannot enable any transition on another port, but selected going
+// back to TRUE after the role selection can.
+static bool CrossPortConditionsAffected (unsigned int before, unsigned int after)
+{
+	if ((before & ~after & (2 | 0x10)) != 0) // updtInfo cleared, rrWhile reached zero
+		return true;
+
+	if ((~before & after & (1 | 4)) != 0) // selected or synced set
+		return true;
+
+	if ((before >> 8) != (after >> 8)) // role or selectedRole changed
+		return true;
+
+	return false;
+}
+
+// Finds the first port with index greater than or equal to fromPortIndex whose bit is set in the given bitmap,
+// clears the bit and returns the port index. Returns portCount if there's no such port.
+static unsigned int TakeNextDirtyPort (STP_BRIDGE* bridge, unsigned int* bitmap, unsigned int fromPortIndex)
+{
+	unsigned int wordIndex = fromPortIndex / 32;
+	unsigned int word = (wordIndex < bridge->portBitsetWordCount()) ? (bitmap[wordIndex] & (0xFFFFFFFF << (fromPortIndex % 32))) : 0;
+
+	while (word == 0)
+	{
+		wordIndex++;
+		if (wordIndex >= bridge->portBitsetWordCount())
+			return bridge->portCount;
+		word = bitmap[wordIndex];
+	}
+
+	unsigned int bitIndex = 0;
+	while ((word & (1u << bitIndex)) == 0)
+		bitIndex++;
+
+	unsigned int portIndex = wordIndex * 32 + bitIndex;
+	if (portIndex >= bridge->portCount)
+		return bridge->portCount;
+
+	bitmap[wordIndex] &= ~(1u << bitIndex);
+	return portIndex;
+}
+
+// Not in the standard. See STP_GetTransmitBurstHistogram.
+static void RecordTransmitBurst (STP_BRIDGE* bridge)
+{
+	if (bridge->transmitBurstSize > 0)
+	{
+		unsigned int bucket = 0;
+		while ((bucket < STP_TRANSMIT_BURST_HISTOGRAM_SIZE - 1) && ((bridge->transmitBurstSize >> (bucket + 1)) != 0))
+			bucket++;
+
+		bridge->transmitBurstHistogram[bucket]++;
+		bridge->transmitBurstSize = 0;
+	}
+}
+
+#if STP_USE_STATISTICS
+// Not in the standard. A tree is stable when on each port the role selection is done (selected set, role equal
+// to selectedRole) and the port state matches the role: learning and forwarding for the Root, Designated and
+// Master Ports, neither for the others.
+static bool IsTreeStable (const STP_BRIDGE* bridge, unsigned int treeIndex)
+{
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		const PORT_TREE* portTree = bridge->ports[portIndex]->trees[treeIndex];
+
+		if (!portTree->GetSelected() || (portTree->role != portTree->selectedRole))
+			return false;
+
+		bool forwardingRole = (portTree->role == STP_PORT_ROLE_ROOT)
+			|| (portTree->role == STP_PORT_ROLE_DESIGNATED)
+			|| (portTree->role == STP_PORT_ROLE_MASTER);
+
+		if ((portTree->learning != forwardingRole) || (portTree->forwarding != forwardingRole))
+			return false;
+	}
+
+	return true;
+}
+
+// Not in the standard. See STP_TREE_STATISTICS::convergenceHistogram.
+static void RecordConvergences (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+	{
+		BRIDGE_TREE* tree = bridge->trees[treeIndex];
+		if (!tree->convergencePending || !IsTreeStable (bridge, treeIndex))
+			continue;
+
+		unsigned int time = timestamp - tree->convergenceStartTimestamp;
+
+		unsigned int bucket = 0;
+		while ((bucket < STP_CONVERGENCE_HISTOGRAM_SIZE - 1) && ((time >> (bucket + 1)) != 0))
+			bucket++;
+
+		tree->statistics.convergenceHistogram[bucket]++;
+		tree->statistics.lastConvergenceTime = time;
+		if (tree->statistics.maxConvergenceTime < time)
+			tree->statistics.maxConvergenceTime = time;
+
+		tree->convergencePending = false;
+	}
+}
+#endif
+
+// Evaluates the dirty state machine instances (see STP_BRIDGE::MarkPortDirty and the related functions) until no
+// transition happens anymore. The instances are visited in the same order as in a full sweep over all of them,
+// and an instance that is not dirty would return no transition anyway, so the resulting sequence of transitions
+// is the same as the one produced by evaluating all instances until nothing changes.
 static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 {
 	bool changed;
+	unsigned int iterations = 0;
 
 	do
 	{
 		changed = false;
+		iterations++;
 
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		// Ports marked during this pass are picked up by this same loop if their index is greater than the current one,
+		// or by the next pass otherwise -- the same as the order in which a full sweep would see the changes.
+		for (unsigned int portIndex = TakeNextDirtyPort (bridge, bridge->dirtyPorts, 0); portIndex < bridge->portCount;
+			portIndex = TakeNextDirtyPort (bridge, bridge->dirtyPorts, portIndex + 1))
 		{
 			PORT* port = bridge->ports[portIndex];
-			changed |= RunStateMachineInstance (bridge, PortTimers           ::sm, port->portTimersState,            timestamp, (PortIndex) portIndex);
-			changed |= RunStateMachineInstance (bridge, PortProtocolMigration::sm, port->portProtocolMigrationState, timestamp, (PortIndex) portIndex);
-			changed |= RunStateMachineInstance (bridge, PortReceive          ::sm, port->portReceiveState,           timestamp, (PortIndex) portIndex);
-			changed |= RunStateMachineInstance (bridge, BridgeDetection      ::sm, port->bridgeDetectionState,       timestamp, (PortIndex) portIndex);
-			//changed |= RunStateMachineInstance (bridge, &L2GP::sm,                  portIndex, -1, &port->l2gpState,                  timestamp);
 
-			for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+			if (port->smDirty)
+			{
+				port->smDirty = false;
+
+				// PortTimers marks by itself what's affected by the timers it decrements.
+				changed |= RunStateMachineInstance (bridge, PortTimers::sm, port->portTimersState, timestamp, (PortIndex) portIndex);
+
+				bool portChanged = false;
+				portChanged |= RunStateMachineInstance (bridge, PortProtocolMigration::sm, port->portProtocolMigrationState, timestamp, (PortIndex) portIndex);
+				portChanged |= RunStateMachineInstance (bridge, PortReceive          ::sm, port->portReceiveState,           timestamp, (PortIndex) portIndex);
+				portChanged |= RunStateMachineInstance (bridge, BridgeDetection      ::sm, port->bridgeDetectionState,       timestamp, (PortIndex) portIndex);
+				//portChanged |= RunStateMachineInstance (bridge, &L2GP::sm,                  portIndex, -1, &port->l2gpState,                  timestamp);
+				if (portChanged)
+				{
+					bridge->MarkPortDirty (portIndex);
+					changed = true;
+				}
+			}
+
+			if (port->treeSmDirty)
 			{
-				PORT_TREE* tree = port->trees[treeIndex];
-				PortAndTree pt = { (PortIndex)portIndex, (TreeIndex)treeIndex };
-				changed |= RunStateMachineInstance (bridge, PortInformation    ::sm, tree->portInformationState,     timestamp, pt);
-				changed |= RunStateMachineInstance (bridge, PortRoleTransitions::sm, tree->portRoleTransitionsState, timestamp, pt);
-				changed |= RunStateMachineInstance (bridge, PortStateTransition::sm, tree->portStateTransitionState, timestamp, pt);
-				changed |= RunStateMachineInstance (bridge, TopologyChange     ::sm, tree->topologyChangeState,      timestamp, pt);
+				port->treeSmDirty = false;
+
+				for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+				{
+					PORT_TREE* tree = port->trees[treeIndex];
+					if (!tree->smDirty && !tree->roleTransitionsSmDirty)
+						continue;
+
+					bool runAll = tree->smDirty;
+					tree->smDirty = false;
+					tree->roleTransitionsSmDirty = false;
+
+					unsigned int crossPortVariables = GetCrossPortVariables (tree);
+
+					PortAndTree pt = { (PortIndex)portIndex, (TreeIndex)treeIndex };
+					bool treeChanged = false;
+					if (runAll)
+						treeChanged |= RunStateMachineInstance (bridge, PortInformation    ::sm, tree->portInformationState,     timestamp, pt);
+					treeChanged |= RunStateMachineInstance (bridge, PortRoleTransitions::sm, tree->portRoleTransitionsState, timestamp, pt);
+					if (runAll || treeChanged)
+					{
+						treeChanged |= RunStateMachineInstance (bridge, PortStateTransition::sm, tree->portStateTransitionState, timestamp, pt);
+						treeChanged |= RunStateMachineInstance (bridge, TopologyChange     ::sm, tree->topologyChangeState,      timestamp, pt);
+					}
+					if (treeChanged)
+					{
+						// Some of the procedures invoked by these state machines write per-port variables,
+						// or variables of other trees of the same port, so we mark the whole port.
+						bridge->MarkPortDirty (portIndex);
+
+						unsigned int newCrossPortVariables = GetCrossPortVariables (tree);
+						if (CrossPortConditionsAffected (crossPortVariables, newCrossPortVariables))
+							bridge->MarkTreeRoleTransitionsDirty (treeIndex);
+						if (newCrossPortVariables & ~crossPortVariables & 8) // reselect set
+							bridge->trees[treeIndex]->roleSelectionSmDirty = true;
+
+						changed = true;
+					}
+				}
 			}
 		}
 
 		for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
 		{
 			BRIDGE_TREE* tree = bridge->trees[treeIndex];
-			changed |= RunStateMachineInstance (bridge, PortRoleSelection::sm, tree->portRoleSelectionState, timestamp, (TreeIndex) treeIndex);
+			if (tree->roleSelectionSmDirty)
+			{
+				tree->roleSelectionSmDirty = false;
+				// The procedures invoked by this state machine (updtRolesTree, setSelectedTree and the others)
+				// mark the ports whose variables they actually change.
+				if (RunStateMachineInstance (bridge, PortRoleSelection::sm, tree->portRoleSelectionState, timestamp, (TreeIndex) treeIndex))
+					changed = true;
+			}
 		}
 
 		// We execute the PortTransmit state machine only after all other state machines have finished executing,
 		// so as to avoid transmitting BPDUs containing results from intermediary calculations.
 		// See Note 1 on page 541 of 802.1Q-2018.
-		if (!changed)
+		if (!changed && !bridge->transmitDeferred)
 		{
-			for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+			for (unsigned int portIndex = TakeNextDirtyPort (bridge, bridge->dirtyTransmitPorts, 0); portIndex < bridge->portCount;
+				portIndex = TakeNextDirtyPort (bridge, bridge->dirtyTransmitPorts, portIndex + 1))
 			{
 				PORT* port = bridge->ports[portIndex];
-				changed |= RunStateMachineInstance (bridge, PortTransmit::sm, port->portTransmitState, timestamp, (PortIndex) portIndex);
+				if (RunStateMachineInstance (bridge, PortTransmit::sm, port->portTransmitState, timestamp, (PortIndex) portIndex))
+				{
+					bridge->MarkPortDirty (portIndex);
+					changed = true;
+				}
 			}
 		}
 	} while (changed);
+
+	#if STP_USE_STATISTICS
+		bridge->statistics.stateMachineRuns++;
+		bridge->statistics.stateMachineIterations += iterations;
+		if (bridge->statistics.maxStateMachineIterations < iterations)
+			bridge->statistics.maxStateMachineIterations = iterations;
+
+		RecordConvergences (bridge, timestamp);
+	#endif
+
+	RecordTransmitBurst (bridge);
+	FlushTransmitBatch (bridge, timestamp);
 }
 
 static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 {
+	if (bridge->configTransaction)
+	{
+		bridge->restartPending = true;
+		return;
+	}
+
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		PORT* port = bridge->ports[portIndex];
@@ -630,9 +1660,22 @@ static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
 		bridge->trees[treeIndex]->portRoleSelectionState = (PortRoleSelection::State)0;
 
+	#if STP_USE_STATISTICS
+		// The restart starts a new convergence of the trees that run, and abandons the measurements of those that
+		// don't (the MSTIs, after a switch away from MSTP).
+		for (unsigned int treeIndex = 0; treeIndex < 1 + bridge->mstiCount; treeIndex++)
+		{
+			bridge->trees[treeIndex]->convergencePending = (treeIndex < bridge->treeCount());
+			bridge->trees[treeIndex]->convergenceStartTimestamp = timestamp;
+		}
+	#endif
+
 	bridge->BEGIN = true;
+	bridge->MarkAllDirty();
+	bridge->InvalidateAllTxBpdus();
 	RunStateMachines (bridge, timestamp);
 	bridge->BEGIN = false;
+	bridge->MarkAllDirty();
 	RunStateMachines (bridge, timestamp);
 }
 
@@ -641,6 +1684,9 @@ static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 void STP_SetPortAdminEdge (struct STP_BRIDGE* bridge, unsigned int portIndex, bool adminEdge, unsigned int timestamp)
 {
 	bridge->ports [portIndex]->AdminEdge = adminEdge;
+
+	// The state machines will see the new value next time they run.
+	bridge->MarkPortDirty (portIndex);
 }
 
 bool STP_GetPortAdminEdge (const struct STP_BRIDGE* bridge, unsigned int portIndex)
@@ -653,6 +1699,9 @@ bool STP_GetPortAdminEdge (const struct STP_BRIDGE* bridge, unsigned int portInd
 void STP_SetPortAutoEdge (struct STP_BRIDGE* bridge, unsigned int portIndex, bool autoEdge, unsigned int timestamp)
 {
 	bridge->ports [portIndex]->AutoEdge = autoEdge;
+
+	// The state machines will see the new value next time they run.
+	bridge->MarkPortDirty (portIndex);
 }
 
 bool STP_GetPortAutoEdge (const struct STP_BRIDGE* bridge, unsigned int portIndex)
@@ -680,7 +1729,11 @@ void STP_SetAdminPointToPointMAC (struct STP_BRIDGE* bridge, unsigned int portIn
 		{
 			port->operPointToPointMAC = newOperPointToPointMAC;
 			if (bridge->started)
-				RunStateMachines (bridge, timestamp);
+			{
+				bridge->MarkAllDirty();
+				if (!bridge->configTransaction)
+					RunStateMachines (bridge, timestamp);
+			}
 		}
 	}
 
@@ -705,41 +1758,53 @@ bool STP_GetOperPointToPointMAC (const STP_BRIDGE* bridge, unsigned int portInde
 
 // ============================================================================
 
+// From page 511 of 802.1Q-2018:
+// BridgeIdentifier, BridgePriority, and BridgeTimes are not modified by the operation of the spanning tree
+// protocols but are treated as constants by the state machines. If they are modified by management, spanning
+// tree priority vectors and Port Role assignments for all trees shall be recomputed, as specified by the
+// operation of the Port Role Selection state machine (13.36) by clearing selected (13.27.67) and setting
+// reselect (13.27.62) for all Bridge Ports for the relevant MSTI and for all trees if the CIST parameter is
+// changed.
+static void ClearSelectedAndSetReselect (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
+{
+	bridge->StartConvergenceMeasurement (treeIndex, timestamp);
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		PORT_TREE* portTree = bridge->ports[portIndex]->trees[treeIndex];
+		portTree->SetSelected (false);
+		portTree->SetReselect (true);
+		bridge->MarkPortTreeDirty (portIndex, treeIndex);
+	}
+
+	bridge->MarkTreeDirty (treeIndex);
+}
+
 static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
 {
-	// From page 511 of 802.1Q-2018:
-	// BridgeIdentifier, BridgePriority, and BridgeTimes are not modified by the operation of the spanning tree
-	// protocols but are treated as constants by the state machines. If they are modified by management, spanning
-	// tree priority vectors and Port Role assignments for all trees shall be recomputed, as specified by the
-	// operation of the Port Role Selection state machine (13.36) by clearing selected (13.27.67) and setting
-	// reselect (13.27.62) for all Bridge Ports for the relevant MSTI and for all trees if the CIST parameter is
-	// changed.
 	if (treeIndex == CIST_INDEX)
 	{
 		// Recompute all trees.
 		// Note that callers of this function expect recomputation for all trees when CIST_INDEX is passed, so don't change this functionality.
 		for (treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
 		{
-			for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-			{
-				PORT_TREE* portTree = bridge->ports[portIndex]->trees[treeIndex];
-				portTree->selected = false;
-				portTree->reselect = true;
-			}
+			if (bridge->configTransaction)
+				bridge->trees[treeIndex]->recomputePending = true;
+			else
+				ClearSelectedAndSetReselect (bridge, treeIndex, timestamp);
 		}
 	}
 	else
 	{
 		// recompute specified MSTI
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			PORT_TREE* portTree = bridge->ports[portIndex]->trees[treeIndex];
-			portTree->selected = false;
-			portTree->reselect = true;
-		}
+		if (bridge->configTransaction)
+			bridge->trees[treeIndex]->recomputePending = true;
+		else
+			ClearSelectedAndSetReselect (bridge, treeIndex, timestamp);
 	}
 
-	RunStateMachines (bridge, timestamp);
+	if (!bridge->configTransaction)
+		RunStateMachines (bridge, timestamp);
 }
 
 // Note AG: Problem when setting a worse bridge priority (numerically higher)
@@ -769,6 +1834,7 @@ void STP_SetBridgePriority (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned
 
 		bid.SetPriorityAndMstid(bridgePriority, treeIndex);
 		bridge->trees[treeIndex]->SetBridgeIdentifier(bid);
+		bridge->InvalidateTxBpdus (treeIndex);
 
 		if (bridge->started && (treeIndex < bridge->treeCount()))
 			RecomputePrioritiesAndPortRoles (bridge, treeIndex, timestamp);
@@ -805,6 +1871,7 @@ void STP_SetPortPriority (STP_BRIDGE* bridge, unsigned int portIndex, unsigned i
 		 portPriority);
 
 	bridge->ports [portIndex]->trees [treeIndex]->portId.SetPriority (portPriority);
+	bridge->InvalidateTxBpdu (portIndex, treeIndex);
 
 	// It would make sense that stuff is recomputed also when the port priority in the portId variable
 	// is changed (as it is recomputed for the bridge priority), but either the spec does not mention this, or I'm not seeing it.
@@ -860,6 +1927,7 @@ void STP_SetMstConfigName (STP_BRIDGE* bridge, const char* name, unsigned int ti
 
 	memset (bridge->MstConfigId.ConfigurationName, 0, 32);
 	memcpy (bridge->MstConfigId.ConfigurationName, name, strlen (name));
+	bridge->InvalidateTxBpdus (CIST_INDEX);
 
 	if (bridge->started)
 		RestartStateMachines(bridge, timestamp);
@@ -876,6 +1944,7 @@ void STP_SetMstConfigRevisionLevel (STP_BRIDGE* bridge, unsigned short revisionL
 
 	bridge->MstConfigId.RevisionLevelHigh = revisionLevel >> 8;
 	bridge->MstConfigId.RevisionLevelLow = revisionLevel & 0xff;
+	bridge->InvalidateTxBpdus (CIST_INDEX);
 
 	if (bridge->started)
 		RestartStateMachines(bridge, timestamp);
@@ -884,19 +1953,86 @@ void STP_SetMstConfigRevisionLevel (STP_BRIDGE* bridge, unsigned short revisionL
 	FLUSH_LOG (bridge);
 }
 
+// The digest is computed over the whole table of 4096 entries (13.8 in 802.1Q-2018), but we store only the entries
+// up to maxVlanNumber; the others are zero. The MD5 state at the start of each 64-byte block of the stored table is
+// kept in mstConfigDigestMidstates, so after a change we resume hashing from the first changed block.
 static void ComputeMstConfigDigest (STP_BRIDGE* bridge)
 {
+	if (bridge->configTransaction)
+	{
+		bridge->mstConfigDigestPending = true;
+		return;
+	}
+
+	static const unsigned char zeroBlock [64] = { };
+
+	unsigned int tableSize = 2 * (1 + bridge->maxVlanNumber);
+	unsigned int blockCount = GetMstConfigTableBlockCount (bridge->maxVlanNumber);
+	const unsigned char* table = (const unsigned char*) bridge->mstConfigTable;
+
 	HMAC_MD5_CONTEXT context;
-	HMAC_MD5_Init (&context);
-	HMAC_MD5_Update (&context, bridge->mstConfigTable, 2 * (1 + bridge->maxVlanNumber));
+	unsigned int blockIndex;
+	if (bridge->mstConfigDigestValidMidstates == 0)
+	{
+		HMAC_MD5_Init (&context);
+		blockIndex = 0;
+	}
+	else
+	{
+		blockIndex = bridge->mstConfigDigestValidMidstates - 1;
+		HMAC_MD5_SetMidstate (&context, bridge->mstConfigDigestMidstates [blockIndex], blockIndex * 64);
+	}
+
+	for (; blockIndex < blockCount; blockIndex++)
+	{
+		HMAC_MD5_GetMidstate (&context, bridge->mstConfigDigestMidstates [blockIndex]);
+
+		if ((blockIndex + 1) * 64 <= tableSize)
+		{
+			HMAC_MD5_Update (&context, &table [blockIndex * 64], 64);
+		}
+		else
+		{
+			// Last block, partly beyond maxVlanNumber.
+			unsigned char block [64];
+			memset (block, 0, 64);
+			memcpy (block, &table [blockIndex * 64], tableSize - blockIndex * 64);
+			HMAC_MD5_Update (&context, block, 64);
+		}
+	}
+
+	bridge->mstConfigDigestValidMidstates = blockCount;
 
-	unsigned short zero = 0;
-	for (int i = (1 + bridge->maxVlanNumber); i < 4096; i++)
-		HMAC_MD5_Update (&context, &zero, 2);
+	for (blockIndex = blockCount; blockIndex < 4096 * 2 / 64; blockIndex++)
+		HMAC_MD5_Update (&context, zeroBlock, 64);
 
 	HMAC_MD5_End (&context);
 
 	memcpy (bridge->MstConfigId.ConfigurationDigest, context.digest, 16);
+	bridge->InvalidateTxBpdus (CIST_INDEX);
+}
+
+static void LogMstConfigDigest (STP_BRIDGE* bridge)
+{
+	if (bridge->configTransaction)
+	{
+		LOG (bridge, -1, -1, "Digest computation deferred until commit.\r\n");
+	}
+	else
+	{
+		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
+			bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
+			bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+	}
+}
+
+// Called after changing the entry for a VLAN, before ComputeMstConfigDigest.
+static void InvalidateMstConfigDigestMidstates (STP_BRIDGE* bridge, unsigned int vlanNumber)
+{
+	// The midstate at the start of the block holding this entry remains valid, those after it don't.
+	unsigned int validMidstates = (vlanNumber * 2) / 64 + 1;
+	if (bridge->mstConfigDigestValidMidstates > validMidstates)
+		bridge->mstConfigDigestValidMidstates = validMidstates;
 }
 
 void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const STP_CONFIG_TABLE_ENTRY* entries, unsigned int entryCount, unsigned int timestamp)
@@ -923,13 +2059,15 @@ void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const STP_CONFIG_TABLE_EN
 		if (entryCount == 4096)
 			assert (entries[4095].treeIndex == 0);
 
+		unsigned int firstChangedVlan = 0;
+		while (memcmp (&bridge->mstConfigTable[firstChangedVlan], &entries[firstChangedVlan], 2) == 0)
+			firstChangedVlan++;
+
 		memcpy (bridge->mstConfigTable, entries, entryCount * 2);
 
+		InvalidateMstConfigDigestMidstates (bridge, firstChangedVlan);
 		ComputeMstConfigDigest (bridge);
-
-		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
-			 bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
-			 bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+		LogMstConfigDigest (bridge);
 
 		if (bridge->started)
 			RestartStateMachines(bridge, timestamp);
@@ -959,11 +2097,9 @@ void STP_SetMstConfigTableEntry (struct STP_BRIDGE* bridge, unsigned int vlanNum
 
 		bridge->mstConfigTable[vlanNumber] = (unsigned short) treeIndex;
 
+		InvalidateMstConfigDigestMidstates (bridge, vlanNumber);
 		ComputeMstConfigDigest (bridge);
-
-		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
-			bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
-			bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+		LogMstConfigDigest (bridge);
 
 		if (bridge->started)
 			RestartStateMachines(bridge, timestamp);
@@ -1009,6 +2145,7 @@ void STP_SetStpVersion (STP_BRIDGE* bridge, enum STP_VERSION version, unsigned i
 		LOG (bridge, -1, -1, "\r\n");
 
 		bridge->ForceProtocolVersion = version;
+		bridge->InvalidateAllTxBpdus();
 
 		if (bridge->started)
 			RestartStateMachines (bridge, timestamp);
@@ -1385,7 +2522,10 @@ extern "C" void STP_SetTxHoldCount (struct STP_BRIDGE* bridge, unsigned int txHo
 	{
 		bridge->TxHoldCount = txHoldCount;
 		for (unsigned int pi = 0; pi < bridge->portCount; pi++)
+		{
 			bridge->ports[pi]->txCount = 0;
+			bridge->MarkPortDirty (pi);
+		}
 	}
 }
 
@@ -1399,3 +2539,75 @@ extern "C" unsigned int STP_GetTxCount (const struct STP_BRIDGE* bridge, unsigne
 	return bridge->ports[portIndex]->txCount;
 }
 
+// ============================================================================
+
+extern "C" void STP_SetHelloStaggering (struct STP_BRIDGE* bridge, bool enable, unsigned int phaseOffset, unsigned int timestamp)
+{
+	// Ports take the new setting into account the next time they restart helloWhen, that is, after their next
+	// transmission. Restarting helloWhen here could delay a periodic transmission beyond the Hello Time.
+	bridge->helloStaggering = enable;
+	bridge->helloStaggeringPhase = phaseOffset;
+}
+
+extern "C" bool STP_GetHelloStaggering (const struct STP_BRIDGE* bridge)
+{
+	return bridge->helloStaggering;
+}
+
+extern "C" void STP_GetTransmitBurstHistogram (const struct STP_BRIDGE* bridge, unsigned int histogramOut[STP_TRANSMIT_BURST_HISTOGRAM_SIZE])
+{
+	for (unsigned int i = 0; i < STP_TRANSMIT_BURST_HISTOGRAM_SIZE; i++)
+		histogramOut[i] = bridge->transmitBurstHistogram[i];
+}
+
+extern "C" void STP_ClearTransmitBurstHistogram (struct STP_BRIDGE* bridge)
+{
+	for (unsigned int i = 0; i < STP_TRANSMIT_BURST_HISTOGRAM_SIZE; i++)
+		bridge->transmitBurstHistogram[i] = 0;
+}
+
+// ============================================================================
+
+extern "C" void STP_GetStatistics (const struct STP_BRIDGE* bridge, struct STP_BRIDGE_STATISTICS* statisticsOut)
+{
+	#if STP_USE_STATISTICS
+		*statisticsOut = bridge->statistics;
+	#else
+		memset (statisticsOut, 0, sizeof (*statisticsOut));
+	#endif
+}
+
+extern "C" void STP_GetPortStatistics (const struct STP_BRIDGE* bridge, unsigned int portIndex, struct STP_PORT_STATISTICS* statisticsOut)
+{
+	assert (portIndex < bridge->portCount);
+
+	#if STP_USE_STATISTICS
+		*statisticsOut = bridge->ports[portIndex]->statistics;
+	#else
+		memset (statisticsOut, 0, sizeof (*statisticsOut));
+	#endif
+}
+
+extern "C" void STP_GetTreeStatistics (const struct STP_BRIDGE* bridge, unsigned int treeIndex, struct STP_TREE_STATISTICS* statisticsOut)
+{
+	// All trees are counted, including the MSTIs while the bridge doesn't run MSTP.
+	assert (treeIndex < 1 + bridge->mstiCount);
+
+	#if STP_USE_STATISTICS
+		*statisticsOut = bridge->trees[treeIndex]->statistics;
+	#else
+		memset (statisticsOut, 0, sizeof (*statisticsOut));
+	#endif
+}
+
+extern "C" void STP_ResetStatistics (struct STP_BRIDGE* bridge)
+{
+	#if STP_USE_STATISTICS
+		memset (&bridge->statistics, 0, sizeof (bridge->statistics));
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+			memset (&bridge->ports[portIndex]->statistics, 0, sizeof (bridge->ports[portIndex]->statistics));
+		for (unsigned int treeIndex = 0; treeIndex < 1 + bridge->mstiCount; treeIndex++)
+			memset (&bridge->trees[treeIndex]->statistics, 0, sizeof (bridge->trees[treeIndex]->statistics));
+	#endif
+}
+
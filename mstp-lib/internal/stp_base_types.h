@@ -18,6 +18,13 @@ inline TreeIndex operator++(TreeIndex& x, int) { TreeIndex res = x; x = (TreeInd
 
 static const TreeIndex CIST_INDEX = (TreeIndex)0;
 
+// Not in the standard. Increments one of the counters returned by STP_GetStatistics and the related functions.
+#if STP_USE_STATISTICS
+	#define COUNT_STATISTIC(counter) ((void) ((counter)++))
+#else
+	#define COUNT_STATISTIC(counter) ((void)0)
+#endif
+
 struct STP_BRIDGE;
 
 // ============================================================================
@@ -154,6 +161,44 @@ public:
 	bool IsBetterThan (const PORT_ID& rhs) const;
 };
 
+// ============================================================================
+
+// Read big-endian numbers from memory with any alignment. Compilers recognize these patterns and generate
+// a single load, followed by a byte swap on little-endian processors.
+
+inline uint16_t LoadBigEndian16 (const unsigned char* p)
+{
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+inline uint64_t LoadBigEndian64 (const unsigned char* p)
+{
+	return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48) | ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32)
+		| ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16) | ((uint64_t) p[6] << 8) | (uint64_t) p[7];
+}
+
+// ============================================================================
+
+// Not in the standard. A priority vector followed by a port identifier, loaded into native integers, so that finding
+// the best of several vectors, with the port identifier as a tie-breaker, takes a few integer compares per vector.
+// See PRIORITY_VECTOR::GetKey and updtRolesTree.
+struct PRIORITY_VECTOR_KEY
+{
+	uint64_t words[4];
+	uint32_t last; // DesignatedPortId in the upper 16 bits, the tie-breaking port identifier in the lower 16 bits
+
+	bool IsLessThan (const PRIORITY_VECTOR_KEY& rhs) const
+	{
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (words[i] != rhs.words[i])
+				return words[i] < rhs.words[i];
+		}
+
+		return last < rhs.last;
+	}
+};
+
 // ============================================================================
 // 13.10 and 13.11 in 802.1Q-2018
 struct PRIORITY_VECTOR
@@ -165,34 +210,64 @@ struct PRIORITY_VECTOR
 	BRIDGE_ID	DesignatedBridgeId;		// e)
 	PORT_ID		DesignatedPortId;		// f)
 
+	// All components are big-endian and laid out from the most significant to the least significant, so comparing
+	// two vectors means comparing their 34 bytes as a big-endian number. We do it as four 64-bit numbers followed
+	// by a 16-bit one. Returns a negative value if this vector is better than rhs, zero if they are the same,
+	// and a positive value if this vector is worse.
+	int Compare (const PRIORITY_VECTOR& rhs) const
+	{
+		const unsigned char* l = (const unsigned char*) this;
+		const unsigned char* r = (const unsigned char*) &rhs;
+
+		for (unsigned int i = 0; i < 32; i += 8)
+		{
+			uint64_t lw = LoadBigEndian64 (&l[i]);
+			uint64_t rw = LoadBigEndian64 (&r[i]);
+			if (lw != rw)
+				return (lw < rw) ? -1 : 1;
+		}
+
+		return (int) LoadBigEndian16 (&l[32]) - (int) LoadBigEndian16 (&r[32]);
+	}
+
+	void GetKey (uint16_t portIdentifier, PRIORITY_VECTOR_KEY* key) const
+	{
+		const unsigned char* p = (const unsigned char*) this;
+
+		for (unsigned int i = 0; i < 4; i++)
+			key->words[i] = LoadBigEndian64 (&p[i * 8]);
+
+		key->last = ((uint32_t) LoadBigEndian16 (&p[32]) << 16) | portIdentifier;
+	}
+
 	bool operator== (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) == 0;
+		return this->Compare (rhs) == 0;
 	}
 
 	bool operator!= (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) != 0;
+		return this->Compare (rhs) != 0;
 	}
 
 	bool IsBetterThan (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) < 0;
+		return this->Compare (rhs) < 0;
 	}
 
 	bool IsBetterThanOrSameAs (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) <= 0;
+		return this->Compare (rhs) <= 0;
 	}
 
 	bool IsWorseThan (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) > 0;
+		return this->Compare (rhs) > 0;
 	}
 
 	bool IsWorseThanOrSameAs (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) >= 0;
+		return this->Compare (rhs) >= 0;
 	}
 
 	bool IsNotBetterThan (const PRIORITY_VECTOR& rhs) const
@@ -260,4 +335,80 @@ enum RCVD_INFO
 
 // ============================================================================
 
+// Bitsets with one bit per port, stored in words of 32 bits. Bit (portIndex % 32) of word (portIndex / 32)
+// belongs to port portIndex. The bits beyond portCount in the last word are always zero.
+
+inline unsigned int GetPortBitsetWordCount (unsigned int portCount)
+{
+	return (portCount + 31) / 32;
+}
+
+inline unsigned int GetPortBitsetLastWordMask (unsigned int portCount)
+{
+	return ((portCount % 32) == 0) ? 0xFFFFFFFF : ((1u << (portCount % 32)) - 1);
+}
+
+// Returns true if the bit is set for at least one port.
+inline bool IsAnyPortBitSet (const unsigned int* bitset, unsigned int portCount)
+{
+	for (unsigned int i = 0; i < GetPortBitsetWordCount (portCount); i++)
+	{
+		if (bitset[i] != 0)
+			return true;
+	}
+
+	return false;
+}
+
+// Returns true if the bit is set for all ports.
+inline bool AreAllPortBitsSet (const unsigned int* bitset, unsigned int portCount)
+{
+	unsigned int wordCount = GetPortBitsetWordCount (portCount);
+	for (unsigned int i = 0; i + 1 < wordCount; i++)
+	{
+		if (bitset[i] != 0xFFFFFFFF)
+			return false;
+	}
+
+	return (wordCount == 0) || (bitset[wordCount - 1] == GetPortBitsetLastWordMask (portCount));
+}
+
+// Returns true if the bit is set for all ports other than exceptPortIndex.
+inline bool AreAllPortBitsSetExcept (const unsigned int* bitset, unsigned int portCount, unsigned int exceptPortIndex)
+{
+	unsigned int wordCount = GetPortBitsetWordCount (portCount);
+	for (unsigned int i = 0; i < wordCount; i++)
+	{
+		unsigned int word = bitset[i];
+		if (i == exceptPortIndex / 32)
+			word |= 1u << (exceptPortIndex % 32);
+
+		if (word != ((i + 1 < wordCount) ? 0xFFFFFFFF : GetPortBitsetLastWordMask (portCount)))
+			return false;
+	}
+
+	return true;
+}
+
+// Sets or clears the bit for all ports.
+inline void SetAllPortBits (unsigned int* bitset, unsigned int portCount, bool value)
+{
+	unsigned int wordCount = GetPortBitsetWordCount (portCount);
+	for (unsigned int i = 0; i + 1 < wordCount; i++)
+		bitset[i] = value ? 0xFFFFFFFF : 0;
+
+	if (wordCount > 0)
+		bitset[wordCount - 1] = value ? GetPortBitsetLastWordMask (portCount) : 0;
+}
+
+// ============================================================================
+
+// Number of 64-byte blocks the MST Config Table takes in memory, for VLANs 0..maxVlanNumber.
+inline unsigned int GetMstConfigTableBlockCount (unsigned int maxVlanNumber)
+{
+	return (2 * (1 + maxVlanNumber) + 63) / 64;
+}
+
+// ============================================================================
+
 #endif
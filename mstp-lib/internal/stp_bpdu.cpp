@@ -81,6 +81,13 @@ static bool Version3LengthIsIntegralNumberOfMstiConfigMsgs (const unsigned char*
 	return ((mstiLength % sizeof(MSTI_CONFIG_MESSAGE)) == 0) && (mstiLength / sizeof(MSTI_CONFIG_MESSAGE) <= 64);
 }
 
+// Not in the standard. For an MST BPDU, the number of MSTI Configuration Messages given by its Version 3 Length.
+size_t GetMstiMessageCount (const MSTP_BPDU* bpdu)
+{
+	size_t version3CistLength = sizeof(MSTP_BPDU) - offsetof (struct MSTP_BPDU, mstConfigId);
+	return (bpdu->Version3Length - version3CistLength) / sizeof(MSTI_CONFIG_MESSAGE);
+}
+
 static bool IsWellFormedSptBpdu (const unsigned char* bpdu, size_t bpduSize)
 {
 	//   4) Is a well-formed an SPT BPDU, i.e., contains
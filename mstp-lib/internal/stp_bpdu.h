@@ -104,6 +104,8 @@ enum VALIDATED_BPDU_TYPE STP_GetValidatedBpduType (enum STP_VERSION bridgeStpVer
 
 BPDU_PORT_ROLE GetBpduPortRole (STP_PORT_ROLE role);
 
+size_t GetMstiMessageCount (const MSTP_BPDU* bpdu);
+
 #if STP_USE_LOG
 void DumpMstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu);
 void DumpRstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu);
@@ -66,7 +66,32 @@ public:
 		return this->BridgePriority;
 	}
 
+	// Not in the standard. PORT_FLAG_COUNT bitsets with one bit per port, one after the other, each of them
+	// GetPortBitsetWordCount(portCount) words long. See PORT_FLAG.
+	unsigned int* portFlags;
+
 	PortRoleSelection::State portRoleSelectionState;
+
+	// Not in the standard. Set when the PortRoleSelection state machine for this tree must be re-evaluated.
+	bool roleSelectionSmDirty;
+
+	// Not in the standard. Set during a configuration transaction when priorities and roles of this tree
+	// must be recomputed at commit. See STP_BeginConfigTransaction.
+	bool recomputePending;
+
+#if STP_USE_LOG
+	// Not in the standard. See STP_EnableTreeLogging.
+	bool logEnabled;
+#endif
+
+#if STP_USE_STATISTICS
+	// Not in the standard. See STP_GetTreeStatistics.
+	STP_TREE_STATISTICS statistics;
+
+	// Not in the standard. Set by STP_BRIDGE::StartConvergenceMeasurement, cleared when the tree is stable again.
+	bool convergencePending;
+	unsigned int convergenceStartTimestamp;
+#endif
 };
 
 // ============================================================================
@@ -83,23 +108,107 @@ struct STP_BRIDGE
 	bool loggingEnabled;
 	int logCurrentPort;
 	int logCurrentTree;
+
+	// Not in the standard. See STP_StartTrace. While traceBuffer is not NULL, the LOG macros append binary entries
+	// to it instead of formatting text. It is a ring of traceRecordCount records, of which traceUsedCount, starting
+	// at traceReadIndex, hold entries not yet read by STP_ReadTrace.
+	unsigned char* traceBuffer;
+	unsigned int traceRecordCount;
+	unsigned int traceReadIndex;
+	unsigned int traceUsedCount;
+	unsigned int traceLostCount;
+	unsigned int traceTimestamp;
+
+	// Not in the standard. See STP_EnableDeferredLog. While logRing is not NULL, the text meant for the debugStrOut
+	// callback is stored in this ring of logRingSize bytes, of which logRingUsedSize, starting at logRingReadOffset,
+	// hold entries not yet passed to the callback by STP_DrainLog. The ring is in a buffer owned by the application;
+	// the byte after the end of the ring, the last one of the buffer, is always zero.
+	char* logRing;
+	unsigned int logRingSize;
+	unsigned int logRingReadOffset;
+	unsigned int logRingUsedSize;
+	unsigned int logRingLostSize;
+
+	// Not in the standard. See STP_SetLogCategories and STP_EnablePortLogging. logFilteredCount is the number
+	// of ports and trees whose PORT::logEnabled or BRIDGE_TREE::logEnabled is false.
+	unsigned int logCategories;
+	unsigned int logFilteredCount;
 #endif
 
 	bool BEGIN; // Defined in 13.23.1 in 802.1Q-2005. Widely used but definition was removed subsequent versions of the standard.
 	bool started; // Added by me. STP_StartBridge sets it, STP_StopBridge clears it.
 
+	// Not in the standard. Between STP_BeginConfigTransaction and STP_CommitConfigTransaction, the configuration
+	// functions only record what they'd have to do, and the commit does it once. See also BRIDGE_TREE::recomputePending.
+	bool configTransaction;
+	bool restartPending;
+	bool mstConfigDigestPending;
+
+	// Not in the standard. See STP_SetHelloStaggering. tickCounter counts the one-second ticks, including
+	// those skipped by STP_AdvanceTime; only its value modulo HelloTime matters.
+	bool helloStaggering;
+	unsigned int helloStaggeringPhase;
+	unsigned int tickCounter;
+
+	// Not in the standard. transmitBurstSize counts the BPDUs transmitted during the current run of
+	// RunStateMachines; at the end of the run it's added to transmitBurstHistogram. See STP_GetTransmitBurstHistogram.
+	unsigned int transmitBurstSize;
+	unsigned int transmitBurstHistogram[STP_TRANSMIT_BURST_HISTOGRAM_SIZE];
+
+#if STP_USE_STATISTICS
+	// Not in the standard. See STP_GetStatistics; the per-port and per-tree counters are in PORT and BRIDGE_TREE.
+	STP_BRIDGE_STATISTICS statistics;
+#endif
+
+	// Not in the standard. Used only when callbacks.transmitBatch is not NULL: the BPDUs transmitted during a run of
+	// RunStateMachines are built in transmitBatchBuffer, one slot of GetMaxBpduSize() bytes for each of the portCount
+	// entries, and handed to the application at the end of the run (or earlier, if all slots are used).
+#if STP_USE_TRANSMIT_BATCH
+	STP_TRANSMIT_BATCH_ENTRY* transmitBatchEntries;
+	unsigned char* transmitBatchBuffer;
+	unsigned int transmitBatchCount;
+#endif
+
+	// Not in the standard. Set by STP_OnBpdusReceived while it processes its BPDUs. RunStateMachines then doesn't
+	// evaluate the PortTransmit state machines; the ports stay marked in dirtyTransmitPorts until the end of the batch.
+	bool transmitDeferred;
+
 	STP_CALLBACKS callbacks;
 
+#ifdef STP_FIXED_PORT_COUNT
+	static const unsigned int portCount = STP_FIXED_PORT_COUNT;
+#else
 	unsigned int portCount;
+#endif
+#ifdef STP_FIXED_MSTI_COUNT
+	static const unsigned int mstiCount = STP_FIXED_MSTI_COUNT;
+#else
 	unsigned int mstiCount;
+#endif
 	unsigned int maxVlanNumber;
 
 	unsigned int treeCount() const { return 1 + ((ForceProtocolVersion >= STP_VERSION_MSTP) ? mstiCount : 0); }
+	unsigned int portBitsetWordCount() const { return GetPortBitsetWordCount (portCount); }
+	unsigned int GetMaxBpduSize() const { return sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE); }
+
+	unsigned int* GetPortFlagBitset (unsigned int treeIndex, PORT_FLAG flag) const { return trees[treeIndex]->portFlags + flag * portBitsetWordCount(); }
+	unsigned short* GetTreeTimerArray (unsigned int portIndex, TREE_TIMER timer) const { return ports[portIndex]->treeTimers + timer * (1 + mstiCount); }
 
 	BRIDGE_TREE** trees;
 	PORT** ports;
 	uint16_nbo* mstConfigTable;
 
+	// Not in the standard. MD5 state of the inner hash of the MST Configuration Digest at the start of each 64-byte
+	// block of mstConfigTable (see ComputeMstConfigDigest). The first mstConfigDigestValidMidstates are up to date.
+	unsigned int (*mstConfigDigestMidstates)[4];
+	unsigned int mstConfigDigestValidMidstates;
+
+	// Not in the standard. Bitmaps with one bit per port, used by RunStateMachines to find the ports that need
+	// evaluation without looking at all of them. A bit in dirtyPorts is set when PORT::smDirty or PORT::treeSmDirty
+	// is set; a bit in dirtyTransmitPorts is set when the PortTransmit state machine of the port must be evaluated.
+	unsigned int* dirtyPorts;
+	unsigned int* dirtyTransmitPorts;
+
 	// 13.26 Per bridge variables
 	// There is one instance per bridge component of the following variable(s):
 	STP_VERSION ForceProtocolVersion;            // 13.26.a) - 13.26.5
@@ -124,8 +233,130 @@ struct STP_BRIDGE
 	const MSTP_BPDU*		receivedBpduContent;
 	VALIDATED_BPDU_TYPE		receivedBpduType;
 	PORT*                   receivedBpduPort;
+
+	// Not in the standard. RunStateMachines evaluates only the state machines flagged as dirty; these functions
+	// set the flags for the state machines that read a given set of variables. Whoever changes a variable outside
+	// the state machine instance that owns it must call one of them. (The state machine transitions themselves
+	// are tracked by RunStateMachines.)
+	void MarkPortDirty (unsigned int portIndex);
+	void MarkPortTreeDirty (unsigned int portIndex, unsigned int treeIndex);
+	void MarkTreeDirty (unsigned int treeIndex);
+	void MarkTreeRoleTransitionsDirty (unsigned int treeIndex);
+	void MarkAllDirty ();
+
+	// Not in the standard. txRstp keeps the last BPDU it encoded for each port (see PORT::txBpdu). Whoever changes
+	// a variable that txRstp encodes, other than the flags and the Hello Time, must call one of these functions.
+	void InvalidateTxBpdu (unsigned int portIndex, unsigned int treeIndex) { ports[portIndex]->trees[treeIndex]->txBpduValid = false; }
+	void InvalidateTxBpdus (unsigned int treeIndex);
+	void InvalidateAllTxBpdus ();
+
+	// Not in the standard. To be called on the events that start a reconvergence of a tree.
+	// See STP_TREE_STATISTICS::convergenceHistogram.
+	void StartConvergenceMeasurement (unsigned int treeIndex, unsigned int timestamp);
 };
 
+// ============================================================================
 
+// Marks all state machines of a port: the per-port ones and those of all its trees.
+// To be called after changing per-port variables.
+inline void STP_BRIDGE::MarkPortDirty (unsigned int portIndex)
+{
+	PORT* port = ports[portIndex];
+	port->smDirty = true;
+	port->treeSmDirty = true;
+	for (unsigned int treeIndex = 0; treeIndex < treeCount(); treeIndex++)
+		port->trees[treeIndex]->smDirty = true;
+
+	dirtyPorts[portIndex / 32] |= (1u << (portIndex % 32));
+	dirtyTransmitPorts[portIndex / 32] |= (1u << (portIndex % 32));
+}
+
+// To be called after changing the variables of a port for a tree. The per-port state machines are marked too, since
+// some of them read the variables of all trees (allTransmitReady, rcvdAnyMsg). Variables of the CIST are also read
+// by the MSTI state machines of the same port, so a change to the CIST marks the whole port.
+inline void STP_BRIDGE::MarkPortTreeDirty (unsigned int portIndex, unsigned int treeIndex)
+{
+	if (treeIndex == CIST_INDEX)
+	{
+		MarkPortDirty (portIndex);
+	}
+	else
+	{
+		PORT* port = ports[portIndex];
+		port->smDirty = true;
+		port->treeSmDirty = true;
+		port->trees[treeIndex]->smDirty = true;
+
+		dirtyPorts[portIndex / 32] |= (1u << (portIndex % 32));
+		dirtyTransmitPorts[portIndex / 32] |= (1u << (portIndex % 32));
+	}
+}
+
+// To be called after a procedure that changes variables of all ports for a tree (setSyncTree, setReRootTree,
+// setTcPropTree), or after setting reselect for a port.
+inline void STP_BRIDGE::MarkTreeDirty (unsigned int treeIndex)
+{
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+	{
+		PORT* port = ports[portIndex];
+		port->treeSmDirty = true;
+		port->trees[treeIndex]->smDirty = true;
+		dirtyPorts[portIndex / 32] |= (1u << (portIndex % 32));
+	}
+
+	trees[treeIndex]->roleSelectionSmDirty = true;
+}
+
+// To be called after changing, for one port, a variable read by allSynced or reRooted (selected, role, selectedRole,
+// updtInfo, synced, rrWhile) in a way that could make them TRUE for other ports. Those two appear only in the
+// conditions of PortRoleTransitions, so only this state machine is marked for the other ports.
+inline void STP_BRIDGE::MarkTreeRoleTransitionsDirty (unsigned int treeIndex)
+{
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+	{
+		PORT* port = ports[portIndex];
+		port->treeSmDirty = true;
+		port->trees[treeIndex]->roleTransitionsSmDirty = true;
+		dirtyPorts[portIndex / 32] |= (1u << (portIndex % 32));
+	}
+}
+
+inline void STP_BRIDGE::MarkAllDirty ()
+{
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+		MarkPortDirty (portIndex);
+
+	for (unsigned int treeIndex = 0; treeIndex < treeCount(); treeIndex++)
+		trees[treeIndex]->roleSelectionSmDirty = true;
+}
+
+inline void STP_BRIDGE::InvalidateTxBpdus (unsigned int treeIndex)
+{
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+		ports[portIndex]->trees[treeIndex]->txBpduValid = false;
+}
+
+inline void STP_BRIDGE::InvalidateAllTxBpdus ()
+{
+	for (unsigned int treeIndex = 0; treeIndex < 1 + mstiCount; treeIndex++)
+		InvalidateTxBpdus (treeIndex);
+}
+
+// The events that come before the tree is stable again belong to the same reconvergence,
+// so only the first one is timestamped.
+inline void STP_BRIDGE::StartConvergenceMeasurement (unsigned int treeIndex, unsigned int timestamp)
+{
+#if STP_USE_STATISTICS
+	BRIDGE_TREE* tree = trees[treeIndex];
+	if (!tree->convergencePending)
+	{
+		tree->convergencePending = true;
+		tree->convergenceStartTimestamp = timestamp;
+	}
+#else
+	(void)treeIndex;
+	(void)timestamp;
+#endif
+}
 
 #endif
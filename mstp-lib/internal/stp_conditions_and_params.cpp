@@ -33,18 +33,18 @@ bool allSptAgree (const STP_BRIDGE* bridge)
 bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree)
 {
 	// a) For all ports for the given tree, selected is TRUE, the port's role is the same as its selectedRole, and updtInfo is FALSE; and
+	if (!AreAllPortBitsSet (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_SELECTED), bridge->portCount))
+		return false;
+
+	if (IsAnyPortBitSet (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_UPDT_INFO), bridge->portCount))
+		return false;
+
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		const PORT_TREE* portTree = bridge->ports[portIndex]->trees[givenTree];
 
-		if (portTree->selected == false)
-			return false;
-
 		if (portTree->role != portTree->selectedRole)
 			return false;
-
-		if (portTree->updtInfo)
-			return false;
 	}
 
 	// Condition b) 3) not yet implemented
@@ -70,7 +70,7 @@ bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 			if (portTree->role == STP_PORT_ROLE_ROOT)
 				continue;
 
-			if (portTree->synced == false)
+			if (portTree->GetSynced() == false)
 				return false;
 		}
 
@@ -80,20 +80,7 @@ bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 	{
 		// 2) Designated Port and synced is TRUE for all ports for the given tree other than the given port; or
 		// 4) Master Port     and synced is TRUE for all ports for the given tree other than the given port.
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			if (portIndex == (unsigned int) givenPort)
-				continue;
-
-			const PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
-
-			//LOG (bridge, givenPort, givenTree, "552: Port {D} synced={D}\r\n", portIndex, portTree->synced);
-
-			if (portTree->synced == false)
-				return false;
-		}
-
-		return true;
+		return AreAllPortBitsSetExcept (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_SYNCED), bridge->portCount, givenPort);
 	}
 	else
 	{
@@ -113,7 +100,7 @@ bool allTransmitReady (const STP_BRIDGE* bridge, PortIndex givenPort)
 	for (unsigned int ti = 0; ti < bridge->treeCount(); ti++)
 	{
 		PORT_TREE* tree = port->trees[ti];
-		if (!tree->selected || tree->updtInfo)
+		if (!tree->GetSelected() || tree->GetUpdtInfo())
 			return false;
 	}
 
@@ -222,7 +209,7 @@ bool mstiDesignatedOrTCpropagatingRootPort (const STP_BRIDGE* bridge, PortIndex
 		if (mstiInstance->role == STP_PORT_ROLE_DESIGNATED)
 			return true;
 
-		if ((mstiInstance->role == STP_PORT_ROLE_ROOT) && (mstiInstance->tcWhile != 0))
+		if ((mstiInstance->role == STP_PORT_ROLE_ROOT) && (mstiInstance->GetTcWhile() != 0))
 			return true;
 	}
 
@@ -302,7 +289,7 @@ bool reRooted (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTre
 		if (portIndex == givenPort)
 			continue;
 
-		if (bridge->ports[portIndex]->trees[givenTree]->rrWhile != 0)
+		if (bridge->ports[portIndex]->trees[givenTree]->GetRrWhile() != 0)
 			return false;
 	}
 
@@ -339,7 +326,7 @@ bool stpVersion (const STP_BRIDGE* bridge)
 // TRUE for a given port if and only if updtInfo is TRUE for the CIST for that port.
 bool updtCistInfo (const STP_BRIDGE* bridge, PortIndex givenPort)
 {
-	return bridge->ports[givenPort]->trees[CIST_INDEX]->updtInfo;
+	return bridge->ports[givenPort]->trees[CIST_INDEX]->GetUpdtInfo();
 }
 
 // ============================================================================
@@ -355,7 +342,7 @@ bool updtMstiInfo (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex give
 	assert (bridge->ForceProtocolVersion <= STP_VERSION_MSTP); // not yet implemented for SPT
 	assert (givenTree != CIST_INDEX); // this must be invoked on MSTIs only
 
-	return bridge->ports[givenPort]->trees[givenTree]->updtInfo || bridge->ports[givenPort]->trees[CIST_INDEX]->updtInfo;
+	return bridge->ports[givenPort]->trees[givenTree]->GetUpdtInfo() || bridge->ports[givenPort]->trees[CIST_INDEX]->GetUpdtInfo();
 }
 
 // ============================================================================
@@ -5,9 +5,9 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "stp_log.h"
+#include "stp_log_formats.h"
 #include "stp_bridge.h"
 #include <assert.h>
-#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -17,12 +17,91 @@
 
 #if STP_USE_LOG
 
-void STP_FlushLog (STP_BRIDGE* bridge)
+// ============================================================================
+// Deferred delivery. See LOG_RING_ENTRY_HEADER in stp_log.h and STP_EnableDeferredLog in stp.cpp.
+
+static void CopyToLogRing (STP_BRIDGE* bridge, unsigned int offset, const void* data, unsigned int size)
+{
+	offset %= bridge->logRingSize;
+	unsigned int firstSize = (size < bridge->logRingSize - offset) ? size : (bridge->logRingSize - offset);
+	memcpy (&bridge->logRing[offset], data, firstSize);
+	memcpy (&bridge->logRing[0], (const char*) data + firstSize, size - firstSize);
+}
+
+static void CopyFromLogRing (const STP_BRIDGE* bridge, unsigned int offset, void* data, unsigned int size)
+{
+	offset %= bridge->logRingSize;
+	unsigned int firstSize = (size < bridge->logRingSize - offset) ? size : (bridge->logRingSize - offset);
+	memcpy (data, &bridge->logRing[offset], firstSize);
+	memcpy ((char*) data + firstSize, &bridge->logRing[0], size - firstSize);
+}
+
+// Passes a piece of text to the debugStrOut callback, or, while the log is deferred, stores it in the log ring.
+// text[size] is the null terminator. Text that doesn't fit in the ring is dropped and counted in logRingLostSize.
+static void OutputText (STP_BRIDGE* bridge, int port, int tree, const char* text, unsigned int size, bool flush)
+{
+	if (bridge->logRing == NULL)
+	{
+		bridge->callbacks.debugStrOut (bridge, port, tree, text, size, flush);
+		return;
+	}
+
+	unsigned int entrySize = sizeof (LOG_RING_ENTRY_HEADER) + size + 1;
+	if (entrySize > bridge->logRingSize - bridge->logRingUsedSize)
+	{
+		bridge->logRingLostSize += size;
+		return;
+	}
+
+	LOG_RING_ENTRY_HEADER header;
+	header.size  = size;
+	header.port  = (short) port;
+	header.tree  = (short) tree;
+	header.flush = flush;
+
+	unsigned int offset = bridge->logRingReadOffset + bridge->logRingUsedSize;
+	CopyToLogRing (bridge, offset, &header, sizeof (header));
+	CopyToLogRing (bridge, offset + sizeof (header), text, size + 1);
+	bridge->logRingUsedSize += entrySize;
+}
+
+unsigned int STP_DrainLogRing (STP_BRIDGE* bridge, unsigned int maxSize)
+{
+	unsigned int drainedSize = 0;
+	while ((bridge->logRingUsedSize > 0) && (drainedSize < maxSize))
+	{
+		LOG_RING_ENTRY_HEADER header;
+		CopyFromLogRing (bridge, bridge->logRingReadOffset, &header, sizeof (header));
+
+		// Text that wraps around the end of the ring goes to the callback in two pieces. The first piece
+		// is null-terminated by the zero byte after the end of the ring.
+		unsigned int textOffset = (bridge->logRingReadOffset + sizeof (header)) % bridge->logRingSize;
+		unsigned int firstSize = (header.size < bridge->logRingSize - textOffset) ? header.size : (bridge->logRingSize - textOffset);
+		if (firstSize < header.size)
+		{
+			bridge->callbacks.debugStrOut (bridge, header.port, header.tree, &bridge->logRing[textOffset], firstSize, false);
+			bridge->callbacks.debugStrOut (bridge, header.port, header.tree, &bridge->logRing[0], header.size - firstSize, header.flush);
+		}
+		else
+			bridge->callbacks.debugStrOut (bridge, header.port, header.tree, &bridge->logRing[textOffset], header.size, header.flush);
+
+		unsigned int entrySize = sizeof (header) + header.size + 1;
+		bridge->logRingReadOffset = (bridge->logRingReadOffset + entrySize) % bridge->logRingSize;
+		bridge->logRingUsedSize -= entrySize;
+		drainedSize += header.size;
+	}
+
+	return drainedSize;
+}
+
+// ============================================================================
+
+static void FlushText (STP_BRIDGE* bridge)
 {
 	assert (bridge->logBufferUsedSize < bridge->logBufferMaxSize);
 
 	bridge->logBuffer [bridge->logBufferUsedSize] = 0;
-	bridge->callbacks.debugStrOut (bridge, bridge->logCurrentPort, bridge->logCurrentTree, bridge->logBuffer, bridge->logBufferUsedSize, true);
+	OutputText (bridge, bridge->logCurrentPort, bridge->logCurrentTree, bridge->logBuffer, bridge->logBufferUsedSize, true);
 	bridge->logBufferUsedSize = 0;
 }
 
@@ -50,7 +129,7 @@ static void WriteChar (STP_BRIDGE* bridge, int port, int tree, char c)
 
 		bridge->logBuffer [bridge->logBufferUsedSize] = '\n';
 		bridge->logBuffer [bridge->logBufferUsedSize + 1] = 0;
-		bridge->callbacks.debugStrOut (bridge, port, tree, bridge->logBuffer, bridge->logBufferUsedSize + 1, false);
+		OutputText (bridge, port, tree, bridge->logBuffer, bridge->logBufferUsedSize + 1, false);
 		bridge->logBufferUsedSize = 0;
 
 		bridge->logLineStarting = true;
@@ -91,13 +170,13 @@ static void WriteChar (STP_BRIDGE* bridge, int port, int tree, char c)
 		{
 			// We only have space for one additional char, so let's write the null-terminator and pass the buffer to the application.
 			bridge->logBuffer [bridge->logBufferUsedSize] = 0;
-			bridge->callbacks.debugStrOut (bridge, port, tree, bridge->logBuffer, bridge->logBufferUsedSize, false);
+			OutputText (bridge, port, tree, bridge->logBuffer, bridge->logBufferUsedSize, false);
 			bridge->logBufferUsedSize = 0;
 		}
 	}
 }
 
-void STP_Indent (STP_BRIDGE* bridge)
+static void IndentText (STP_BRIDGE* bridge)
 {
 	// This is supposed to be called only at the start of the line.
 	assert (bridge->logLineStarting);
@@ -105,7 +184,7 @@ void STP_Indent (STP_BRIDGE* bridge)
 	bridge->logIndent += STP_BRIDGE::LogIndentSize;
 }
 
-void STP_Unindent (STP_BRIDGE* bridge)
+static void UnindentText (STP_BRIDGE* bridge)
 {
 	// This is supposed to be called only at the start of the line.
 	assert (bridge->logLineStarting);
@@ -116,165 +195,574 @@ void STP_Unindent (STP_BRIDGE* bridge)
 	bridge->logIndent -= STP_BRIDGE::LogIndentSize;
 }
 
-void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
+// ============================================================================
+// Text formatting. Each token of a format string is written by one of the functions below,
+// from an argument whose type was already checked against the token.
+
+static void WriteString (STP_BRIDGE* bridge, int port, int tree, const char* str)
 {
-	char _buffer [10];
+	while (*str != 0)
+	{
+		WriteChar (bridge, port, tree, *str);
+		str++;
+	}
+}
 
-    va_list ap;
-    va_start (ap, format);
+// printfFormat is "%0*d" or "%0*x".
+static void WriteNumber (STP_BRIDGE* bridge, int port, int tree, const char* printfFormat, unsigned int width, int v)
+{
+	char buffer [12];
+	snprintf (buffer, sizeof (buffer), printfFormat, (int) width, v);
+	buffer [sizeof (buffer) - 1] = 0;
+	WriteString (bridge, port, tree, buffer);
+}
 
-	while (*format != 0)
+static void WriteBridgeAddress (STP_BRIDGE* bridge, int port, int tree, const unsigned char* a)
+{
+	for (unsigned int i = 0; i < 6; i++)
+		WriteNumber (bridge, port, tree, "%0*x", 2, a[i]);
+}
+
+static void WriteBridgeId (STP_BRIDGE* bridge, int port, int tree, const BRIDGE_ID* bid)
+{
+	WriteNumber (bridge, port, tree, "%0*x", 4, bid->GetPriorityAndMstid());
+	WriteChar (bridge, port, tree, '.');
+	WriteBridgeAddress (bridge, port, tree, bid->GetAddress().bytes);
+}
+
+static void WritePortId (STP_BRIDGE* bridge, int port, int tree, const PORT_ID* pid)
+{
+	if (pid->IsInitialized ())
+		WriteNumber (bridge, port, tree, "%0*x", 4, pid->GetPortIdentifier ());
+	else
+		WriteString (bridge, port, tree, "(undefined)");
+}
+
+static void WritePriorityVector (STP_BRIDGE* bridge, int port, int tree, const PRIORITY_VECTOR* pv)
+{
+	WriteBridgeId (bridge, port, tree, &pv->RootId);
+	WriteChar (bridge, port, tree, '-');
+	WriteNumber (bridge, port, tree, "%0*d", 7, (int) pv->ExternalRootPathCost);
+	WriteChar (bridge, port, tree, '-');
+	WriteBridgeId (bridge, port, tree, &pv->RegionalRootId);
+	WriteChar (bridge, port, tree, '-');
+	WriteNumber (bridge, port, tree, "%0*d", 7, (int) pv->InternalRootPathCost);
+	WriteChar (bridge, port, tree, '-');
+	WriteBridgeId (bridge, port, tree, &pv->DesignatedBridgeId);
+	WriteChar (bridge, port, tree, '-');
+	WritePortId (bridge, port, tree, &pv->DesignatedPortId);
+}
+
+static void WriteTimes (STP_BRIDGE* bridge, int port, int tree, const TIMES* times)
+{
+	WriteString (bridge, port, tree, "MessageAge=");
+	WriteNumber (bridge, port, tree, "%0*d", 0, times->MessageAge);
+	WriteString (bridge, port, tree, ", MaxAge=");
+	WriteNumber (bridge, port, tree, "%0*d", 0, times->MaxAge);
+	WriteString (bridge, port, tree, ", HelloTime=");
+	WriteNumber (bridge, port, tree, "%0*d", 0, times->HelloTime);
+	WriteString (bridge, port, tree, ", FwDelay=");
+	WriteNumber (bridge, port, tree, "%0*d", 0, times->ForwardDelay);
+	WriteString (bridge, port, tree, ", remainingHops=");
+	WriteNumber (bridge, port, tree, "%0*d", 0, times->remainingHops);
+}
+
+// Returns the length of the {...} token at the start of format, and the type of the argument it takes.
+static unsigned int ParseLogToken (const char* format, LOG_ARG_TYPE* argType)
+{
+	assert (*format == '{');
+	const char* end = strchr (format, '}');
+	assert (end != NULL);
+
+	switch (format[1])
+	{
+		case 'B': *argType = (format[2] == 'I') ? LOG_ARG_TYPE_BRIDGE_ID : LOG_ARG_TYPE_BRIDGE_ADDRESS; break; // {BID}, {BA}
+		case 'P': *argType = (format[2] == 'I') ? LOG_ARG_TYPE_PORT_ID : LOG_ARG_TYPE_PRIORITY_VECTOR; break; // {PID}, {PVS}
+		case 'T': *argType = (format[2] == 'M') ? LOG_ARG_TYPE_TIMES : LOG_ARG_TYPE_INT; break; // {TMS}; {T}, {TN}
+		case 'S': *argType = LOG_ARG_TYPE_STRING; break;
+		case 'D':
+		case 'X': *argType = LOG_ARG_TYPE_INT; break;
+		default:  assert (false); // not implemented
+	}
+
+	return (unsigned int) (end + 1 - format);
+}
+
+// Returns the number in a {Dn}, {Xn} or {Sn} token, or 0 if there is none. digits points after the letter.
+static unsigned int ParseTokenWidth (const char* digits)
+{
+	unsigned int width = 0;
+	while ((*digits >= '0') && (*digits <= '9'))
+	{
+		width = 10 * width + (*digits - '0');
+		digits++;
+	}
+
+	assert (*digits == '}');
+	return width;
+}
+
+static void WriteArg (STP_BRIDGE* bridge, int port, int tree, const char* token, const LOG_ARG& arg)
+{
+	switch (token[1])
 	{
-		if (strncmp (format, "{BID}", 5) == 0)
+		case 'B':
+			if (token[2] == 'I')
+				WriteBridgeId (bridge, port, tree, (const BRIDGE_ID*) arg.p);
+			else
+				WriteBridgeAddress (bridge, port, tree, (const unsigned char*) arg.p);
+			break;
+
+		case 'P':
+			if (token[2] == 'I')
+				WritePortId (bridge, port, tree, (const PORT_ID*) arg.p);
+			else
+				WritePriorityVector (bridge, port, tree, (const PRIORITY_VECTOR*) arg.p);
+			break;
+
+		case 'S':
 		{
-			const BRIDGE_ID* bid = va_arg (ap, BRIDGE_ID*);
-			STP_Log (bridge, port, tree, "{X4}.{BA}", bid->GetPriorityAndMstid(), &bid->GetAddress());
-			format += 5;
+			const char* str = (const char*) arg.p;
+			unsigned int width = ParseTokenWidth (&token[2]);
+			for (size_t i = strlen (str); i < width; i++)
+				WriteChar (bridge, port, tree, ' ');
+			WriteString (bridge, port, tree, str);
+			break;
 		}
-		else if (strncmp (format, "{PID}", 5) == 0)
-		{
-			const PORT_ID* pid = va_arg (ap, PORT_ID*);
-			if (pid->IsInitialized ())
+
+		case 'T':
+			if (token[2] == '}')
 			{
-				unsigned short id = pid->GetPortIdentifier ();
-				STP_Log (bridge, port, tree, "{X4}", (int) id);
+				unsigned int v = (unsigned int) arg.i;
+				WriteNumber (bridge, port, tree, "%0*d", 0, (int) (v / 1000));
+				WriteChar (bridge, port, tree, '.');
+				WriteNumber (bridge, port, tree, "%0*d", 3, (int) (v % 1000));
+			}
+			else if (token[2] == 'N')
+			{
+				if (arg.i == 0)
+					WriteString (bridge, port, tree, "CIST");
+				else
+				{
+					WriteString (bridge, port, tree, "MST");
+					WriteNumber (bridge, port, tree, "%0*d", 0, arg.i);
+				}
 			}
 			else
-				STP_Log (bridge, port, tree, "(undefined)");
-			format += 5;
-		}
-		else if (strncmp (format, "{BA}", 4) == 0)
+				WriteTimes (bridge, port, tree, (const TIMES*) arg.p);
+			break;
+
+		case 'D':
+			WriteNumber (bridge, port, tree, "%0*d", ParseTokenWidth (&token[2]), arg.i);
+			break;
+
+		case 'X':
+			WriteNumber (bridge, port, tree, "%0*x", ParseTokenWidth (&token[2]), arg.i);
+			break;
+	}
+}
+
+static void LogText (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_ARG* args, unsigned int argCount)
+{
+	unsigned int argIndex = 0;
+	while (*format != 0)
+	{
+		if (*format != '{')
 		{
-			const unsigned char* a = va_arg (ap, unsigned char*);
-			STP_Log (bridge, port, tree, "{X2}{X2}{X2}{X2}{X2}{X2}", a[0], a[1], a[2], a[3], a[4], a[5]);
-			format += 4;
+			WriteChar (bridge, port, tree, *format);
+			format++;
+			continue;
 		}
-		else if (strncmp (format, "{PVS}", 5) == 0)
+
+		LOG_ARG_TYPE argType;
+		unsigned int tokenLength = ParseLogToken (format, &argType);
+		assert (argIndex < argCount); // fewer arguments than tokens
+		assert (args[argIndex].type == argType); // argument of the wrong type for its token
+		WriteArg (bridge, port, tree, format, args[argIndex]);
+		argIndex++;
+		format += tokenLength;
+	}
+
+	assert (argIndex == argCount); // more arguments than tokens
+}
+
+// ============================================================================
+// Binary trace. See TRACE_ENTRY_HEADER in stp_log.h and STP_StartTrace in stp.cpp.
+
+// The ID stored in the trace for a format string: its 32-bit FNV-1a hash. Unlike the address of the string,
+// it is the same in all builds of the library.
+static unsigned int GetLogFormatId (const char* format)
+{
+	unsigned int hash = 2166136261u;
+	for (; *format != 0; format++)
+		hash = (hash ^ (unsigned char) *format) * 16777619u;
+	return hash;
+}
+
+static const unsigned int LogFormatCount = sizeof (LogFormats) / sizeof (LogFormats[0]);
+
+// Returns the index in LogFormats of the format with the given ID, or LogFormatCount if there's none.
+// formatIds holds the IDs of all entries of LogFormats, in the same order.
+static unsigned int FindLogFormat (const unsigned int formatIds[], unsigned int formatId)
+{
+	unsigned int i = 0;
+	while ((i < LogFormatCount) && (formatIds[i] != formatId))
+		i++;
+	return i;
+}
+
+#ifndef NDEBUG
+static bool IsLogFormatInTable (const char* format)
+{
+	for (unsigned int i = 0; i < LogFormatCount; i++)
+	{
+		if (strcmp (LogFormats[i], format) == 0)
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+static unsigned int GetTraceRecordCount (unsigned int entrySize)
+{
+	return (entrySize + STP_TRACE_RECORD_SIZE - 1) / STP_TRACE_RECORD_SIZE;
+}
+
+// Copies data into the ring at offset *entrySize from the start of the entry being written, which begins
+// at the first free record; the copy wraps around the end of the ring. Returns false if the entry would
+// no longer fit in the free records.
+static bool AppendTraceData (STP_BRIDGE* bridge, unsigned int* entrySize, const void* data, unsigned int size)
+{
+	unsigned int newEntrySize = *entrySize + size;
+	if ((newEntrySize > STP_TRACE_MAX_ENTRY_SIZE)
+		|| (GetTraceRecordCount (newEntrySize) > bridge->traceRecordCount - bridge->traceUsedCount))
+		return false;
+
+	unsigned int ringSize = bridge->traceRecordCount * STP_TRACE_RECORD_SIZE;
+	unsigned int writeIndex = (bridge->traceReadIndex + bridge->traceUsedCount) % bridge->traceRecordCount;
+	unsigned int offset = (writeIndex * STP_TRACE_RECORD_SIZE + *entrySize) % ringSize;
+	unsigned int firstSize = (size < ringSize - offset) ? size : (ringSize - offset);
+	memcpy (&bridge->traceBuffer[offset], data, firstSize);
+	memcpy (&bridge->traceBuffer[0], (const unsigned char*) data + firstSize, size - firstSize);
+	*entrySize = newEntrySize;
+	return true;
+}
+
+// Writes the header of the entry whose arguments AppendTraceData just wrote, making it visible to STP_ReadTrace.
+static void CommitTraceEntry (STP_BRIDGE* bridge, TRACE_ENTRY_TYPE type, unsigned int formatId, int port, int tree, unsigned int entrySize)
+{
+	if (GetTraceRecordCount (entrySize) > bridge->traceRecordCount - bridge->traceUsedCount)
+	{
+		bridge->traceLostCount++;
+		return;
+	}
+
+	TRACE_ENTRY_HEADER header;
+	header.formatId  = formatId;
+	header.timestamp = bridge->traceTimestamp;
+	header.port      = (short) port;
+	header.tree      = (short) tree;
+	header.argsSize  = (unsigned short) (entrySize - sizeof (TRACE_ENTRY_HEADER));
+	header.type      = (unsigned char) type;
+
+	// The header is at the start of a record, so it never wraps around the end of the ring.
+	unsigned int writeIndex = (bridge->traceReadIndex + bridge->traceUsedCount) % bridge->traceRecordCount;
+	memcpy (&bridge->traceBuffer[writeIndex * STP_TRACE_RECORD_SIZE], &header, sizeof (header));
+	bridge->traceUsedCount += GetTraceRecordCount (entrySize);
+}
+
+// Stores the values of the arguments without formatting them, and without looking at the format string.
+static void TraceLog (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_ARG* args, unsigned int argCount)
+{
+	// A format missing from the table would make the entry impossible to decode.
+	assert (IsLogFormatInTable (format));
+
+	// API calls log their timestamp first. It goes into the header of this entry and of the ones after it.
+	if ((format[0] == '{') && (format[1] == 'T') && (format[2] == '}'))
+		bridge->traceTimestamp = (unsigned int) args[0].i;
+
+	unsigned int entrySize = sizeof (TRACE_ENTRY_HEADER);
+	for (unsigned int i = 0; i < argCount; i++)
+	{
+		const void* data = args[i].p;
+		unsigned int size;
+		switch (args[i].type)
 		{
-			const PRIORITY_VECTOR* pv = va_arg (ap, PRIORITY_VECTOR*);
-			STP_Log (bridge, port, tree, "{BID}-{D7}-{BID}-{D7}-{BID}-{PID}",
-					 &pv->RootId,
-					 (int) pv->ExternalRootPathCost,
-					 &pv->RegionalRootId,
-					 (int) pv->InternalRootPathCost,
-					 &pv->DesignatedBridgeId,
-					 &pv->DesignatedPortId);
-			format += 5;
+			case LOG_ARG_TYPE_INT:             data = &args[i].i; size = sizeof (int); break;
+			case LOG_ARG_TYPE_STRING:          size = (unsigned int) strlen ((const char*) data) + 1; break;
+			case LOG_ARG_TYPE_BRIDGE_ID:       size = sizeof (BRIDGE_ID); break;
+			case LOG_ARG_TYPE_PORT_ID:         size = sizeof (PORT_ID); break;
+			case LOG_ARG_TYPE_BRIDGE_ADDRESS:  size = sizeof (STP_BRIDGE_ADDRESS); break;
+			case LOG_ARG_TYPE_PRIORITY_VECTOR: size = sizeof (PRIORITY_VECTOR); break;
+			case LOG_ARG_TYPE_TIMES:           size = sizeof (TIMES); break;
+			default:                           assert (false); return;
 		}
-		else if (strncmp (format, "{S", 2) == 0)
+
+		if (!AppendTraceData (bridge, &entrySize, data, size))
 		{
-			format += 2;
-			size_t size = 0;
-			while (true)
+			bridge->traceLostCount++;
+			return;
+		}
+	}
+
+	CommitTraceEntry (bridge, TRACE_ENTRY_TYPE_LOG, GetLogFormatId (format), port, tree, entrySize);
+}
+
+unsigned int STP_ReadTraceEntries (STP_BRIDGE* bridge, unsigned char* buffer, unsigned int bufferSize)
+{
+	unsigned int copiedSize = 0;
+	while (bridge->traceUsedCount > 0)
+	{
+		const unsigned char* record = &bridge->traceBuffer[bridge->traceReadIndex * STP_TRACE_RECORD_SIZE];
+		TRACE_ENTRY_HEADER header;
+		memcpy (&header, record, sizeof (header));
+
+		unsigned int recordCount = GetTraceRecordCount (sizeof (TRACE_ENTRY_HEADER) + header.argsSize);
+		if (copiedSize + recordCount * STP_TRACE_RECORD_SIZE > bufferSize)
+			break;
+
+		// The entry may wrap around the end of the ring.
+		unsigned int firstCount = bridge->traceRecordCount - bridge->traceReadIndex;
+		if (firstCount > recordCount)
+			firstCount = recordCount;
+		memcpy (&buffer[copiedSize], record, firstCount * STP_TRACE_RECORD_SIZE);
+		memcpy (&buffer[copiedSize + firstCount * STP_TRACE_RECORD_SIZE], bridge->traceBuffer, (recordCount - firstCount) * STP_TRACE_RECORD_SIZE);
+
+		copiedSize += recordCount * STP_TRACE_RECORD_SIZE;
+		bridge->traceReadIndex = (bridge->traceReadIndex + recordCount) % bridge->traceRecordCount;
+		bridge->traceUsedCount -= recordCount;
+	}
+
+	return copiedSize;
+}
+
+// Returns the size of the argument of the given type stored at args, or 0 if the argument would extend past argsEnd,
+// or is a string with control characters, which the text writer doesn't accept. This is how the decoder avoids
+// reading past a corrupt entry, or tripping the asserts of the text writer.
+static unsigned int GetTraceArgSize (LOG_ARG_TYPE argType, const unsigned char* args, const unsigned char* argsEnd)
+{
+	unsigned int availableSize = (unsigned int) (argsEnd - args);
+	unsigned int size;
+	switch (argType)
+	{
+		case LOG_ARG_TYPE_INT:             size = sizeof (int); break;
+		case LOG_ARG_TYPE_BRIDGE_ID:       size = sizeof (BRIDGE_ID); break;
+		case LOG_ARG_TYPE_PORT_ID:         size = sizeof (PORT_ID); break;
+		case LOG_ARG_TYPE_BRIDGE_ADDRESS:  size = sizeof (STP_BRIDGE_ADDRESS); break;
+		case LOG_ARG_TYPE_PRIORITY_VECTOR: size = sizeof (PRIORITY_VECTOR); break;
+		case LOG_ARG_TYPE_TIMES:           size = sizeof (TIMES); break;
+
+		case LOG_ARG_TYPE_STRING:
+			for (size = 0; size < availableSize; size++)
 			{
-				char ch = *format;
-				if ((ch < '0') || (ch > '9'))
-					break;
+				if (args[size] == 0)
+					return size + 1;
 
-				size = 10 * size + ch - '0';
-				format++;
+				if (args[size] < 0x20)
+					return 0;
 			}
 
-			assert (*format == '}');
-			format++;
+			return 0;
 
-			const char* str = va_arg (ap, const char*);
-			size_t strLen = strlen (str);
+		default:
+			return 0;
+	}
 
-			size_t paddingSize = (strLen >= size) ? 0 : (size - strLen);
-			for (size_t i = 0; i < paddingSize; i++)
-				WriteChar (bridge, port, tree, ' ');
+	return (size <= availableSize) ? size : 0;
+}
 
-			STP_Log (bridge, port, tree, str);
-		}
-		else if (strncmp (format, "{T}", 3) == 0)
+// Returns true if the arguments stored in a LOG entry are exactly those taken by the tokens of format.
+static bool TraceArgsMatchFormat (const char* format, const unsigned char* args, unsigned int argsSize)
+{
+	const unsigned char* argsEnd = args + argsSize;
+	for (const char* f = format; *f != 0; )
+	{
+		if (*f != '{')
 		{
-			unsigned int v = va_arg (ap, unsigned int);
-			STP_Log (bridge, port, tree, "{D}.{D3}", (int) (v / 1000), (int) (v % 1000));
-			format += 3;
+			f++;
+			continue;
 		}
-		/*
-		else if (strncmp (format, "{I}", 3) == 0)
-		{
-			int i = va_arg (ap, int);
-			while (i--)
-				WriteChar (bridge, port, tree, ' ');
 
-			format += 3;
-		}
-		*/
-		else if (strncmp (format, "{TN}", 4) == 0)
-		{
-			int i = va_arg (ap, int);
-			if (i == 0)
-				STP_Log (bridge, port, tree, "CIST");
-			else
-				STP_Log (bridge, port, tree, "MST{D}", i);
+		LOG_ARG_TYPE argType;
+		f += ParseLogToken (f, &argType);
 
-			format += 4;
-		}
-		else if (strncmp (format, "{TMS}", 5) == 0)
+		unsigned int argSize = GetTraceArgSize (argType, args, argsEnd);
+		if (argSize == 0)
+			return false;
+		args += argSize;
+	}
+
+	return args == argsEnd;
+}
+
+// Formats a LOG entry as text, exactly as STP_Log would have formatted it had the trace not been enabled.
+// The caller checked the arguments with TraceArgsMatchFormat.
+static void DecodeLogEntry (STP_BRIDGE* bridge, const TRACE_ENTRY_HEADER* header, const char* format, const unsigned char* args)
+{
+	int port = header->port;
+	int tree = header->tree;
+	const unsigned char* argsEnd = args + header->argsSize;
+
+	for (const char* f = format; *f != 0; )
+	{
+		if (*f != '{')
 		{
-			const TIMES* times = va_arg (ap, TIMES*);
-			STP_Log (bridge, port, tree, "MessageAge={D}, MaxAge={D}, HelloTime={D}, FwDelay={D}, remainingHops={D}",
-					  times->MessageAge, times->MaxAge, times->HelloTime, times->ForwardDelay, times->remainingHops);
-			format += 5;
+			WriteChar (bridge, port, tree, *f);
+			f++;
+			continue;
 		}
-		else if (strncmp (format, "{D", 2) == 0)
+
+		LOG_ARG_TYPE argType;
+		unsigned int tokenLength = ParseLogToken (f, &argType);
+		unsigned int argSize = GetTraceArgSize (argType, args, argsEnd);
+
+		// Arguments are not aligned in the trace, so those read through pointers are copied out first.
+		switch (argType)
 		{
-			format += 2;
-			int size;
-			if (*format >= '0' && *format <= '9')
+			case LOG_ARG_TYPE_INT:
 			{
-				size = *format - '0';
-				format++;
+				int v;
+				memcpy (&v, args, sizeof (v));
+				WriteArg (bridge, port, tree, f, LOG_ARG(v));
+				break;
 			}
-			else
-				size = 0;
 
-			assert (*format == '}');
-			format++;
+			case LOG_ARG_TYPE_STRING:
+				WriteArg (bridge, port, tree, f, LOG_ARG((const char*) args));
+				break;
 
-			int v = va_arg (ap, int);
+			case LOG_ARG_TYPE_BRIDGE_ID:
+			{
+				BRIDGE_ID v;
+				memcpy (&v, args, sizeof (v));
+				WriteArg (bridge, port, tree, f, LOG_ARG(&v));
+				break;
+			}
 
-			snprintf (_buffer, sizeof (_buffer), "%0*d", size, v);
+			case LOG_ARG_TYPE_PORT_ID:
+			{
+				PORT_ID v;
+				memcpy (&v, args, sizeof (v));
+				WriteArg (bridge, port, tree, f, LOG_ARG(&v));
+				break;
+			}
 
-			for (unsigned int i = 0; i < sizeof (_buffer) && _buffer [i] != 0; i++)
-				WriteChar (bridge, port, tree, _buffer [i]);
-		}
-		else if (strncmp (format, "{X", 2) == 0)
-		{
-			format += 2;
-			int size;
-			if (*format >= '0' && *format <= '9')
+			case LOG_ARG_TYPE_BRIDGE_ADDRESS:
+				WriteArg (bridge, port, tree, f, LOG_ARG(args));
+				break;
+
+			case LOG_ARG_TYPE_PRIORITY_VECTOR:
 			{
-				size = *format - '0';
-				format++;
+				PRIORITY_VECTOR v;
+				memcpy (&v, args, sizeof (v));
+				WriteArg (bridge, port, tree, f, LOG_ARG(&v));
+				break;
 			}
-			else
-				size = 0;
 
-			assert (*format == '}');
-			format++;
+			case LOG_ARG_TYPE_TIMES:
+			{
+				TIMES v;
+				memcpy (&v, args, sizeof (v));
+				WriteArg (bridge, port, tree, f, LOG_ARG(&v));
+				break;
+			}
+		}
+
+		args += argSize;
+		f += tokenLength;
+	}
+}
+
+void STP_DecodeTraceEntries (STP_BRIDGE* bridge, const unsigned char* trace, unsigned int traceSize)
+{
+	// The trace comes from outside the library, maybe from another build of it, so we look up each format ID
+	// in our own table and check the entry against the format before decoding it.
+	unsigned int formatIds [LogFormatCount];
+	for (unsigned int i = 0; i < LogFormatCount; i++)
+		formatIds[i] = GetLogFormatId (LogFormats[i]);
+
+	unsigned int offset = 0;
+	while (traceSize - offset >= STP_TRACE_RECORD_SIZE)
+	{
+		const unsigned char* entry = &trace[offset];
+		TRACE_ENTRY_HEADER header;
+		memcpy (&header, entry, sizeof (header));
 
-			int v = va_arg (ap, int);
+		unsigned int entrySize = GetTraceRecordCount (sizeof (TRACE_ENTRY_HEADER) + header.argsSize) * STP_TRACE_RECORD_SIZE;
+		if (entrySize > traceSize - offset)
+			break; // truncated entry
 
-			snprintf (_buffer, sizeof (_buffer), "%0*x", size, v);
+		// The text writer expects the port and tree of a line to be those of this bridge, or -1.
+		bool portAndTreeValid = (header.port >= -1) && (header.port < (int) bridge->portCount)
+			&& (header.tree >= -1) && (header.tree <= (int) bridge->mstiCount);
 
-			for (unsigned int i = 0; i < sizeof (_buffer) && _buffer [i] != 0; i++)
-				WriteChar (bridge, port, tree, _buffer [i]);
+		const char* format = NULL;
+		if ((header.type == TRACE_ENTRY_TYPE_LOG) && portAndTreeValid)
+		{
+			unsigned int formatIndex = FindLogFormat (formatIds, header.formatId);
+			if ((formatIndex < LogFormatCount) && TraceArgsMatchFormat (LogFormats[formatIndex], entry + sizeof (header), header.argsSize))
+				format = LogFormats[formatIndex];
 		}
-		else if (*format == '{')
+
+		// Entries lost to a full trace buffer can leave a line unterminated, or the indentation unbalanced.
+		// We end the line here rather than trip the asserts of the text writer.
+		if (!bridge->logLineStarting
+			&& ((format == NULL) || (header.port != bridge->logCurrentPort) || (header.tree != bridge->logCurrentTree)))
+			WriteChar (bridge, bridge->logCurrentPort, bridge->logCurrentTree, '\n');
+
+		if (header.type == TRACE_ENTRY_TYPE_INDENT)
+			IndentText (bridge);
+		else if (header.type == TRACE_ENTRY_TYPE_UNINDENT)
 		{
-			assert (false); // not implemented
+			if (bridge->logIndent >= STP_BRIDGE::LogIndentSize)
+				UnindentText (bridge);
 		}
+		else if (format != NULL)
+			DecodeLogEntry (bridge, &header, format, entry + sizeof (header));
 		else
 		{
-			WriteChar (bridge, port, tree, *format);
-			format++;
+			// Recorded by a different version of the library, or by a bridge with more ports or trees, or corrupt.
+			LOG_ARG args[] = { header.type, header.formatId };
+			LogText (bridge, -1, -1, "(Unknown trace entry: type {D}, format ID 0x{X8}.)\r\n", args, 2);
 		}
+
+		offset += entrySize;
 	}
 
-	va_end (ap);
+	FlushText (bridge);
+}
+
+// ============================================================================
+
+void STP_LogArgs (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_ARG* args, unsigned int argCount)
+{
+	if (bridge->traceBuffer != NULL)
+		TraceLog (bridge, port, tree, format, args, argCount);
+	else
+		LogText (bridge, port, tree, format, args, argCount);
+}
+
+void STP_FlushLog (STP_BRIDGE* bridge)
+{
+	// Trace entries stay in the trace buffer until the application reads them.
+	if (bridge->traceBuffer == NULL)
+		FlushText (bridge);
+}
+
+void STP_Indent (STP_BRIDGE* bridge)
+{
+	if (bridge->traceBuffer != NULL)
+		CommitTraceEntry (bridge, TRACE_ENTRY_TYPE_INDENT, 0, -1, -1, sizeof (TRACE_ENTRY_HEADER));
+	else
+		IndentText (bridge);
+}
+
+void STP_Unindent (STP_BRIDGE* bridge)
+{
+	if (bridge->traceBuffer != NULL)
+		CommitTraceEntry (bridge, TRACE_ENTRY_TYPE_UNINDENT, 0, -1, -1, sizeof (TRACE_ENTRY_HEADER));
+	else
+		UnindentText (bridge);
 }
 #endif
@@ -9,18 +9,168 @@
 
 #if STP_USE_LOG
 	struct STP_BRIDGE;
+	struct BRIDGE_ID;
+	struct PORT_ID;
+	struct PRIORITY_VECTOR;
+	struct TIMES;
+
+	// Not in the standard. The arguments of a LOG call, each with its type. Every token in the format string takes
+	// one argument, of the type given below; the implicit constructors of LOG_ARG let the compiler reject arguments
+	// of any other type, and STP_LogArgs asserts that each argument matches its token.
+	//   {D}, {Dn}, {X}, {Xn}, {TN}  int (or any type promoted to int), unsigned int
+	//   {T}                         unsigned int (timestamp in milliseconds)
+	//   {S}, {Sn}                   const char*
+	//   {BID}                       const BRIDGE_ID*
+	//   {PID}                       const PORT_ID*
+	//   {BA}                        const unsigned char* (six bytes)
+	//   {PVS}                       const PRIORITY_VECTOR*
+	//   {TMS}                       const TIMES*
+	enum LOG_ARG_TYPE
+	{
+		LOG_ARG_TYPE_INT,
+		LOG_ARG_TYPE_STRING,
+		LOG_ARG_TYPE_BRIDGE_ID,
+		LOG_ARG_TYPE_PORT_ID,
+		LOG_ARG_TYPE_BRIDGE_ADDRESS,
+		LOG_ARG_TYPE_PRIORITY_VECTOR,
+		LOG_ARG_TYPE_TIMES,
+	};
+
+	struct LOG_ARG
+	{
+		LOG_ARG_TYPE type;
+		union
+		{
+			int i;
+			const void* p;
+		};
+
+		LOG_ARG (int v)                    : type(LOG_ARG_TYPE_INT), i(v) { }
+		LOG_ARG (unsigned int v)           : type(LOG_ARG_TYPE_INT), i((int) v) { }
+		LOG_ARG (const char* v)            : type(LOG_ARG_TYPE_STRING), p(v) { }
+		LOG_ARG (const BRIDGE_ID* v)       : type(LOG_ARG_TYPE_BRIDGE_ID), p(v) { }
+		LOG_ARG (const PORT_ID* v)         : type(LOG_ARG_TYPE_PORT_ID), p(v) { }
+		LOG_ARG (const unsigned char* v)   : type(LOG_ARG_TYPE_BRIDGE_ADDRESS), p(v) { }
+		LOG_ARG (const PRIORITY_VECTOR* v) : type(LOG_ARG_TYPE_PRIORITY_VECTOR), p(v) { }
+		LOG_ARG (const TIMES* v)           : type(LOG_ARG_TYPE_TIMES), p(v) { }
+	};
+
+	void STP_LogArgs (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_ARG* args, unsigned int argCount);
+
+	// One overload per argument count, so that each LOG call site builds its array of typed arguments
+	// and makes a single call, with no va_arg on the other side.
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format)
+	{
+		STP_LogArgs (bridge, port, tree, format, 0, 0);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1)
+	{
+		STP_LogArgs (bridge, port, tree, format, &a1, 1);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2)
+	{
+		LOG_ARG args[] = { a1, a2 };
+		STP_LogArgs (bridge, port, tree, format, args, 2);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2, LOG_ARG a3)
+	{
+		LOG_ARG args[] = { a1, a2, a3 };
+		STP_LogArgs (bridge, port, tree, format, args, 3);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2, LOG_ARG a3, LOG_ARG a4)
+	{
+		LOG_ARG args[] = { a1, a2, a3, a4 };
+		STP_LogArgs (bridge, port, tree, format, args, 4);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2, LOG_ARG a3, LOG_ARG a4, LOG_ARG a5)
+	{
+		LOG_ARG args[] = { a1, a2, a3, a4, a5 };
+		STP_LogArgs (bridge, port, tree, format, args, 5);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2, LOG_ARG a3, LOG_ARG a4, LOG_ARG a5, LOG_ARG a6)
+	{
+		LOG_ARG args[] = { a1, a2, a3, a4, a5, a6 };
+		STP_LogArgs (bridge, port, tree, format, args, 6);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2, LOG_ARG a3, LOG_ARG a4, LOG_ARG a5, LOG_ARG a6, LOG_ARG a7)
+	{
+		LOG_ARG args[] = { a1, a2, a3, a4, a5, a6, a7 };
+		STP_LogArgs (bridge, port, tree, format, args, 7);
+	}
+
+	inline void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, LOG_ARG a1, LOG_ARG a2, LOG_ARG a3, LOG_ARG a4, LOG_ARG a5, LOG_ARG a6, LOG_ARG a7, LOG_ARG a8)
+	{
+		LOG_ARG args[] = { a1, a2, a3, a4, a5, a6, a7, a8 };
+		STP_LogArgs (bridge, port, tree, format, args, 8);
+	}
 
-	void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...);
 	void STP_FlushLog (STP_BRIDGE* bridge);
 	void STP_Indent (STP_BRIDGE* bridge);
 	void STP_Unindent (STP_BRIDGE* bridge);
 
-	#define LOG(b,p,t,...)		((void) ( !(b)->loggingEnabled || (STP_Log(b,p,t,__VA_ARGS__), 0)))
+	// Not in the standard. Binary trace, see STP_StartTrace. Each LOG, LOG_INDENT and LOG_UNINDENT call becomes
+	// one entry in the trace buffer: a TRACE_ENTRY_HEADER followed by the values of the arguments, the whole
+	// rounded up to STP_TRACE_RECORD_SIZE bytes. Pointer arguments are stored as the values they point to, strings
+	// as their characters followed by a null terminator. The types of the arguments are not stored; the decoder
+	// takes them from the tokens of the format string, which it finds in the LogFormats table (stp_log_formats.h).
+	// All fields have the same size on all targets, so a host build of the library can decode the trace of a target
+	// with the same byte order.
+	enum TRACE_ENTRY_TYPE
+	{
+		TRACE_ENTRY_TYPE_LOG,
+		TRACE_ENTRY_TYPE_INDENT,
+		TRACE_ENTRY_TYPE_UNINDENT,
+	};
+
+	struct TRACE_ENTRY_HEADER
+	{
+		unsigned int   formatId;  // hash of the format string of the LOG call, see GetLogFormatId; 0 for the other entry types
+		unsigned int   timestamp; // that of the API call in progress, taken from the last entry whose format starts with {T}
+		short          port;
+		short          tree;
+		unsigned short argsSize;
+		unsigned char  type;      // one of TRACE_ENTRY_TYPE
+	};
+
+	unsigned int STP_ReadTraceEntries (STP_BRIDGE* bridge, unsigned char* buffer, unsigned int bufferSize);
+	void STP_DecodeTraceEntries (STP_BRIDGE* bridge, const unsigned char* trace, unsigned int traceSize);
+
+	// Not in the standard. Deferred delivery, see STP_EnableDeferredLog. Each piece of text that would have been passed
+	// to the debugStrOut callback is one entry in the log ring: a LOG_RING_ENTRY_HEADER followed by the characters and
+	// a null terminator. Entries are not aligned and may wrap around the end of the ring.
+	struct LOG_RING_ENTRY_HEADER
+	{
+		unsigned int size;  // number of characters, without the null terminator
+		short        port;
+		short        tree;
+		bool         flush;
+	};
+
+	unsigned int STP_DrainLogRing (STP_BRIDGE* bridge, unsigned int maxSize);
+
+	// The per-port and per-tree flags are looked at only while some port or tree has logging disabled
+	// (see STP_EnablePortLogging), so LOG costs one extra test when no filter is set. p and t are -1 for
+	// lines not about a port or a tree. Filtered lines don't get their arguments evaluated.
+	#define LOG_FILTER_PASSES(b,p,t)	(((b)->logFilteredCount == 0) \
+										 || ((((int)(p) < 0) || (b)->ports[p]->logEnabled) && (((int)(t) < 0) || (b)->trees[t]->logEnabled)))
+	#define LOG_CATEGORY_ENABLED(b,c)	((b)->loggingEnabled && (((b)->logCategories & (c)) != 0))
+
+	#define LOG(b,p,t,...)		((void) ( !(b)->loggingEnabled || !LOG_FILTER_PASSES(b,p,t) || (STP_Log(b,p,t,__VA_ARGS__), 0)))
+	#define LOG_IN_CATEGORY(b,c,p,t,...) ((void) ( !LOG_CATEGORY_ENABLED(b,c) || !LOG_FILTER_PASSES(b,p,t) || (STP_Log(b,p,t,__VA_ARGS__), 0)))
 	#define FLUSH_LOG(b)		((void) ( !(b)->loggingEnabled || (STP_FlushLog(b), 0)))
 	#define LOG_INDENT(b)		((void) ( !(b)->loggingEnabled || (STP_Indent(b), 0)))
 	#define LOG_UNINDENT(b)		((void) ( !(b)->loggingEnabled || (STP_Unindent(b), 0)))
 #else
+	#define LOG_CATEGORY_ENABLED(b,c)	false
 	#define LOG(b,p,t,...)		((void)0)
+	#define LOG_IN_CATEGORY(b,c,p,t,...) ((void)0)
 	#define FLUSH_LOG(b)		((void)0)
 	#define LOG_INDENT(b)		((void)0)
 	#define LOG_UNINDENT(b)		((void)0)
@@ -0,0 +1,97 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#ifndef MSTP_LIB_LOG_FORMATS_H
+#define MSTP_LIB_LOG_FORMATS_H
+
+// Not in the standard. The format strings of all LOG calls of the library, each listed once. The binary trace
+// identifies a LOG call by a hash of its format string (see TRACE_ENTRY_HEADER), and STP_DecodeTrace looks the hash
+// up in this table; so a trace recorded by one build of the library can be decoded by another, for instance a host
+// build of the same version. A LOG call with a new format string must have it added here; TraceLog asserts that it is.
+static const char* const LogFormats[] =
+{
+	// stp.cpp
+	"{T}: Starting the bridge...\r\n",
+	"Bridge started.\r\n",
+	"------------------------------------\r\n",
+	"{T}: Bridge stopped.\r\n",
+	"{T}: Beginning configuration transaction.\r\n",
+	"{T}: Committing configuration transaction...\r\n",
+	"Configuration transaction committed.\r\n",
+	"{T}: Setting bridge MAC address to {BA}...",
+	" nothing changed.\r\n",
+	"\r\n",
+	"{T}: Port {D} good\r\n",
+	"{T}: Port {D} down\r\n",
+	"{T}: One second:\r\n",
+	"{T}: Advancing time by {D} seconds.\r\n",
+	"{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n",
+	"{T}: BPDU received on Port {D}:\r\n",
+	"Config BPDU:\r\n",
+	"RSTP BPDU:\r\n",
+	"MSTP BPDU:\r\n",
+	"SPT BPDU (processed as MSTP):\r\n",
+	"TCN BPDU.\r\n",
+	"Invalid BPDU received. Discarding it.\r\n",
+	"Bridge: ",
+	"CIST: ",
+	"MST{D}: ",
+	"{S}: -> {S}\r\n",
+	"Port {D}: ",
+	"{T}: Setting adminPointToPointMAC = {S} on port {D}...\r\n",
+	"{T}: Setting bridge priority: tree {TN} prio = {D}...\r\n",
+	"{T}: Setting port priority: port {D} tree {TN} prio = {D}...\r\n",
+	"{T}: Setting MST Config Name to \"{S}\"...\r\n",
+	"{T}: Setting MST Config Revision Level to {D}...\r\n",
+	"Digest computation deferred until commit.\r\n",
+	"New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
+	"{T}: Setting MST Config Table... ",
+	"... nothing changed.\r\n",
+	"{T}: Switching to {S}... ",
+	"... bridge was already running {S}.\r\n",
+	"Name=\"{S}\", Rev={D}, Digest={X2}{X2}..{X2}{X2}\r\n",
+	"{T}: Setting Port {D} AdminExternalPortPathCost to {D}...\r\n",
+	"{T}: Setting Port {D} {TN} AdminInternalPortPathCost to {D}...\r\n",
+	// stp_bpdu.cpp
+	"Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}\r\n",
+	"CIST Root ID                 : {BID}\r\n",
+	"CIST External Path Cost      : {D7}\r\n",
+	"CIST Regional Root ID        : {BID}\r\n",
+	"CIST Internal Root Path Cost : {D7}\r\n",
+	"CIST Bridge ID               : {BID}\r\n",
+	"CIST Port ID                 : {PID}\r\n",
+	"CIST MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}, remainingHops={D}\r\n",
+	"MSTI #{D}\r\n",
+	"  Root ID        : {BID}\r\n",
+	"  Root Path Cost : {D7}\r\n",
+	"  Bridge ID      : {BID}\r\n",
+	"  Port ID        : {PID}\r\n",
+	"  MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}\r\n",
+	"Flags: TC={D}, TCAck={D}\r\n",
+	"Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}, Master={D}\r\n",
+	"RegionalRootId       : {BID}\r\n",
+	"InternalRootPathCost : {D}\r\n",
+	"BridgePriority       : 0x{X2}\r\n",
+	"PortPriority         : 0x{X2}\r\n",
+	"RemainingHops        : {D}\r\n",
+	// stp_procedures.cpp
+	"rcvMsgs() -- rcvdInternal==1\r\n",
+	"rcvMsgs() -- Ignoring MSTI messages {D}..{D}\r\n",
+	"rcvMsgs() -- rcvdInternal==0\r\n",
+	"Port {D}: {TN}: recordMastered(): {D}\r\n",
+	"Port {D}: {TN}: recordPriority(): {PVS}\r\n",
+	"TX Config BPDU to port {D}:\r\n",
+	"TX RSTP BPDU to port {D}:\r\n",
+	"TX MSTP BPDU to port {D}:\r\n",
+	"TX TCN BPDU to port {D}:\r\n",
+	"Tree {D}:\r\n",
+	"  BridgeID: {BID}\r\n",
+	"  Port {D} root path priority  : {PVS}\r\n",
+	"  bridge root priority : {PVS}\r\n",
+	"  root port = {PID}\r\n",
+	"  Port {D} designated priority : {PVS}\r\n",
+	"Port {D}: {TN}: selectedRole set to {S}\r\n",
+};
+
+#endif
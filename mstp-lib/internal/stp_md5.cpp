@@ -27,18 +27,7 @@ documentation and/or software.
 #include <assert.h>
 #include <string.h>
 
-static void Transform (unsigned int *buf, unsigned int* in);
-
-static unsigned char PADDING[64] = {
-	0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void Transform (unsigned int* buf, const unsigned char* block);
 
 /* F, G and H are basic MD5 functions: selection, majority, parity */
 #define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
@@ -72,25 +61,10 @@ static unsigned char PADDING[64] = {
 	(a) += (b); \
 	}
 
-static void MD5Init (MD5_CTX* mdContext)
-{
-	mdContext->i[0] = mdContext->i[1] = 0;
-
-	// Constant from table 13-1, page 482 in 802.1Q-2018.
-	mdContext->buf[0] = 0x67452301u;
-	mdContext->buf[1] = 0xefcdab89u;
-	mdContext->buf[2] = 0x98badcfeu;
-	mdContext->buf[3] = 0x10325476u;
-}
-
 static void MD5Update (MD5_CTX* mdContext, const unsigned char* inBuf, unsigned int inLen)
 {
-	unsigned int in[16];
-	int mdi;
-	unsigned int i, ii;
-
 	/* compute number of bytes mod 64 */
-	mdi = (int)((mdContext->i[0] >> 3) & 0x3F);
+	unsigned int mdi = (mdContext->i[0] >> 3) & 0x3F;
 
 	/* update number of bits */
 	if ((mdContext->i[0] + ((unsigned int)inLen << 3)) < mdContext->i[0])
@@ -98,48 +72,61 @@ static void MD5Update (MD5_CTX* mdContext, const unsigned char* inBuf, unsigned
 	mdContext->i[0] += ((unsigned int)inLen << 3);
 	mdContext->i[1] += ((unsigned int)inLen >> 29);
 
-	while (inLen--) {
-		/* add new character to buffer, increment mdi */
-		mdContext->in[mdi++] = *inBuf++;
-
-		/* transform if necessary */
-		if (mdi == 0x40) {
-			for (i = 0, ii = 0; i < 16; i++, ii += 4)
-				in[i] = (((unsigned int)mdContext->in[ii+3]) << 24) |
-				(((unsigned int)mdContext->in[ii+2]) << 16) |
-				(((unsigned int)mdContext->in[ii+1]) << 8) |
-				((unsigned int)mdContext->in[ii]);
-			Transform (mdContext->buf, in);
-			mdi = 0;
+	// Complete a block left partially filled by a previous call.
+	if (mdi != 0)
+	{
+		unsigned int n = 64 - mdi;
+		if (inLen < n)
+		{
+			memcpy (&mdContext->in[mdi], inBuf, inLen);
+			return;
 		}
+
+		memcpy (&mdContext->in[mdi], inBuf, n);
+		Transform (mdContext->buf, mdContext->in);
+		inBuf += n;
+		inLen -= n;
+	}
+
+	// Whole blocks are hashed directly from the caller's buffer.
+	while (inLen >= 64)
+	{
+		Transform (mdContext->buf, inBuf);
+		inBuf += 64;
+		inLen -= 64;
 	}
+
+	memcpy (mdContext->in, inBuf, inLen);
 }
 
 static void MD5Final (MD5_CTX* mdContext, unsigned char* digest)
 {
-	unsigned int in[16];
-	int mdi;
 	unsigned int i, ii;
-	unsigned int padLen;
-
-	/* save number of bits */
-	in[14] = mdContext->i[0];
-	in[15] = mdContext->i[1];
 
 	/* compute number of bytes mod 64 */
-	mdi = (int)((mdContext->i[0] >> 3) & 0x3F);
+	unsigned int mdi = (mdContext->i[0] >> 3) & 0x3F;
 
 	/* pad out to 56 mod 64 */
-	padLen = (mdi < 56) ? (56 - mdi) : (120 - mdi);
-	MD5Update (mdContext, PADDING, padLen);
+	mdContext->in[mdi++] = 0x80;
+	if (mdi > 56)
+	{
+		memset (&mdContext->in[mdi], 0, 64 - mdi);
+		Transform (mdContext->buf, mdContext->in);
+		mdi = 0;
+	}
+
+	memset (&mdContext->in[mdi], 0, 56 - mdi);
 
 	/* append length in bits and transform */
-	for (i = 0, ii = 0; i < 14; i++, ii += 4)
-		in[i] = (((unsigned int)mdContext->in[ii+3]) << 24) |
-		(((unsigned int)mdContext->in[ii+2]) << 16) |
-		(((unsigned int)mdContext->in[ii+1]) << 8) |
-		((unsigned int)mdContext->in[ii]);
-	Transform (mdContext->buf, in);
+	for (i = 0; i < 2; i++)
+	{
+		mdContext->in[56 + 4 * i]     = (unsigned char)(mdContext->i[i] & 0xFF);
+		mdContext->in[56 + 4 * i + 1] = (unsigned char)((mdContext->i[i] >> 8) & 0xFF);
+		mdContext->in[56 + 4 * i + 2] = (unsigned char)((mdContext->i[i] >> 16) & 0xFF);
+		mdContext->in[56 + 4 * i + 3] = (unsigned char)((mdContext->i[i] >> 24) & 0xFF);
+	}
+
+	Transform (mdContext->buf, mdContext->in);
 
 	/* store buffer in digest */
 	for (i = 0, ii = 0; i < 4; i++, ii += 4) {
@@ -153,10 +140,17 @@ static void MD5Final (MD5_CTX* mdContext, unsigned char* digest)
 	}
 }
 
-/* Basic MD5 step. Transform buf based on in.
+/* Basic MD5 step. Transform buf based on the 64 bytes at block.
 */
-static void Transform (unsigned int *buf, unsigned int* in)
+static void Transform (unsigned int* buf, const unsigned char* block)
 {
+	// The words are assembled from bytes, so the block needs no particular alignment and the code works on
+	// big-endian processors too. Compilers for little-endian processors turn each of these into a single load.
+	unsigned int in[16];
+	for (unsigned int i = 0; i < 16; i++)
+		in[i] = ((unsigned int)block[4 * i + 3] << 24) | ((unsigned int)block[4 * i + 2] << 16)
+			| ((unsigned int)block[4 * i + 1] << 8) | (unsigned int)block[4 * i];
+
 	unsigned int a = buf[0], b = buf[1], c = buf[2], d = buf[3];
 
 	/* Round 1 */
@@ -253,22 +247,20 @@ static void Transform (unsigned int *buf, unsigned int* in)
 	buf[3] += d;
 }
 
-static const unsigned char ConfigurationDigestSignatureKey [16] = { 0x13, 0xAC, 0x06, 0xA6, 0x2E, 0x47, 0xFD, 0x51, 0xF9, 0x5D, 0x2B, 0xA2, 0x43, 0xCD, 0x03, 0x46 };
+// The key is the Configuration Digest Signature Key from table 13-1, page 482 in 802.1Q-2018:
+// 0x13AC06A62E47FD51F95D2BA243CD0346. Since it is fixed, the MD5 states after hashing the inner pad
+// (key XORed with 0x36 bytes) and the outer pad (key XORed with 0x5C bytes) are constants too.
+// They were computed by hashing the 64-byte pads, built as in RFC 2104, starting from the MD5 initial
+// state 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476.
+static const unsigned int InnerPadMidstate [4] = { 0x6b8f0e69u, 0xa38e5d5eu, 0xde18ccd2u, 0xe7a77319u };
+static const unsigned int OuterPadMidstate [4] = { 0x790530e1u, 0xeee1eab5u, 0x02e19ddcu, 0xf5919137u };
 
 void HMAC_MD5_Init (HMAC_MD5_CONTEXT* context)
 {
-	// perform inner MD5
-	// inner padding - key XORd with ipad
-	unsigned char k_ipad [65]; 
-	memset (k_ipad, 0, sizeof k_ipad);
-	memcpy (k_ipad, ConfigurationDigestSignatureKey, sizeof (ConfigurationDigestSignatureKey));
-	for (int i = 0; i < 64; i++)
-		k_ipad [i] ^= 0x36;
-
-	// init context for 1st pass
-	// start with inner pad
-	MD5Init (context);					
-	MD5Update (context, k_ipad, 64);
+	// Same as initializing MD5 and hashing the 64-byte inner pad.
+	memcpy (context->buf, InnerPadMidstate, 16);
+	context->i[0] = 64 << 3;
+	context->i[1] = 0;
 }
 
 void HMAC_MD5_Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int text_len)
@@ -281,23 +273,29 @@ void HMAC_MD5_End (HMAC_MD5_CONTEXT* context)
 	// finish up 1st pass
 	MD5Final (context, context->digest);
 
-	// perform outer MD5
-	unsigned char k_opad[65];
-	memset (k_opad, 0, sizeof k_opad);
-	memcpy (k_opad, ConfigurationDigestSignatureKey, sizeof (ConfigurationDigestSignatureKey));
-	for (int i = 0; i < 64; i++)
-		k_opad[i] ^= 0x5c;
+	// Outer MD5, starting from the state after the outer pad. What's left to hash is the 16-byte
+	// result of the 1st pass, which together with the MD5 padding makes up exactly one block.
+	memcpy (context->buf, OuterPadMidstate, 16);
+	context->i[0] = (64 + 16) << 3;
+	context->i[1] = 0;
+	memcpy (context->in, context->digest, 16);
 
-	// init context for 2nd pass
-	MD5Init (context);
-	
-	// start with outer pad
-	MD5Update (context, k_opad, 64);
+	MD5Final (context, context->digest);
+}
+
+void HMAC_MD5_GetMidstate (const HMAC_MD5_CONTEXT* context, unsigned int midstate[4])
+{
+	assert (((context->i[0] >> 3) & 0x3F) == 0);
+	memcpy (midstate, context->buf, 16);
+}
 
-	// then results of 1st hash
-	MD5Update (context, context->digest, 16);
+void HMAC_MD5_SetMidstate (HMAC_MD5_CONTEXT* context, const unsigned int midstate[4], unsigned int textLength)
+{
+	assert ((textLength % 64) == 0);
+	memcpy (context->buf, midstate, 16);
 
-	// finish up 2nd pass
-	MD5Final (context, context->digest);
+	// The inner hash starts with the 64-byte inner pad.
+	context->i[0] = (64 + textLength) << 3;
+	context->i[1] = (64 + textLength) >> 29;
 }
 
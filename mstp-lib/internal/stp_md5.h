@@ -22,4 +22,9 @@ void HMAC_MD5_Init (HMAC_MD5_CONTEXT* context);
 void HMAC_MD5_Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int text_len);
 void HMAC_MD5_End (HMAC_MD5_CONTEXT* context);
 
+// Not part of HMAC-MD5. Get or set the state of the inner hash between whole 64-byte blocks of text,
+// so that hashing can be resumed from a saved point. textLength is the number of text bytes hashed up to that point.
+void HMAC_MD5_GetMidstate (const HMAC_MD5_CONTEXT* context, unsigned int midstate[4]);
+void HMAC_MD5_SetMidstate (HMAC_MD5_CONTEXT* context, const unsigned int midstate[4], unsigned int textLength);
+
 #endif
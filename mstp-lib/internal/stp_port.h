@@ -12,11 +12,41 @@
 #include "stp_sm.h"
 #include "../stp.h"
 
+// Not in the standard. The per port per tree flags that procedures and conditions read or write for all ports of
+// a tree at once (allSynced, clearReselectTree, setSelectedTree, setSyncTree, setReRootTree, setTcPropTree,
+// syncMaster, the PortRoleSelection state machine) are not stored in PORT_TREE, but in bitsets with one bit
+// per port, one bitset per flag per tree (see BRIDGE_TREE::portFlags). This lets those loops work on whole words.
+enum PORT_FLAG
+{
+	PORT_FLAG_AGREE,
+	PORT_FLAG_AGREED,
+	PORT_FLAG_RE_ROOT,
+	PORT_FLAG_RESELECT,
+	PORT_FLAG_SELECTED,
+	PORT_FLAG_SYNC,
+	PORT_FLAG_SYNCED,
+	PORT_FLAG_TC_PROP,
+	PORT_FLAG_UPDT_INFO,
+	PORT_FLAG_COUNT,
+};
+
+// Not in the standard. Likewise, the timers of 13.25 that have one instance per port per tree are not stored in
+// PORT_TREE, but in arrays with one element per tree, one array per timer per port (see PORT::treeTimers). This
+// lets the TICK state of the Port Timers state machine decrement each timer for all trees of a port in one loop.
+enum TREE_TIMER
+{
+	TREE_TIMER_FD_WHILE,
+	TREE_TIMER_RR_WHILE,
+	TREE_TIMER_RB_WHILE,
+	TREE_TIMER_TC_WHILE,
+	TREE_TIMER_RCVD_INFO_WHILE,
+	TREE_TIMER_TC_DETECTED,
+	TREE_TIMER_COUNT,
+};
+
 struct PORT_TREE
 {
 	BRIDGE_ID pseudoRootId; // 13.27.ae) - 13.27.51
-	bool agree      : 1; // 13.27.ap) - 13.27.3
-	bool agreed     : 1; // 13.27.aq) - 13.27.4
 	bool disputed   : 1; // 13.27.at) - 13.27.22
 	bool fdbFlush   : 1; // 13.27.au) - 13.27.28
 	bool forward    : 1; // 13.27.av) - 13.27.29
@@ -27,13 +57,42 @@ struct PORT_TREE
 	bool proposing  : 1; // 13.27.bh) - 13.27.50
 	bool rcvdMsg    : 1; // 13.27.bj) - 13.27.55
 	bool rcvdTc     : 1; // 13.27.bk) - 13.27.58
-	bool reRoot     : 1; // 13.27.bl) - 13.27.61
-	bool reselect   : 1; // 13.27.bm) - 13.27.62
-	bool selected   : 1; // 13.27.bo) - 13.27.67
-	bool sync       : 1; // 13.27.bq) - 13.27.70
-	bool synced     : 1; // 13.27.br) - 13.27.71
-	bool tcProp     : 1; // 13.27.bs) - 13.27.73
-	bool updtInfo   : 1; // 13.27.bt) - 13.27.76
+
+	// Location of the bit of this port in the flag bitsets of the tree: flagWords points to the word holding
+	// the bit in the first bitset, and the same word of the next bitset is flagStride words further.
+	unsigned int* flagWords;
+	unsigned int  flagMask;
+	unsigned int  flagStride;
+
+	bool GetFlag (PORT_FLAG flag) const { return (flagWords[flag * flagStride] & flagMask) != 0; }
+
+	void SetFlag (PORT_FLAG flag, bool value)
+	{
+		if (value)
+			flagWords[flag * flagStride] |= flagMask;
+		else
+			flagWords[flag * flagStride] &= ~flagMask;
+	}
+
+	bool GetAgree()    const { return GetFlag (PORT_FLAG_AGREE);     } // 13.27.ap) - 13.27.3
+	bool GetAgreed()   const { return GetFlag (PORT_FLAG_AGREED);    } // 13.27.aq) - 13.27.4
+	bool GetReRoot()   const { return GetFlag (PORT_FLAG_RE_ROOT);   } // 13.27.bl) - 13.27.61
+	bool GetReselect() const { return GetFlag (PORT_FLAG_RESELECT);  } // 13.27.bm) - 13.27.62
+	bool GetSelected() const { return GetFlag (PORT_FLAG_SELECTED);  } // 13.27.bo) - 13.27.67
+	bool GetSync()     const { return GetFlag (PORT_FLAG_SYNC);      } // 13.27.bq) - 13.27.70
+	bool GetSynced()   const { return GetFlag (PORT_FLAG_SYNCED);    } // 13.27.br) - 13.27.71
+	bool GetTcProp()   const { return GetFlag (PORT_FLAG_TC_PROP);   } // 13.27.bs) - 13.27.73
+	bool GetUpdtInfo() const { return GetFlag (PORT_FLAG_UPDT_INFO); } // 13.27.bt) - 13.27.76
+
+	void SetAgree    (bool value) { SetFlag (PORT_FLAG_AGREE,     value); }
+	void SetAgreed   (bool value) { SetFlag (PORT_FLAG_AGREED,    value); }
+	void SetReRoot   (bool value) { SetFlag (PORT_FLAG_RE_ROOT,   value); }
+	void SetReselect (bool value) { SetFlag (PORT_FLAG_RESELECT,  value); }
+	void SetSelected (bool value) { SetFlag (PORT_FLAG_SELECTED,  value); }
+	void SetSync     (bool value) { SetFlag (PORT_FLAG_SYNC,      value); }
+	void SetSynced   (bool value) { SetFlag (PORT_FLAG_SYNCED,    value); }
+	void SetTcProp   (bool value) { SetFlag (PORT_FLAG_TC_PROP,   value); }
+	void SetUpdtInfo (bool value) { SetFlag (PORT_FLAG_UPDT_INFO, value); }
 
 	// Note AG: I added these flag variables here for convenience; they're not in the standard.
 	// When a BPDU is received, the procedure rcvMsgs() populates them with the flags present in the received BPDU.
@@ -72,12 +131,27 @@ struct PORT_TREE
 //	PRIORITY_VECTOR neighbourPriority; // 13.27.bx) - 13.27.41
 
 	// 13.25 State machine timers
-	unsigned short fdWhile;			// e) - 13.25.2
-	unsigned short rrWhile;			// f) - 13.25.7
-	unsigned short rbWhile;			// g) - 13.25.5
-	unsigned short tcWhile;			// h) - 13.25.9
-	unsigned short rcvdInfoWhile;	// i) - 13.25.6
-	unsigned short tcDetected;		// j) - 13.25.8
+	// Location of this tree's element in the timer arrays of the port: timers points to it in the first array,
+	// and the element of the next array is timerStride elements further.
+	unsigned short* timers;
+	unsigned int    timerStride;
+
+	unsigned short GetTimer (TREE_TIMER timer) const { return timers[timer * timerStride]; }
+	void SetTimer (TREE_TIMER timer, unsigned int value) { timers[timer * timerStride] = (unsigned short) value; }
+
+	unsigned short GetFdWhile()       const { return GetTimer (TREE_TIMER_FD_WHILE);        } // e) - 13.25.2
+	unsigned short GetRrWhile()       const { return GetTimer (TREE_TIMER_RR_WHILE);        } // f) - 13.25.7
+	unsigned short GetRbWhile()       const { return GetTimer (TREE_TIMER_RB_WHILE);        } // g) - 13.25.5
+	unsigned short GetTcWhile()       const { return GetTimer (TREE_TIMER_TC_WHILE);        } // h) - 13.25.9
+	unsigned short GetRcvdInfoWhile() const { return GetTimer (TREE_TIMER_RCVD_INFO_WHILE); } // i) - 13.25.6
+	unsigned short GetTcDetected()    const { return GetTimer (TREE_TIMER_TC_DETECTED);     } // j) - 13.25.8
+
+	void SetFdWhile       (unsigned int value) { SetTimer (TREE_TIMER_FD_WHILE,        value); }
+	void SetRrWhile       (unsigned int value) { SetTimer (TREE_TIMER_RR_WHILE,        value); }
+	void SetRbWhile       (unsigned int value) { SetTimer (TREE_TIMER_RB_WHILE,        value); }
+	void SetTcWhile       (unsigned int value) { SetTimer (TREE_TIMER_TC_WHILE,        value); }
+	void SetRcvdInfoWhile (unsigned int value) { SetTimer (TREE_TIMER_RCVD_INFO_WHILE, value); }
+	void SetTcDetected    (unsigned int value) { SetTimer (TREE_TIMER_TC_DETECTED,     value); }
 
 	// Not in the standard. Used by STP_Get/SetAdminInternalPortPathCost.
 	unsigned int adminInternalPortPathCost;
@@ -86,6 +160,17 @@ struct PORT_TREE
 	PortRoleTransitions::State portRoleTransitionsState;
 	PortStateTransition::State portStateTransitionState;
 	TopologyChange::State      topologyChangeState;
+
+	// Not in the standard. Set when the four state machines above must be re-evaluated by RunStateMachines,
+	// either because they're in the middle of a transition sequence or because something they read was changed.
+	// roleTransitionsSmDirty is set when only PortRoleTransitions must be re-evaluated, because a variable of
+	// another port that it reads through allSynced or reRooted was changed.
+	bool smDirty;
+	bool roleTransitionsSmDirty;
+
+	// Not in the standard. Cleared when a variable that txRstp encodes for this tree changes, other than the flags
+	// and the Hello Time, which txRstp encodes every time. See PORT::txBpdu and STP_BRIDGE::InvalidateTxBpdu.
+	bool txBpduValid;
 };
 
 struct PORT
@@ -152,8 +237,20 @@ struct PORT
 	// One instance of the following shall be implemented per port when L2GP functionality is provided:
 	unsigned short pseudoInfoHelloWhen; // d) - 13.25.10
 
+	// Not in the standard. TREE_TIMER_COUNT arrays with one element per tree (1 + mstiCount elements,
+	// regardless of ForceProtocolVersion), one after the other. See TREE_TIMER.
+	unsigned short* treeTimers;
 
+	// Not in the standard. The last BPDU encoded by txRstp for this port, sizeof(MSTP_BPDU) + mstiCount * sizeof(MSTI_CONFIG_MESSAGE)
+	// bytes long. txRstp re-encodes only the parts of the trees whose PORT_TREE::txBpduValid is false.
+	MSTP_BPDU* txBpdu;
 
+	// Not in the standard. A copy of the last Config, RST or MST BPDU whose processing by the state machines finished on
+	// this port (only its first sizeof(MSTP_BPDU) + mstiCount * sizeof(MSTI_CONFIG_MESSAGE) bytes, which is as far as rcvMsgs
+	// reads), and its size as received; the size is zero when there is no such BPDU. The msg* variables of the trees and
+	// rcvdInternal still hold what rcvMsgs decoded from it. See ProcessRepeatedBpdu in stp.cpp.
+	unsigned char* lastRcvdBpdu;
+	unsigned int   lastRcvdBpduSize;
 
 	PORT_TREE** trees;
 
@@ -185,6 +282,22 @@ struct PORT
 	BridgeDetection::State       bridgeDetectionState;
 	L2GPortReceive::State        l2gpState;
 	PortTransmit::State          portTransmitState;
+
+	// Not in the standard. Dirty flags used by RunStateMachines to skip state machines whose inputs didn't change.
+	// smDirty covers the four per-port machines above PortTransmit, and treeSmDirty is set when PORT_TREE::smDirty
+	// or PORT_TREE::roleTransitionsSmDirty is set for at least one tree of this port. (PortTransmit is covered by STP_BRIDGE::dirtyTransmitPorts.)
+	bool smDirty;
+	bool treeSmDirty;
+
+#if STP_USE_LOG
+	// Not in the standard. See STP_EnablePortLogging.
+	bool logEnabled;
+#endif
+
+#if STP_USE_STATISTICS
+	// Not in the standard. See STP_GetPortStatistics.
+	STP_PORT_STATISTICS statistics;
+#endif
 };
 
 #endif
@@ -9,6 +9,7 @@
 #include "stp_conditions_and_params.h"
 #include "stp_log.h"
 #include <assert.h>
+#include <string.h>
 #include <stddef.h>
 
 #ifdef __GNUC__
@@ -52,8 +53,7 @@ void clearAllRcvdMsgs (STP_BRIDGE* bridge, PortIndex givenPort)
 // Clears reselect for the tree (the CIST or a given MSTI) for all ports of the bridge.
 void clearReselectTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->reselect = false;
+	SetAllPortBits (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_RESELECT), bridge->portCount, false);
 }
 
 // ============================================================================
@@ -134,11 +134,11 @@ void newTcDetected (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree
 	PORT* port = bridge->ports[givenPort];
 	PORT_TREE* portTree = port->trees[givenTree];
 
-	if ((portTree->tcDetected == 0) && port->sendRSTP)
-		portTree->tcDetected = port->trees [CIST_INDEX]->portTimes.HelloTime + 1;
+	if ((portTree->GetTcDetected() == 0) && port->sendRSTP)
+		portTree->SetTcDetected (port->trees [CIST_INDEX]->portTimes.HelloTime + 1);
 
-	if ((portTree->tcDetected == 0) && !port->sendRSTP)
-		portTree->tcDetected = bridge->trees[givenTree]->rootTimes.MaxAge + bridge->trees[givenTree]->rootTimes.ForwardDelay;
+	if ((portTree->GetTcDetected() == 0) && !port->sendRSTP)
+		portTree->SetTcDetected (bridge->trees[givenTree]->rootTimes.MaxAge + bridge->trees[givenTree]->rootTimes.ForwardDelay);
 }
 
 // ============================================================================
@@ -157,21 +157,25 @@ void newTcWhile (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree, u
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* portTree = port->trees [givenTree];
 
-	if ((portTree->tcWhile == 0) && port->sendRSTP)
+	if ((portTree->GetTcWhile() == 0) && port->sendRSTP)
 	{
 		// Note AG: See in 802.1Q-2018:
 		//  - 12.8.1.1.3, b) and c);
 		//  - 12.8.1.2.3, c) and d).
-		if (bridge->callbacks.onTopologyChange)
+		if ((bridge->callbacks.onTopologyChange != NULL) || STP_USE_STATISTICS)
 		{
 			bool allZero = true;
 			for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-				allZero &= (bridge->ports[portIndex]->trees[givenTree]->tcWhile == 0);
+				allZero &= (bridge->ports[portIndex]->trees[givenTree]->GetTcWhile() == 0);
 			if (allZero)
-				bridge->callbacks.onTopologyChange (bridge, (unsigned int) givenTree, timestamp);
+			{
+				COUNT_STATISTIC (bridge->trees[givenTree]->statistics.topologyChanges);
+				if (bridge->callbacks.onTopologyChange != NULL)
+					bridge->callbacks.onTopologyChange (bridge, (unsigned int) givenTree, timestamp);
+			}
 		}
 
-		portTree->tcWhile = 1 + port->trees [CIST_INDEX]->portTimes.HelloTime;
+		portTree->SetTcWhile (1 + port->trees [CIST_INDEX]->portTimes.HelloTime);
 
 		if (givenTree == CIST_INDEX)
 			port->newInfo = true;
@@ -179,9 +183,9 @@ void newTcWhile (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree, u
 			port->newInfoMsti = true;
 	}
 
-	if ((portTree->tcWhile == 0) && !port->sendRSTP)
+	if ((portTree->GetTcWhile() == 0) && !port->sendRSTP)
 	{
-		portTree->tcWhile = bridge->trees [givenTree]->rootTimes.MaxAge + bridge->trees [givenTree]->rootTimes.ForwardDelay;
+		portTree->SetTcWhile (bridge->trees [givenTree]->rootTimes.MaxAge + bridge->trees [givenTree]->rootTimes.ForwardDelay);
 	}
 }
 
@@ -475,19 +479,19 @@ void recordAgreement (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 
 		if (rstpVersion(bridge) && port->operPointToPointMAC && portTree->msgFlagsAgreement)
 		{
-			portTree->agreed = true;
+			portTree->SetAgreed (true);
 			portTree->proposing = false;
 		}
 		else
 		{
-			portTree->agreed = false;
+			portTree->SetAgreed (false);
 		}
 
 		if (port->rcvdInternal == false)
 		{
 			for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
 			{
-				port->trees [treeIndex]->agreed    = cistPortTree->agreed;
+				port->trees [treeIndex]->SetAgreed (cistPortTree->GetAgreed());
 				port->trees [treeIndex]->proposing = cistPortTree->proposing;
 			}
 		}
@@ -515,11 +519,11 @@ void recordAgreement (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 			&& (cistPortTree->msgPriority.RegionalRootId       == cistPortTree->portPriority.RegionalRootId)
 			&& portTree->msgFlagsAgreement)
 		{
-			portTree->agreed = true;
+			portTree->SetAgreed (true);
 			portTree->proposing = false;
 		}
 		else
-			portTree->agreed = false;
+			portTree->SetAgreed (false);
 	}
 }
 
@@ -554,14 +558,14 @@ void recordDispute (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree
 		if (portTree->msgFlagsLearning)
 		{
 			portTree->disputed = true;
-			portTree->agreed = false;
+			portTree->SetAgreed (false);
 
 			if (!port->rcvdInternal)
 			{
 				for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
 				{
 					port->trees [treeIndex]->disputed = true;
-					port->trees [treeIndex]->agreed = false;
+					port->trees [treeIndex]->SetAgreed (false);
 				}
 			}
 		}
@@ -571,7 +575,7 @@ void recordDispute (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree
 		if (portTree->msgFlagsLearning)
 		{
 			portTree->disputed = true;
-			portTree->agreed = false;
+			portTree->SetAgreed (false);
 		}
 	}
 }
@@ -698,8 +702,9 @@ void recordTimes (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree)
 // Sets reRoot TRUE for this tree (the CIST or a given MSTI) for all ports of the bridge.
 void setReRootTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->reRoot = true;
+	SetAllPortBits (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_RE_ROOT), bridge->portCount, true);
+
+	bridge->MarkTreeDirty (givenTree);
 }
 
 // ============================================================================
@@ -708,14 +713,33 @@ void setReRootTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 // for all ports in this tree. If reselect is TRUE for any port in this tree, this procedure takes no action.
 void setSelectedTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
-	for (unsigned int portIndex = 0;  portIndex < bridge->portCount; portIndex++)
+	if (IsAnyPortBitSet (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_RESELECT), bridge->portCount))
+		return;
+
+	// Only the ports whose selected variable was FALSE need their state machines evaluated again; selected is also read
+	// by allSynced, so a change on any port makes us mark the whole tree.
+	unsigned int* selected = bridge->GetPortFlagBitset (givenTree, PORT_FLAG_SELECTED);
+	unsigned int wordCount = bridge->portBitsetWordCount();
+	bool changed = false;
+	for (unsigned int wordIndex = 0; wordIndex < wordCount; wordIndex++)
 	{
-		if (bridge->ports [portIndex]->trees [givenTree]->reselect)
-			return;
+		unsigned int allPorts = (wordIndex + 1 < wordCount) ? 0xFFFFFFFF : GetPortBitsetLastWordMask (bridge->portCount);
+		unsigned int changedPorts = ~selected[wordIndex] & allPorts;
+		if (changedPorts == 0)
+			continue;
+
+		selected[wordIndex] = allPorts;
+		changed = true;
+
+		for (unsigned int bitIndex = 0; bitIndex < 32; bitIndex++)
+		{
+			if (changedPorts & (1u << bitIndex))
+				bridge->MarkPortTreeDirty (wordIndex * 32 + bitIndex, givenTree);
+		}
 	}
 
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->selected = true;
+	if (changed)
+		bridge->MarkTreeRoleTransitionsDirty (givenTree);
 }
 
 // ============================================================================
@@ -723,8 +747,9 @@ void setSelectedTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 // Sets sync TRUE for this tree (the CIST or a given MSTI) for all ports of the bridge.
 void setSyncTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->sync = true;
+	SetAllPortBits (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_SYNC), bridge->portCount, true);
+
+	bridge->MarkTreeDirty (givenTree);
 }
 
 // ============================================================================
@@ -782,11 +807,12 @@ void setTcPropTree (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree
 {
 	if (bridge->ports [givenPort]->restrictedTcn == false)
 	{
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			if (portIndex != (unsigned int) givenPort)
-				bridge->ports [portIndex]->trees [givenTree]->tcProp = true;
-		}
+		PORT_TREE* givenPortTree = bridge->ports [givenPort]->trees [givenTree];
+		bool givenPortTcProp = givenPortTree->GetTcProp();
+		SetAllPortBits (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_TC_PROP), bridge->portCount, true);
+		givenPortTree->SetTcProp (givenPortTcProp);
+
+		bridge->MarkTreeDirty (givenTree);
 	}
 }
 
@@ -806,13 +832,80 @@ void syncMaster (STP_BRIDGE* bridge)
 			for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
 			{
 				PORT_TREE* portTree = port->trees [treeIndex];
-				portTree->agree = false;
-				portTree->agreed = false;
-				portTree->synced = false;
-				portTree->sync = true;
+				portTree->SetAgree (false);
+				portTree->SetAgreed (false);
+				portTree->SetSynced (false);
+				portTree->SetSync (true);
 			}
 		}
 	}
+
+	for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
+		bridge->MarkTreeDirty (treeIndex);
+}
+
+// ============================================================================
+// Not in the standard. See STP_CALLBACKS::transmitBatch.
+
+void* GetTransmitBuffer (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int bpduSize, unsigned int timestamp)
+{
+	bridge->transmitBurstSize++;
+
+#if STP_USE_TRANSMIT_BATCH
+	if (bridge->callbacks.transmitBatch == NULL)
+#endif
+	{
+		void* buffer = bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
+		if (buffer == NULL)
+			COUNT_STATISTIC (bridge->ports[givenPort]->statistics.txGetBufferFailures);
+		return buffer;
+	}
+
+#if STP_USE_TRANSMIT_BATCH
+	assert (bpduSize <= bridge->GetMaxBpduSize());
+
+	if (bridge->transmitBatchCount == bridge->portCount)
+		FlushTransmitBatch (bridge, timestamp);
+
+	unsigned char* buffer = bridge->transmitBatchBuffer + bridge->transmitBatchCount * bridge->GetMaxBpduSize();
+
+	STP_TRANSMIT_BATCH_ENTRY* entry = &bridge->transmitBatchEntries [bridge->transmitBatchCount];
+	entry->portIndex = givenPort;
+	entry->bpdu = buffer;
+	entry->bpduSize = bpduSize;
+
+	return buffer;
+#endif
+}
+
+void ReleaseTransmitBuffer (STP_BRIDGE* bridge, void* buffer)
+{
+#if STP_USE_TRANSMIT_BATCH
+	if (bridge->callbacks.transmitBatch == NULL)
+#endif
+	{
+		bridge->callbacks.transmitReleaseBuffer (bridge, buffer);
+		return;
+	}
+
+#if STP_USE_TRANSMIT_BATCH
+	assert (buffer == bridge->transmitBatchEntries [bridge->transmitBatchCount].bpdu);
+	bridge->transmitBatchCount++;
+#endif
+}
+
+void FlushTransmitBatch (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+#if STP_USE_TRANSMIT_BATCH
+	if (bridge->transmitBatchCount > 0)
+	{
+		bridge->callbacks.transmitBatch (bridge, bridge->transmitBatchEntries, bridge->transmitBatchCount, timestamp);
+		bridge->transmitBatchCount = 0;
+	}
+#else
+	(void)bridge;
+	(void)timestamp;
+#endif
 }
 
 // ============================================================================
@@ -834,7 +927,7 @@ void txConfig (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 
 	FLUSH_LOG (bridge);
 
-	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
+	MSTP_BPDU* bpdu = (MSTP_BPDU*) GetTransmitBuffer (bridge, givenPort, bpduSize, timestamp);
 	if (bpdu != NULL)
 	{
 		// 14.3.a) in 802.1Q-2018
@@ -850,7 +943,7 @@ void txConfig (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 
 		bpdu->cistFlags = 0;
 
-		if (cistTree->tcWhile != 0)
+		if (cistTree->GetTcWhile() != 0)
 			bpdu->cistFlags |= (unsigned char) 1;
 
 		if (port->tcAck)
@@ -861,24 +954,34 @@ void txConfig (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 		bpdu->ForwardDelay = cistTree->designatedTimes.ForwardDelay * 256;
 		bpdu->HelloTime    = cistTree->portTimes.HelloTime * 256;
 
+		COUNT_STATISTIC (port->statistics.txConfigBpdus);
+
 		#if STP_USE_LOG
-			LOG (bridge, givenPort, -1, "TX Config BPDU to port {D}:\r\n", 1 + givenPort);
-			LOG_INDENT (bridge);
-			DumpConfigBpdu (bridge, givenPort, -1, bpdu);
-			LOG_UNINDENT (bridge);
+			if (LOG_CATEGORY_ENABLED (bridge, STP_LOG_CATEGORY_TX_BPDU_DUMP))
+			{
+				LOG (bridge, givenPort, -1, "TX Config BPDU to port {D}:\r\n", 1 + givenPort);
+				LOG_INDENT (bridge);
+				DumpConfigBpdu (bridge, givenPort, -1, bpdu);
+				LOG_UNINDENT (bridge);
 
-			FLUSH_LOG (bridge);
+				FLUSH_LOG (bridge);
+			}
 		#endif
-		bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+		ReleaseTransmitBuffer (bridge, bpdu);
 	}
 }
 
 // ============================================================================
 // 13.29.aa) - 13.29.28
+//
+// Not in the standard: the BPDU is encoded into port->txBpdu and then copied to the transmit buffer. The flags
+// and the Hello Time are encoded every time; the rest of the CIST information and of each MSTI Configuration
+// Message is encoded only when the tree's txBpduValid was cleared since the previous transmission on this port.
 void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 {
 	PORT* port = bridge->ports [givenPort];
 	PORT_TREE* cistTree = port->trees [CIST_INDEX];
+	MSTP_BPDU* bpdu = port->txBpdu;
 
 	unsigned int bpduSize;
 	if (bridge->ForceProtocolVersion < 3)
@@ -886,33 +989,75 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 	else
 		bpduSize = sizeof(MSTP_BPDU) + bridge->mstiCount * sizeof(MSTI_CONFIG_MESSAGE);
 
-	FLUSH_LOG (bridge);
+	if (!cistTree->txBpduValid)
+	{
+		// octets 1 and 2 - 14.3 in 802.1Q-2018
+		bpdu->protocolId = 0;
 
-	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
-	if (bpdu == NULL)
-		return;
+		// octets 3 and 4
+		bpdu->bpduType = 2;
+		if (bridge->ForceProtocolVersion < 3)
+			bpdu->protocolVersionId = 2; // 14.3.c)
+		else if (bridge->ForceProtocolVersion == 3)
+			bpdu->protocolVersionId = 3; // 14.3.d)
+		else
+			assert(false); // SPT not yet implemented by this function
 
-	// octets 1 and 2 - 14.3 in 802.1Q-2018
-	bpdu->protocolId = 0;
+		// octets 6 to 13 - 14.4.h) in 802.1Q-2018
+		bpdu->cistRootId = cistTree->designatedPriority.RootId;
 
-	// octets 3 and 4
-	bpdu->bpduType = 2;
-	if (bridge->ForceProtocolVersion < 3)
-		bpdu->protocolVersionId = 2; // 14.3.c)
-	else if (bridge->ForceProtocolVersion == 3)
-		bpdu->protocolVersionId = 3; // 14.3.d)
-	else
-		assert(false); // SPT not yet implemented by this function
+		// octets 14 to 17 - 14.4.i) in 802.1Q-2018
+		bpdu->cistExternalPathCost = cistTree->designatedPriority.ExternalRootPathCost;
+
+		// octets 18 to 25 - 14.4.j) in 802.1Q-2018
+		bpdu->cistRegionalRootId = cistTree->designatedPriority.RegionalRootId;
+
+		// octets 26 to 27 - 14.4.k) in 802.1Q-2018
+		bpdu->cistPortId = cistTree->designatedPriority.DesignatedPortId;
+
+		// octets 28 to 29 - 14.4.l) in 802.1Q-2018
+		bpdu->MessageAge = cistTree->designatedTimes.MessageAge * 256;
+
+		// octets 30 to 31 - 14.4.m) in 802.1Q-2018
+		bpdu->MaxAge = cistTree->designatedTimes.MaxAge * 256;
+
+		// octets 34 to 35 - 14.4.o) in 802.1Q-2018
+		bpdu->ForwardDelay = cistTree->designatedTimes.ForwardDelay * 256;
+
+		// octet 36 - 14.4.p) in 802.1Q-2018
+		bpdu->Version1Length = 0;
+
+		if (bridge->ForceProtocolVersion >= 3)
+		{
+			// octet 37 to 38 - 14.4.q) in 802.1Q-2018
+			bpdu->Version3Length = (unsigned short) (bpduSize - 38);
+
+			// octet 39 to 89 - 14.4.r) in 802.1Q-2018
+			bpdu->mstConfigId = bridge->MstConfigId;
+
+			// octet 90 to 93 - 14.4.s) in 802.1Q-2018
+			bpdu->cistInternalRootPathCost = cistTree->designatedPriority.InternalRootPathCost;
+
+			// octet 94 to 101 - 14.4.t) in 802.1Q-2018
+			bpdu->cistBridgeId = cistTree->designatedPriority.DesignatedBridgeId;
+			bpdu->cistBridgeId.SetPriorityAndMstid (bpdu->cistBridgeId.GetPriorityWithoutMstid(), 0);
+
+			// octet 102 - 14.4.u) in 802.1Q-2018
+			bpdu->cistRemainingHops = cistTree->designatedTimes.remainingHops;
+		}
+
+		cistTree->txBpduValid = true;
+	}
 
 	// octet 5 - 14.4.a) to 14.4.g) in 802.1Q-2018
 	bpdu->cistFlags = GetBpduPortRole(cistTree->role) << 2;
-	if (cistTree->agree)
+	if (cistTree->GetAgree())
 		bpdu->cistFlags |= (unsigned char) 0x40;
 
 	if (cistTree->proposing)
 		bpdu->cistFlags |= (unsigned char) 2;
 
-	if (cistTree->tcWhile != 0)
+	if (cistTree->GetTcWhile() != 0)
 		bpdu->cistFlags |= (unsigned char) 1;
 
 	if (cistTree->learning)
@@ -921,68 +1066,41 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 	if (cistTree->forwarding)
 		bpdu->cistFlags |= (unsigned char) 0x20;
 
-	// octets 6 to 13 - 14.4.h) in 802.1Q-2018
-	bpdu->cistRootId = cistTree->designatedPriority.RootId;
-
-	// octets 14 to 17 - 14.4.i) in 802.1Q-2018
-	bpdu->cistExternalPathCost = cistTree->designatedPriority.ExternalRootPathCost;
-
-	// octets 18 to 25 - 14.4.j) in 802.1Q-2018
-	bpdu->cistRegionalRootId = cistTree->designatedPriority.RegionalRootId;
-
-	// octets 26 to 27 - 14.4.k) in 802.1Q-2018
-	bpdu->cistPortId = cistTree->designatedPriority.DesignatedPortId;
-
-	// octets 28 to 29 - 14.4.l) in 802.1Q-2018
-	bpdu->MessageAge = cistTree->designatedTimes.MessageAge * 256;
-
-	// octets 30 to 31 - 14.4.m) in 802.1Q-2018
-	bpdu->MaxAge = cistTree->designatedTimes.MaxAge * 256;
-
 	// octets 32 to 33 - 14.4.n) in 802.1Q-2018
 	bpdu->HelloTime = cistTree->portTimes.HelloTime * 256;
 
-	// octets 34 to 35 - 14.4.o) in 802.1Q-2018
-	bpdu->ForwardDelay = cistTree->designatedTimes.ForwardDelay * 256;
-
-	// octet 36 - 14.4.p) in 802.1Q-2018
-	bpdu->Version1Length = 0;
-
 	if (bridge->ForceProtocolVersion >= 3)
 	{
-		// octet 37 to 38 - 14.4.q) in 802.1Q-2018
-		bpdu->Version3Length = (unsigned short) (bpduSize - 38);
-
-		// octet 39 to 89 - 14.4.r) in 802.1Q-2018
-		bpdu->mstConfigId = bridge->MstConfigId;
-
-		// octet 90 to 93 - 14.4.s) in 802.1Q-2018
-		bpdu->cistInternalRootPathCost = cistTree->designatedPriority.InternalRootPathCost;
-
-		// octet 94 to 101 - 14.4.t) in 802.1Q-2018
-		bpdu->cistBridgeId = cistTree->designatedPriority.DesignatedBridgeId;
-		bpdu->cistBridgeId.SetPriorityAndMstid (bpdu->cistBridgeId.GetPriorityWithoutMstid(), 0);
-
-		// octet 102 - 14.4.u) in 802.1Q-2018
-		bpdu->cistRemainingHops = cistTree->designatedTimes.remainingHops;
-
 		MSTI_CONFIG_MESSAGE* mstiMessage = reinterpret_cast<MSTI_CONFIG_MESSAGE*>(bpdu + 1);
 
 		// 14.4.1 in 802.1Q-2018
 		for (unsigned int mstiIndex = 0; mstiIndex < bridge->mstiCount; mstiIndex++)
 		{
-			const PORT_TREE* tree = port->trees [1 + mstiIndex];
+			PORT_TREE* tree = port->trees [1 + mstiIndex];
+
+			if (!tree->txBpduValid)
+			{
+				// b) to e)
+				mstiMessage->RegionalRootId       = tree->designatedPriority.RegionalRootId;
+				mstiMessage->InternalRootPathCost = tree->designatedPriority.InternalRootPathCost;
+				mstiMessage->BridgePriority       = bridge->trees[1 + mstiIndex]->GetBridgeIdentifier().GetPriorityWithoutMstid() >> 8;
+				mstiMessage->PortPriority         = tree->portId.GetPriority();
+				// f)
+				mstiMessage->RemainingHops        = tree->designatedTimes.remainingHops;
+
+				tree->txBpduValid = true;
+			}
 
 			// a)
 			mstiMessage->flags = GetBpduPortRole (tree->role) << 2;
 
-			if (tree->agree)
+			if (tree->GetAgree())
 				mstiMessage->flags |= (unsigned char) 0x40;
 
 			if (tree->proposing)
 				mstiMessage->flags |= (unsigned char) 2;
 
-			if (tree->tcWhile != 0)
+			if (tree->GetTcWhile() != 0)
 				mstiMessage->flags |= (unsigned char) 1;
 
 			if (port->master)
@@ -994,40 +1112,50 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 			if (tree->forwarding)
 				mstiMessage->flags |= (unsigned char) 0x20;
 
-			// b) to e)
-			mstiMessage->RegionalRootId       = tree->designatedPriority.RegionalRootId;
-			mstiMessage->InternalRootPathCost = tree->designatedPriority.InternalRootPathCost;
-			mstiMessage->BridgePriority       = bridge->trees[1 + mstiIndex]->GetBridgeIdentifier().GetPriorityWithoutMstid() >> 8;
-			mstiMessage->PortPriority         = tree->portId.GetPriority();
-			// f)
-			mstiMessage->RemainingHops        = tree->designatedTimes.remainingHops;
-
 			mstiMessage++;
 		}
 	}
 
-	#if STP_USE_LOG
+	FLUSH_LOG (bridge);
+
+	unsigned char* buffer = (unsigned char*) GetTransmitBuffer (bridge, givenPort, bpduSize, timestamp);
+	if (buffer == NULL)
+		return;
+
+	memcpy (buffer, bpdu, bpduSize);
+
+	#if STP_USE_STATISTICS
 		if (bridge->ForceProtocolVersion < 3)
-		{
-			LOG (bridge, givenPort, -1, "TX RSTP BPDU to port {D}:\r\n", 1 + givenPort);
-			LOG_INDENT (bridge);
-			DumpRstpBpdu (bridge, givenPort, -1, bpdu);
-			LOG_UNINDENT (bridge);
-		}
-		else if (bridge->ForceProtocolVersion == 3)
-		{
-			LOG (bridge, givenPort, -1, "TX MSTP BPDU to port {D}:\r\n", 1 + givenPort);
-			LOG_INDENT (bridge);
-			DumpMstpBpdu (bridge, givenPort, -1, bpdu);
-			LOG_UNINDENT (bridge);
-		}
+			port->statistics.txRstBpdus++;
 		else
-			assert(false); // not yet implemented for SPT
+			port->statistics.txMstBpdus++;
+	#endif
+
+	#if STP_USE_LOG
+		if (LOG_CATEGORY_ENABLED (bridge, STP_LOG_CATEGORY_TX_BPDU_DUMP))
+		{
+			if (bridge->ForceProtocolVersion < 3)
+			{
+				LOG (bridge, givenPort, -1, "TX RSTP BPDU to port {D}:\r\n", 1 + givenPort);
+				LOG_INDENT (bridge);
+				DumpRstpBpdu (bridge, givenPort, -1, bpdu);
+				LOG_UNINDENT (bridge);
+			}
+			else if (bridge->ForceProtocolVersion == 3)
+			{
+				LOG (bridge, givenPort, -1, "TX MSTP BPDU to port {D}:\r\n", 1 + givenPort);
+				LOG_INDENT (bridge);
+				DumpMstpBpdu (bridge, givenPort, -1, bpdu);
+				LOG_UNINDENT (bridge);
+			}
+			else
+				assert(false); // not yet implemented for SPT
 
-		FLUSH_LOG (bridge);
+			FLUSH_LOG (bridge);
+		}
 	#endif
 
-	bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+	ReleaseTransmitBuffer (bridge, buffer);
 }
 
 // ============================================================================
@@ -1035,7 +1163,7 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 void txTcn (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 {
 	FLUSH_LOG (bridge);
-	BPDU_HEADER* bpdu = (BPDU_HEADER*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, sizeof (BPDU_HEADER), timestamp);
+	BPDU_HEADER* bpdu = (BPDU_HEADER*) GetTransmitBuffer (bridge, givenPort, sizeof (BPDU_HEADER), timestamp);
 	if (bpdu == NULL)
 		return;
 
@@ -1044,10 +1172,12 @@ void txTcn (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 	bpdu->protocolVersionId = 0;
 	bpdu->bpduType = 0x80;
 
-	LOG (bridge, givenPort, -1, "TX TCN BPDU to port {D}:\r\n", 1 + givenPort);
+	COUNT_STATISTIC (bridge->ports [givenPort]->statistics.txTcnBpdus);
+
+	LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_TX_BPDU_DUMP, givenPort, -1, "TX TCN BPDU to port {D}:\r\n", 1 + givenPort);
 
 	FLUSH_LOG (bridge);
-	bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+	ReleaseTransmitBuffer (bridge, bpdu);
 }
 
 // ============================================================================
@@ -1111,10 +1241,10 @@ void updtRcvdInfoWhile	(STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex given
 	if (((cistTimes->MessageAge + 1 <= cistTimes->MaxAge) && (port->rcvdInternal == false))
 		|| (((int)cistTimes->remainingHops - 1 > 0) && port->rcvdInternal))
 	{
-		portTree->rcvdInfoWhile = 3 * cistTimes->HelloTime;
+		portTree->SetRcvdInfoWhile (3 * cistTimes->HelloTime);
 	}
 	else
-		portTree->rcvdInfoWhile = 0;
+		portTree->SetRcvdInfoWhile (0);
 }
 
 // ============================================================================
@@ -1208,8 +1338,8 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 
 	BRIDGE_TREE* bridgeTree = bridge->trees [givenTree];
 
-	LOG (bridge, -1, givenTree, "Tree {D}:\r\n", givenTree);
-	LOG (bridge, -1, givenTree, "  BridgeID: {BID}\r\n", &bridgeTree->GetBridgeIdentifier());
+	LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, -1, givenTree, "Tree {D}:\r\n", givenTree);
+	LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, -1, givenTree, "  BridgeID: {BID}\r\n", &bridgeTree->GetBridgeIdentifier());
 
 	BRIDGE_ID previousCistRegionalRootIdentifier = bridgeTree->rootPriority.RegionalRootId;
 	uint32_nbo previousCistExternalRootPathCost   = bridgeTree->rootPriority.ExternalRootPathCost;
@@ -1221,6 +1351,13 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 
 	PORT_TREE* rootPortTree = NULL;
 
+	// b) and c) The best of the bridge priority vector and of the root path priority vectors, with the Port Identifier
+	// as a tie-breaker. We find it as the minimum of the keys (see PRIORITY_VECTOR_KEY); the bridge priority vector
+	// gets Port Identifier zero, so it wins against a root path priority vector equal to it, same as in the standard.
+	PRIORITY_VECTOR_KEY bestKey;
+	bridgeTree->rootPriority.GetKey (0, &bestKey);
+	unsigned int bestPortIndex = bridge->portCount;
+
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		PORT* port = bridge->ports [portIndex];
@@ -1232,49 +1369,66 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			PRIORITY_VECTOR rootPathPriority;
 			CalculateRootPathPriorityForPort (bridge, portIndex, givenTree, &rootPathPriority);
 
-			LOG (bridge, -1, givenTree, "  Port {D} root path priority  : {PVS}\r\n", 1 + portIndex, &rootPathPriority);
+			LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, portIndex, givenTree, "  Port {D} root path priority  : {PVS}\r\n", 1 + portIndex, &rootPathPriority);
 
 			// c)
 			if ((rootPathPriority.DesignatedBridgeId.GetAddress () != bridgeTree->GetBridgePriority ().DesignatedBridgeId.GetAddress ())
 				&& (port->restrictedRole == false))
 			{
-				if (rootPathPriority.IsBetterThan (bridgeTree->rootPriority)
-					|| ((rootPathPriority == bridgeTree->rootPriority) && (portTree->portId.IsBetterThan (bridgeTree->rootPortId))))
+				PRIORITY_VECTOR_KEY key;
+				rootPathPriority.GetKey (portTree->portId.GetPortIdentifier(), &key);
+				if (key.IsLessThan (bestKey))
 				{
-					rootPortTree = portTree;
-
-					bridgeTree->rootPriority = rootPathPriority;
-					bridgeTree->rootPortId   = portTree->portId;
-
-					// d)
-					bridgeTree->rootTimes = portTree->portTimes;
-					if (port->rcvdInternal == false)
-						bridgeTree->rootTimes.MessageAge++;
-					else
-					{
-						assert (bridgeTree->rootTimes.remainingHops > 0);
-						bridgeTree->rootTimes.remainingHops--;
-					}
+					bestKey = key;
+					bestPortIndex = portIndex;
 				}
 			}
 		}
 	}
 
-	LOG (bridge, -1, givenTree, "  bridge root priority : {PVS}\r\n", &bridgeTree->rootPriority);
-	LOG (bridge, -1, givenTree, "  root port = {PID}\r\n", &bridgeTree->rootPortId);
+	if (bestPortIndex < bridge->portCount)
+	{
+		PORT* port = bridge->ports [bestPortIndex];
+		rootPortTree = port->trees [givenTree];
+
+		CalculateRootPathPriorityForPort (bridge, bestPortIndex, givenTree, &bridgeTree->rootPriority);
+		bridgeTree->rootPortId = rootPortTree->portId;
+
+		// d)
+		bridgeTree->rootTimes = rootPortTree->portTimes;
+		if (port->rcvdInternal == false)
+			bridgeTree->rootTimes.MessageAge++;
+		else
+		{
+			assert (bridgeTree->rootTimes.remainingHops > 0);
+			bridgeTree->rootTimes.remainingHops--;
+		}
+	}
+
+	LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, -1, givenTree, "  bridge root priority : {PVS}\r\n", &bridgeTree->rootPriority);
+	LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, -1, givenTree, "  root port = {PID}\r\n", &bridgeTree->rootPortId);
 
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		PORT* port = bridge->ports [portIndex];
 		PORT_TREE* portTree = port->trees [givenTree];
 
+		PRIORITY_VECTOR previousDesignatedPriority = portTree->designatedPriority;
+		TIMES previousDesignatedTimes = portTree->designatedTimes;
+
 		// e)
 		CalculateDesignatedPriorityForPort (bridge, portIndex, givenTree);
 
 		// f)
 		portTree->designatedTimes = bridgeTree->rootTimes;
 
-		LOG (bridge, -1, givenTree, "  Port {D} designated priority : {PVS}\r\n", 1 + portIndex, &portTree->designatedPriority);
+		if ((portTree->designatedPriority != previousDesignatedPriority) || (portTree->designatedTimes != previousDesignatedTimes))
+		{
+			bridge->MarkPortTreeDirty (portIndex, givenTree);
+			bridge->InvalidateTxBpdu (portIndex, givenTree);
+		}
+
+		LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, portIndex, givenTree, "  Port {D} designated priority : {PVS}\r\n", 1 + portIndex, &portTree->designatedPriority);
 	}
 
 	// If the root priority vector for the CIST is recalculated, and has a different Regional Root Identifier than that
@@ -1290,12 +1444,16 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 	// The CIST, or MSTI Port Role for each port is assigned, and its port priority vector and timer information are
 	// updated as specified in the remainder of this clause (13.41.2).
 
+	bool crossPortVariablesChanged = false;
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		PORT* port = bridge->ports [portIndex];
 		PORT_TREE* portTree = port->trees [givenTree];
 		PORT_TREE* cistPortTree = port->trees [CIST_INDEX];
 
+		STP_PORT_ROLE previousSelectedRole = portTree->selectedRole;
+		bool previousUpdtInfo = portTree->GetUpdtInfo();
+
 		// If the port is Disabled (infoIs == Disabled), selectedRole is set to DisabledPort.
 		if (portTree->infoIs == INFO_IS_DISABLED)
 		{
@@ -1325,15 +1483,15 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			// Let's look at the bridge times in this case.
 			if (portTree->portPriority != portTree->designatedPriority)
 			{
-				portTree->updtInfo = true;
+				portTree->SetUpdtInfo (true);
 			}
 			else if ((rootPortTree != NULL) && (portTree->portTimes != rootPortTree->designatedTimes))
 			{
-				portTree->updtInfo = true;
+				portTree->SetUpdtInfo (true);
 			}
 			else if ((rootPortTree == NULL) && (portTree->portTimes != bridgeTree->rootTimes))
 			{
-				portTree->updtInfo = true;
+				portTree->SetUpdtInfo (true);
 			}
 		}
 
@@ -1352,7 +1510,7 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			//    set to DesignatedPort.
 			if (portTree->infoIs == INFO_IS_AGED)
 			{
-				portTree->updtInfo = true;
+				portTree->SetUpdtInfo (true);
 				portTree->selectedRole = STP_PORT_ROLE_DESIGNATED;
 			}
 
@@ -1368,15 +1526,15 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 
 				if (portTree->portPriority != portTree->designatedPriority)
 				{
-					portTree->updtInfo = true;
+					portTree->SetUpdtInfo (true);
 				}
 				else if ((rootPortTree != NULL) && (portTree->portTimes != rootPortTree->designatedTimes))
 				{
-					portTree->updtInfo = true;
+					portTree->SetUpdtInfo (true);
 				}
 				else if ((rootPortTree == NULL) && (portTree->portTimes != bridgeTree->rootTimes))
 				{
-					portTree->updtInfo = true;
+					portTree->SetUpdtInfo (true);
 				}
 			}
 
@@ -1386,7 +1544,7 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			else if ((portTree->infoIs == INFO_IS_RECEIVED) && (rootPortTree == portTree))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_ROOT;
-				portTree->updtInfo = false;
+				portTree->SetUpdtInfo (false);
 			}
 
 			// m) If the port priority vector was received in a Configuration Message and is not aged
@@ -1406,7 +1564,7 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 				&& (portTree->portPriority.DesignatedBridgeId.GetAddress() != bridgeTree->GetBridgeIdentifier().GetAddress()))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_ALTERNATE;
-				portTree->updtInfo = false;
+				portTree->SetUpdtInfo (false);
 			}
 
 			// n) If the port priority vector was received in a Configuration Message and is not aged
@@ -1420,7 +1578,7 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 				&& (portTree->portPriority.DesignatedBridgeId.GetAddress() == bridgeTree->GetBridgeIdentifier ().GetAddress()))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_BACKUP;
-				portTree->updtInfo = false;
+				portTree->SetUpdtInfo (false);
 			}
 
 			// o) If the port priority vector was received in a Configuration Message and is not aged
@@ -1431,7 +1589,7 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 				&& (portTree->designatedPriority.IsBetterThan (portTree->portPriority)))
 			{
 				portTree->selectedRole = STP_PORT_ROLE_DESIGNATED;
-				portTree->updtInfo = true;
+				portTree->SetUpdtInfo (true);
 			}
 
 			else
@@ -1441,8 +1599,18 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			}
 		}
 
-		LOG (bridge, -1, givenTree, "Port {D}: {TN}: selectedRole set to {S}\r\n", 1 + portIndex, givenTree, GetPortRoleName (portTree->selectedRole));
+		LOG_IN_CATEGORY (bridge, STP_LOG_CATEGORY_ROLE_COMPUTATION, portIndex, givenTree, "Port {D}: {TN}: selectedRole set to {S}\r\n", 1 + portIndex, givenTree, GetPortRoleName (portTree->selectedRole));
+
+		if ((portTree->selectedRole != previousSelectedRole) || (portTree->GetUpdtInfo() != previousUpdtInfo))
+		{
+			bridge->MarkPortTreeDirty (portIndex, givenTree);
+			crossPortVariablesChanged = true;
+		}
 	}
+
+	// selectedRole and updtInfo are also read by allSynced for the other ports.
+	if (crossPortVariablesChanged)
+		bridge->MarkTreeRoleTransitionsDirty (givenTree);
 }
 
 // ============================================================================
@@ -1452,4 +1620,8 @@ void updtRolesDisabledTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		bridge->ports [portIndex]->trees [givenTree]->selectedRole = STP_PORT_ROLE_DISABLED;
+
+	bridge->MarkTreeDirty (givenTree);
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		bridge->MarkPortTreeDirty (portIndex, givenTree);
 }
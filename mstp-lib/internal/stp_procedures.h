@@ -43,4 +43,11 @@ void updtRcvdInfoWhile     (STP_BRIDGE*, PortIndex, TreeIndex);
 void updtRolesTree         (STP_BRIDGE*, TreeIndex);
 void updtRolesDisabledTree (STP_BRIDGE*, TreeIndex);
 
+// Not in the standard. Used by txConfig, txRstp and txTcn instead of calling transmitGetBuffer and transmitReleaseBuffer
+// directly, so that the BPDUs can be collected for the transmitBatch callback. RunStateMachines calls FlushTransmitBatch
+// when it finishes.
+void* GetTransmitBuffer    (STP_BRIDGE*, PortIndex, unsigned int bpduSize, unsigned int timestamp);
+void  ReleaseTransmitBuffer(STP_BRIDGE*, void* buffer);
+void  FlushTransmitBatch   (STP_BRIDGE*, unsigned int timestamp);
+
 #endif
@@ -10,6 +10,9 @@ struct StateMachine
 #if STP_USE_LOG
 	const char* smName;
 	const char* (*getStateName) (State state);
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE id; // index of STP_BRIDGE_STATISTICS::transitions
 #endif
 	State (*checkConditions) (const STP_BRIDGE* bridge, PortTreeArgs portTreeArgs, State state);
 	void (*initState) (STP_BRIDGE* bridge, PortTreeArgs portTreeArgs, State state, unsigned int timestamp);
@@ -43,6 +46,12 @@ namespace PortTimers {
 	};
 
 	extern const StateMachine<State, PortIndex> sm;
+
+	// Not in the standard. A tick is quiet when the TICK state marks no state machine dirty, so that running
+	// the state machines for it would only decrement the timers. GetQuietTickCount returns how many of the
+	// coming ticks are quiet (0xFFFFFFFF if all of them are), and SkipQuietTicks applies up to that many ticks at once.
+	unsigned int GetQuietTickCount (const STP_BRIDGE* bridge, PortIndex givenPort);
+	void SkipQuietTicks (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int tickCount);
 };
 
 namespace PortProtocolMigration {
@@ -141,6 +141,9 @@ const StateMachine<BridgeDetection::State, PortIndex> BridgeDetection::sm =
 #if STP_USE_LOG
 	"BridgeDetection",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_BRIDGE_DETECTION,
 #endif
 	&CheckConditions,
 	&InitState,
@@ -104,6 +104,9 @@ const StateMachine<State, PortIndex> L2GPortReceive::sm =
 #if STP_USE_LOG
 	"L2GPortReceive",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_L2G_PORT_RECEIVE,
 #endif
 	&CheckConditions,
 	&InitState
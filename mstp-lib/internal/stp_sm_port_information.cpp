@@ -72,7 +72,7 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == AGED)
 	{
-		if (portTree->selected && portTree->updtInfo)
+		if (portTree->GetSelected() && portTree->GetUpdtInfo())
 			return UPDATE;
 
 		return (State)0;
@@ -98,10 +98,10 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == CURRENT)
 	{
-		if (portTree->selected && portTree->updtInfo)
+		if (portTree->GetSelected() && portTree->GetUpdtInfo())
 			return UPDATE;
 
-		if ((portTree->infoIs == INFO_IS_RECEIVED) && (portTree->rcvdInfoWhile == 0) && !portTree->updtInfo && !rcvdXstMsg (bridge, givenPort, givenTree))
+		if ((portTree->infoIs == INFO_IS_RECEIVED) && (portTree->GetRcvdInfoWhile() == 0) && !portTree->GetUpdtInfo() && !rcvdXstMsg (bridge, givenPort, givenTree))
 			return AGED;
 
 		if (rcvdXstMsg (bridge, givenPort, givenTree) && !updtXstInfo (bridge, givenPort, givenTree))
@@ -147,21 +147,26 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	if (state == DISABLED)
 	{
 		portTree->rcvdMsg = false;
-		portTree->proposing = portTree->proposed = portTree->agree = portTree->agreed = false;
-		portTree->rcvdInfoWhile = 0;
-		portTree->infoIs = INFO_IS_DISABLED; portTree->reselect = true; portTree->selected = false;
+		portTree->proposing = portTree->proposed = false;
+		portTree->SetAgree (false);
+		portTree->SetAgreed (false);
+		portTree->SetRcvdInfoWhile (0);
+		portTree->infoIs = INFO_IS_DISABLED;
+		portTree->SetReselect (true);
+		portTree->SetSelected (false);
 	}
 	else if (state == AGED)
 	{
 		portTree->infoIs = INFO_IS_AGED;
-		portTree->reselect = true;
-		portTree->selected = false;
+		bridge->StartConvergenceMeasurement (givenTree, timestamp);
+		portTree->SetReselect (true);
+		portTree->SetSelected (false);
 	}
 	else if (state == UPDATE)
 	{
 		portTree->proposing = portTree->proposed = false;
-		portTree->agreed = portTree->agreed && betterorsameInfo (bridge, givenPort, givenTree, INFO_IS_MINE);
-		portTree->synced = portTree->synced && portTree->agreed;
+		portTree->SetAgreed (portTree->GetAgreed() && betterorsameInfo (bridge, givenPort, givenTree, INFO_IS_MINE));
+		portTree->SetSynced (portTree->GetSynced() && portTree->GetAgreed());
 
 //LOG (bridge, pi, ti, "-------------------------\r\n");
 //LOG (bridge, pi, ti, "{S} portTree->portPriority = portTree->designatedPriority\r\n", port->debugName);
@@ -173,7 +178,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 //LOG (bridge, pi, ti, "-------------------------\r\n");
 
 		portTree->portTimes = portTree->designatedTimes;
-		portTree->updtInfo = false;
+		portTree->SetUpdtInfo (false);
 		portTree->infoIs = INFO_IS_MINE;
 
 		if (givenTree == CIST_INDEX)
@@ -184,18 +189,22 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	else if (state == SUPERIOR_DESIGNATED)
 	{
 		port->infoInternal = port->rcvdInternal;
-		portTree->agreed = portTree->proposing = false;
+		portTree->SetAgreed (false);
+		portTree->proposing = false;
 		recordProposal (bridge, givenPort, givenTree);
 		setTcFlags (bridge, givenPort, givenTree);
-		portTree->agree = portTree->agree && betterorsameInfo (bridge, givenPort, givenTree, INFO_IS_RECEIVED);
+		portTree->SetAgree (portTree->GetAgree() && betterorsameInfo (bridge, givenPort, givenTree, INFO_IS_RECEIVED));
 		recordAgreement (bridge, givenPort, givenTree);
-		portTree->synced = portTree->synced && portTree->agreed;
+		portTree->SetSynced (portTree->GetSynced() && portTree->GetAgreed());
+		// Not in the standard. A superior BPDU that only renews the priority vector already recorded changes nothing.
+		if (!(portTree->msgPriority == portTree->portPriority))
+			bridge->StartConvergenceMeasurement (givenTree, timestamp);
 		recordPriority (bridge, givenPort, givenTree);
 		recordTimes (bridge, givenPort, givenTree);
 		updtRcvdInfoWhile (bridge, givenPort, givenTree);
 		portTree->infoIs = INFO_IS_RECEIVED;
-		portTree->reselect = true;
-		portTree->selected = false;
+		portTree->SetReselect (true);
+		portTree->SetSelected (false);
 		portTree->rcvdMsg = false;
 	}
 	else if (state == REPEATED_DESIGNATED)
@@ -239,6 +248,9 @@ const StateMachine<State, PortAndTree> PortInformation::sm =
 #if STP_USE_LOG
 	"PortInformation",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_INFORMATION,
 #endif
 	&CheckConditions,
 	&InitState
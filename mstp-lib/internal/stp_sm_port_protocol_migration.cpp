@@ -112,6 +112,9 @@ const StateMachine<PortProtocolMigration::State, PortIndex> PortProtocolMigratio
 #if STP_USE_LOG
 	"PortProtocolMigration",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION,
 #endif
 	&CheckConditions,
 	&InitState
@@ -98,6 +98,9 @@ const StateMachine<PortReceive::State, PortIndex> PortReceive::sm =
 #if STP_USE_LOG
 	"PortReceive",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_RECEIVE,
 #endif
 	&CheckConditions,
 	&InitState
@@ -49,11 +49,8 @@ static State CheckConditions (const STP_BRIDGE* bridge, TreeIndex givenTree, Sta
 
 	if (state == ROLE_SELECTION)
 	{
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			if (bridge->ports [portIndex]->trees [givenTree]->reselect)
-				return ROLE_SELECTION;
-		}
+		if (IsAnyPortBitSet (bridge->GetPortFlagBitset (givenTree, PORT_FLAG_RESELECT), bridge->portCount))
+			return ROLE_SELECTION;
 
 		return (State)0;
 	}
@@ -85,6 +82,9 @@ const StateMachine<State, TreeIndex> PortRoleSelection::sm =
 #if STP_USE_LOG
 	"PortRoleSelection",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_ROLE_SELECTION,
 #endif
 	&CheckConditions,
 	&InitState
@@ -84,7 +84,7 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 		return INIT_PORT;
 	}
 
-	if (tree->selected && !tree->updtInfo)
+	if (tree->GetSelected() && !tree->GetUpdtInfo())
 	{
 		if ((tree->selectedRole == STP_PORT_ROLE_DISABLED) && (tree->role != tree->selectedRole))
 			return DISABLE_PORT;
@@ -113,7 +113,7 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == DISABLE_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
 			if (!tree->learning && !tree->forwarding)
 				return DISABLED_PORT;
@@ -124,9 +124,9 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == DISABLED_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
-			if ((tree->fdWhile != MaxAge (bridge, givenPort)) || tree->sync || tree->reRoot || !tree->synced)
+			if ((tree->GetFdWhile() != MaxAge (bridge, givenPort)) || tree->GetSync() || tree->GetReRoot() || !tree->GetSynced())
 				return DISABLED_PORT;
 		}
 
@@ -138,27 +138,27 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == MASTER_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
-			if (((tree->sync && !tree->synced) || (tree->reRoot && (tree->rrWhile != 0)) || tree->disputed) && !port->operEdge && (tree->learn || tree->forward))
+			if (((tree->GetSync() && !tree->GetSynced()) || (tree->GetReRoot() && (tree->GetRrWhile() != 0)) || tree->disputed) && !port->operEdge && (tree->learn || tree->forward))
 				return MASTER_DISCARD;
 
-			if (((tree->fdWhile == 0) || allSynced (bridge, givenPort, givenTree)) && !tree->learn)
+			if (((tree->GetFdWhile() == 0) || allSynced (bridge, givenPort, givenTree)) && !tree->learn)
 				return MASTER_LEARN;
 
-			if (((tree->fdWhile == 0) || allSynced (bridge, givenPort, givenTree)) && (tree->learn && !tree->forward))
+			if (((tree->GetFdWhile() == 0) || allSynced (bridge, givenPort, givenTree)) && (tree->learn && !tree->forward))
 				return MASTER_FORWARD;
 
-			if (tree->proposed && !tree->agree)
+			if (tree->proposed && !tree->GetAgree())
 				return MASTER_PROPOSED;
 
-			if ((allSynced (bridge, givenPort, givenTree) && !tree->agree) || (tree->proposed && tree->agree))
+			if ((allSynced (bridge, givenPort, givenTree) && !tree->GetAgree()) || (tree->proposed && tree->GetAgree()))
 				return MASTER_AGREED;
 
-			if ((!tree->learning && !tree->forwarding && !tree->synced) || (tree->agreed && !tree->synced) || (port->operEdge && !tree->synced) || (tree->sync && tree->synced))
+			if ((!tree->learning && !tree->forwarding && !tree->GetSynced()) || (tree->GetAgreed() && !tree->GetSynced()) || (port->operEdge && !tree->GetSynced()) || (tree->GetSync() && tree->GetSynced()))
 				return MASTER_SYNCED;
 
-			if (tree->reRoot && (tree->rrWhile == 0))
+			if (tree->GetReRoot() && (tree->GetRrWhile() == 0))
 				return MASTER_RETIRED;
 		}
 
@@ -191,33 +191,33 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == ROOT_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
-			if (tree->proposed && !tree->agree)
+			if (tree->proposed && !tree->GetAgree())
 				return ROOT_PROPOSED;
 
-			if ((allSynced (bridge, givenPort, givenTree) && !tree->agree) || (tree->proposed && tree->agree))
+			if ((allSynced (bridge, givenPort, givenTree) && !tree->GetAgree()) || (tree->proposed && tree->GetAgree()))
 				return ROOT_AGREED;
 
-			if ((tree->agreed && !tree->synced) || (tree->sync && tree->synced))
+			if ((tree->GetAgreed() && !tree->GetSynced()) || (tree->GetSync() && tree->GetSynced()))
 				return ROOT_SYNCED;
 
-			if (!tree->forward && (tree->rbWhile == 0) && !tree->reRoot)
+			if (!tree->forward && (tree->GetRbWhile() == 0) && !tree->GetReRoot())
 				return REROOT;
 
-			if (tree->rrWhile != FwdDelay (bridge, givenPort))
+			if (tree->GetRrWhile() != FwdDelay (bridge, givenPort))
 				return ROOT_PORT;
 
-			if (tree->disputed || (spt(bridge) && !tree->agreed && (tree->learn || tree->forward)))
+			if (tree->disputed || (spt(bridge) && !tree->GetAgreed() && (tree->learn || tree->forward)))
 				return ROOT_DISCARD;
 
-			if (tree->reRoot && tree->forward)
+			if (tree->GetReRoot() && tree->forward)
 				return REROOTED;
 
-			if (((tree->fdWhile == 0) || (reRooted(bridge, givenPort, givenTree) && (tree->rbWhile == 0) && rstpVersion(bridge))) && !tree->learn && (tree->agreed || !spt(bridge)))
+			if (((tree->GetFdWhile() == 0) || (reRooted(bridge, givenPort, givenTree) && (tree->GetRbWhile() == 0) && rstpVersion(bridge))) && !tree->learn && (tree->GetAgreed() || !spt(bridge)))
 				return ROOT_LEARN;
 
-			if (((tree->fdWhile == 0) || (reRooted(bridge, givenPort, givenTree) && (tree->rbWhile == 0) && rstpVersion(bridge))) && tree->learn && !tree->forward && (tree->agreed || !spt(bridge)))
+			if (((tree->GetFdWhile() == 0) || (reRooted(bridge, givenPort, givenTree) && (tree->GetRbWhile() == 0) && rstpVersion(bridge))) && tree->learn && !tree->forward && (tree->GetAgreed() || !spt(bridge)))
 				return ROOT_FORWARD;
 		}
 
@@ -253,32 +253,32 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == DESIGNATED_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
-			if (!tree->forward && !tree->agreed && !tree->proposing && !port->operEdge)
+			if (!tree->forward && !tree->GetAgreed() && !tree->proposing && !port->operEdge)
 				return DESIGNATED_PROPOSE;
 
-			if (allSynced (bridge, givenPort, givenTree) && (tree->proposed || !tree->agree))
+			if (allSynced (bridge, givenPort, givenTree) && (tree->proposed || !tree->GetAgree()))
 				return DESIGNATED_AGREE;
 
-			if ((!tree->learning && !tree->forwarding && !tree->synced)
-				|| (tree->agreed && !tree->synced)
-				|| (port->operEdge && !tree->synced)
-				|| (tree->sync && tree->synced))
+			if ((!tree->learning && !tree->forwarding && !tree->GetSynced())
+				|| (tree->GetAgreed() && !tree->GetSynced())
+				|| (port->operEdge && !tree->GetSynced())
+				|| (tree->GetSync() && tree->GetSynced()))
 			{
 				return DESIGNATED_SYNCED;
 			}
 
-			if (tree->reRoot && (tree->rrWhile == 0))
+			if (tree->GetReRoot() && (tree->GetRrWhile() == 0))
 				return DESIGNATED_RETIRED;
 
-			if (((tree->sync && !tree->synced) || (tree->reRoot && (tree->rrWhile != 0)) || tree->disputed || port->isolate) && !port->operEdge && (tree->learn || tree->forward))
+			if (((tree->GetSync() && !tree->GetSynced()) || (tree->GetReRoot() && (tree->GetRrWhile() != 0)) || tree->disputed || port->isolate) && !port->operEdge && (tree->learn || tree->forward))
 				return DESIGNATED_DISCARD;
 
-			if (((tree->fdWhile == 0) || tree->agreed || port->operEdge) && ((tree->rrWhile == 0) || !tree->reRoot) && !tree->sync && !tree->learn && !port->isolate)
+			if (((tree->GetFdWhile() == 0) || tree->GetAgreed() || port->operEdge) && ((tree->GetRrWhile() == 0) || !tree->GetReRoot()) && !tree->GetSync() && !tree->learn && !port->isolate)
 				return DESIGNATED_LEARN;
 
-			if (((tree->fdWhile == 0) || tree->agreed || port->operEdge) && ((tree->rrWhile == 0) || !tree->reRoot) && !tree->sync && (tree->learn && !tree->forward) && !port->isolate)
+			if (((tree->GetFdWhile() == 0) || tree->GetAgreed() || port->operEdge) && ((tree->GetRrWhile() == 0) || !tree->GetReRoot()) && !tree->GetSync() && (tree->learn && !tree->forward) && !port->isolate)
 				return DESIGNATED_FORWARD;
 		}
 
@@ -311,18 +311,18 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == ALTERNATE_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
-			if (tree->proposed && !tree->agree)
+			if (tree->proposed && !tree->GetAgree())
 				return ALTERNATE_PROPOSED;
 
-			if ((allSynced (bridge, givenPort, givenTree) && !tree->agree) || (tree->proposed && tree->agree))
+			if ((allSynced (bridge, givenPort, givenTree) && !tree->GetAgree()) || (tree->proposed && tree->GetAgree()))
 				return ALTERNATE_AGREED;
 
-			if ((tree->fdWhile != forwardDelay (bridge, givenPort)) || tree->sync || tree->reRoot || !tree->synced)
+			if ((tree->GetFdWhile() != forwardDelay (bridge, givenPort)) || tree->GetSync() || tree->GetReRoot() || !tree->GetSynced())
 				return ALTERNATE_PORT;
 
-			if ((tree->rbWhile != 2 * HelloTime (bridge, givenPort)) && (tree->role == STP_PORT_ROLE_BACKUP))
+			if ((tree->GetRbWhile() != 2 * HelloTime (bridge, givenPort)) && (tree->role == STP_PORT_ROLE_BACKUP))
 				return BACKUP_PORT;
 		}
 
@@ -340,7 +340,7 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortAndTree pt, State st
 
 	if (state == BLOCK_PORT)
 	{
-		if (tree->selected && !tree->updtInfo)
+		if (tree->GetSelected() && !tree->GetUpdtInfo())
 		{
 			if (!tree->learning && !tree->forwarding)
 				return ALTERNATE_PORT;
@@ -372,11 +372,12 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 
 		tree->role = STP_PORT_ROLE_DISABLED;
 		tree->learn = tree->forward = false;
-		tree->synced = false;
-		tree->sync = tree->reRoot = true;
-		tree->rrWhile = FwdDelay (bridge, givenPort);
-		tree->fdWhile = MaxAge (bridge, givenPort);
-		tree->rbWhile = 0;
+		tree->SetSynced (false);
+		tree->SetSync (true);
+		tree->SetReRoot (true);
+		tree->SetRrWhile (FwdDelay (bridge, givenPort));
+		tree->SetFdWhile (MaxAge (bridge, givenPort));
+		tree->SetRbWhile (0);
 
 		if ((oldRole != STP_PORT_ROLE_DISABLED) && (bridge->callbacks.onPortRoleChanged != NULL))
 			bridge->callbacks.onPortRoleChanged (bridge, givenPort, givenTree, STP_PORT_ROLE_DISABLED, timestamp);
@@ -393,10 +394,11 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	}
 	else if (state == DISABLED_PORT)
 	{
-		tree->fdWhile = MaxAge (bridge, givenPort);
-		tree->synced = true;
-		tree->rrWhile = 0;
-		tree->sync = tree->reRoot = false;
+		tree->SetFdWhile (MaxAge (bridge, givenPort));
+		tree->SetSynced (true);
+		tree->SetRrWhile (0);
+		tree->SetSync (false);
+		tree->SetReRoot (false);
 	}
 
 	// ------------------------------------------------------------------------
@@ -418,34 +420,35 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	}
 	else if (state == MASTER_AGREED)
 	{
-		tree->proposed = tree->sync = false;
-		tree->agree = true;
+		tree->proposed = false;
+		tree->SetSync (false);
+		tree->SetAgree (true);
 	}
 	else if (state == MASTER_SYNCED)
 	{
-		tree->rrWhile = 0;
-		tree->synced = true;
-		tree->sync = false;
+		tree->SetRrWhile (0);
+		tree->SetSynced (true);
+		tree->SetSync (false);
 	}
 	else if (state == MASTER_RETIRED)
 	{
-		tree->reRoot = false;
+		tree->SetReRoot (false);
 	}
 	else if (state == MASTER_FORWARD)
 	{
 		tree->forward = true;
-		tree->fdWhile = 0;
-		tree->agreed = port->sendRSTP;
+		tree->SetFdWhile (0);
+		tree->SetAgreed (port->sendRSTP);
 	}
 	else if (state == MASTER_LEARN)
 	{
 		tree->learn = true;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->SetFdWhile (forwardDelay (bridge, givenPort));
 	}
 	else if (state == MASTER_DISCARD)
 	{
 		tree->learn = tree->forward = tree->disputed = false;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->SetFdWhile (forwardDelay (bridge, givenPort));
 	}
 
 	// ------------------------------------------------------------------------
@@ -456,7 +459,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 		STP_PORT_ROLE oldRole = tree->role;
 
 		tree->role = STP_PORT_ROLE_ROOT;
-		tree->rrWhile = FwdDelay (bridge, givenPort);
+		tree->SetRrWhile (FwdDelay (bridge, givenPort));
 
 		if ((oldRole != STP_PORT_ROLE_ROOT) && (bridge->callbacks.onPortRoleChanged != NULL))
 			bridge->callbacks.onPortRoleChanged (bridge, givenPort, givenTree, STP_PORT_ROLE_ROOT, timestamp);
@@ -468,8 +471,9 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	}
 	else if (state == ROOT_AGREED)
 	{
-		tree->proposed = tree->sync = false;
-		tree->agree = true;
+		tree->proposed = false;
+		tree->SetSync (false);
+		tree->SetAgree (true);
 		if (givenTree == CIST_INDEX)
 			port->newInfo = true;
 		else
@@ -477,8 +481,8 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	}
 	else if (state == ROOT_SYNCED)
 	{
-		tree->synced = true;
-		tree->sync = false;
+		tree->SetSynced (true);
+		tree->SetSync (false);
 	}
 	else if (state == REROOT)
 	{
@@ -486,24 +490,24 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	}
 	else if (state == ROOT_FORWARD)
 	{
-		tree->fdWhile = 0;
+		tree->SetFdWhile (0);
 		tree->forward = true;
 	}
 	else if (state == ROOT_LEARN)
 	{
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->SetFdWhile (forwardDelay (bridge, givenPort));
 		tree->learn = true;
 	}
 	else if (state == REROOTED)
 	{
-		tree->reRoot = false;
+		tree->SetReRoot (false);
 	}
 	else if (state == ROOT_DISCARD)
 	{
 		if (tree->disputed)
-			tree->rbWhile = 3 * HelloTime (bridge, givenPort);
+			tree->SetRbWhile (3 * HelloTime (bridge, givenPort));
 		tree->learn = tree->forward = tree->disputed = false;
-		tree->fdWhile = FwdDelay (bridge, givenPort);
+		tree->SetFdWhile (FwdDelay (bridge, givenPort));
 	}
 
 	// ------------------------------------------------------------------------
@@ -523,8 +527,8 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	else if (state == DESIGNATED_FORWARD)
 	{
 		tree->forward = true;
-		tree->fdWhile = 0;
-		tree->agreed = port->sendRSTP;
+		tree->SetFdWhile (0);
+		tree->SetAgreed (port->sendRSTP);
 	}
 	else if (state == DESIGNATED_PROPOSE)
 	{
@@ -542,12 +546,13 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	else if (state == DESIGNATED_LEARN)
 	{
 		tree->learn = true;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->SetFdWhile (forwardDelay (bridge, givenPort));
 	}
 	else if (state == DESIGNATED_AGREE)
 	{
-		tree->proposed = tree->sync = false;
-		tree->agree = true;
+		tree->proposed = false;
+		tree->SetSync (false);
+		tree->SetAgree (true);
 		if (givenTree == CIST_INDEX)
 			port->newInfo = true;
 		else
@@ -556,17 +561,17 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	else if (state == DESIGNATED_DISCARD)
 	{
 		tree->learn = tree->forward = tree->disputed = false;
-		tree->fdWhile = forwardDelay (bridge, givenPort);
+		tree->SetFdWhile (forwardDelay (bridge, givenPort));
 	}
 	else if (state == DESIGNATED_SYNCED)
 	{
-		tree->rrWhile = 0;
-		tree->synced = true;
-		tree->sync = false;
+		tree->SetRrWhile (0);
+		tree->SetSynced (true);
+		tree->SetSync (false);
 	}
 	else if (state == DESIGNATED_RETIRED)
 	{
-		tree->reRoot = false;
+		tree->SetReRoot (false);
 	}
 
 	// ------------------------------------------------------------------------
@@ -574,14 +579,15 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 
 	else if (state == ALTERNATE_PORT)
 	{
-		tree->fdWhile = forwardDelay (bridge, givenPort);
-		tree->synced = true;
-		tree->rrWhile = 0;
-		tree->sync = tree->reRoot = false;
+		tree->SetFdWhile (forwardDelay (bridge, givenPort));
+		tree->SetSynced (true);
+		tree->SetRrWhile (0);
+		tree->SetSync (false);
+		tree->SetReRoot (false);
 	}
 	else if (state == BACKUP_PORT)
 	{
-		tree->rbWhile = 2 * HelloTime (bridge, givenPort);
+		tree->SetRbWhile (2 * HelloTime (bridge, givenPort));
 	}
 	else if (state == ALTERNATE_PROPOSED)
 	{
@@ -591,7 +597,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 	else if (state == ALTERNATE_AGREED)
 	{
 		tree->proposed = false;
-		tree->agree = true;
+		tree->SetAgree (true);
 		if (givenTree == CIST_INDEX)
 			port->newInfo = true;
 		else
@@ -616,6 +622,9 @@ const StateMachine<PortRoleTransitions::State, PortAndTree> PortRoleTransitions:
 #if STP_USE_LOG
 	"PortRoleTransitions",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS,
 #endif
 	&CheckConditions,
 	&InitState
@@ -118,6 +118,9 @@ const StateMachine<PortStateTransition::State, PortAndTree> PortStateTransition:
 #if STP_USE_LOG
 	"PortStateTransition",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_STATE_TRANSITION,
 #endif
 	&CheckConditions,
 	&InitState
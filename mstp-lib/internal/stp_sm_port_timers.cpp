@@ -5,6 +5,7 @@
 // This file implements 13.30 from 802.1Q-2018.
 
 #include "stp_procedures.h"
+#include "stp_conditions_and_params.h"
 #include "stp_bridge.h"
 #include <assert.h>
 
@@ -63,6 +64,59 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortIndex givenPort, Sta
 
 // ============================================================================
 
+// The start values of the timers, as compared by the state machine conditions.
+struct START_VALUES
+{
+	unsigned int maxAge;
+	unsigned int forwardDelay;
+	unsigned int fwdDelay;
+	unsigned int twiceHelloTime;
+
+	START_VALUES (const STP_BRIDGE* bridge, PortIndex givenPort)
+		: maxAge(MaxAge (bridge, givenPort))
+		, forwardDelay(::forwardDelay (bridge, givenPort))
+		, fwdDelay(FwdDelay (bridge, givenPort))
+		, twiceHelloTime(2 * HelloTime (bridge, givenPort))
+	{ }
+};
+
+// Returns whether the timer, about to be decremented, reaches zero or leaves one of the given start values.
+static unsigned int IsTimerEvent (unsigned int timer, unsigned int startValue1, unsigned int startValue2)
+{
+	return (timer != 0) & ((timer == 1) | (timer == startValue1) | (timer == startValue2));
+}
+
+// Decrements down to zero the first count (at most 32) timers of an array. Returns a mask with the bits of the
+// timers that reached zero, and sets in leftStartValueMask the bits of those that left one of the two given
+// start values (zero meaning none). Most ticks change nothing, so the masks are built only after a first loop
+// finds that some timer needs them. That loop and the decrementing one have no branches and no dependencies
+// between iterations, so that compilers can vectorize them.
+static unsigned int DecrementTimers (unsigned short* timers, unsigned int count, unsigned int startValue1, unsigned int startValue2, unsigned int& leftStartValueMask)
+{
+	unsigned int anyEvent = 0;
+	for (unsigned int i = 0; i < count; i++)
+		anyEvent |= IsTimerEvent (timers[i], startValue1, startValue2);
+
+	unsigned int reachedZero = 0;
+	if (anyEvent)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (timers[i] == 1)
+				reachedZero |= (1u << i);
+			else if (IsTimerEvent (timers[i], startValue1, startValue2))
+				leftStartValueMask |= (1u << i);
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		timers[i] = (unsigned short) (timers[i] - (timers[i] != 0));
+
+	return reachedZero;
+}
+
+// ============================================================================
+
 static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, unsigned int timestamp)
 {
 	PORT* port = bridge->ports[givenPort];
@@ -73,31 +127,237 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 	}
 	else if (state == TICK)
 	{
+		// Besides decrementing the timers, we must mark dirty the state machines for which a condition might
+		// have changed as a result (see RunStateMachines). The conditions compare timers either with zero, or
+		// with the value they were started with (for instance "fdWhile != forwardDelay"), so we mark the state
+		// machines when a timer reaches zero or when it leaves one of those start values.
+		// GetQuietTickCount below must be kept in sync with these checks.
+		bool portDirty = (port->helloWhen == 1) || (port->mDelayWhile == 1) || (port->edgeDelayWhile == 1) || (port->pseudoInfoHelloWhen == 1)
+			|| (port->mDelayWhile == bridge->MigrateTime) || (port->edgeDelayWhile == bridge->MigrateTime)
+			|| (port->txCount == bridge->TxHoldCount);
+
 		if (port->helloWhen      > 0) port->helloWhen--;
 		if (port->mDelayWhile    > 0) port->mDelayWhile--;
 		if (port->edgeDelayWhile > 0) port->edgeDelayWhile--;
 		if (port->txCount        > 0) port->txCount--;
 		if (port->pseudoInfoHelloWhen > 0) port->pseudoInfoHelloWhen--;
 
-		for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+		if (portDirty)
+			bridge->MarkPortDirty (givenPort);
+
+		START_VALUES sv (bridge, givenPort);
+
+		// The per-tree timers are decremented one array at a time, for up to 32 trees at once (see TREE_TIMER).
+		for (unsigned int firstTree = 0; firstTree < bridge->treeCount(); firstTree += 32)
+		{
+			unsigned int count = bridge->treeCount() - firstTree;
+			if (count > 32)
+				count = 32;
+
+			unsigned int reachedZero = 0;
+			unsigned int leftStartValue = 0;
+			reachedZero |= DecrementTimers (bridge->GetTreeTimerArray (givenPort, TREE_TIMER_FD_WHILE) + firstTree, count, sv.maxAge, sv.forwardDelay, leftStartValue);
+			unsigned int rrWhileReachedZero = DecrementTimers (bridge->GetTreeTimerArray (givenPort, TREE_TIMER_RR_WHILE) + firstTree, count, sv.fwdDelay, sv.fwdDelay, leftStartValue);
+			reachedZero |= rrWhileReachedZero;
+			reachedZero |= DecrementTimers (bridge->GetTreeTimerArray (givenPort, TREE_TIMER_RB_WHILE) + firstTree, count, sv.twiceHelloTime, sv.twiceHelloTime, leftStartValue);
+			reachedZero |= DecrementTimers (bridge->GetTreeTimerArray (givenPort, TREE_TIMER_TC_WHILE) + firstTree, count, 0, 0, leftStartValue);
+			reachedZero |= DecrementTimers (bridge->GetTreeTimerArray (givenPort, TREE_TIMER_RCVD_INFO_WHILE) + firstTree, count, 0, 0, leftStartValue);
+			reachedZero |= DecrementTimers (bridge->GetTreeTimerArray (givenPort, TREE_TIMER_TC_DETECTED) + firstTree, count, 0, 0, leftStartValue);
+
+			unsigned int dirtyTrees = reachedZero | leftStartValue;
+			for (unsigned int bitIndex = 0; dirtyTrees != 0; bitIndex++, dirtyTrees >>= 1, rrWhileReachedZero >>= 1)
+			{
+				// reRooted reads rrWhile of all ports.
+				if (rrWhileReachedZero & 1)
+					bridge->MarkTreeRoleTransitionsDirty (firstTree + bitIndex);
+
+				if (dirtyTrees & 1)
+					bridge->MarkPortTreeDirty (givenPort, firstTree + bitIndex);
+			}
+		}
+	}
+}
+
+// ============================================================================
+
+// Returns how many ticks decrement the timer before the tick that finds it at the given value.
+static unsigned int TicksBeforeValue (unsigned int timer, unsigned int value)
+{
+	if ((value == 0) || (value > timer))
+		return 0xFFFFFFFF;
+
+	return timer - value;
+}
+
+static void Min (unsigned int& a, unsigned int b)
+{
+	if (b < a)
+		a = b;
+}
+
+enum
+{
+	HELD_FD_WHILE = 1,
+	HELD_RR_WHILE = 2,
+	HELD_RB_WHILE = 4,
+};
+
+// In some states the Port Role Transitions state machine re-enters the state as soon as a timer leaves its
+// start value, and the state's entry block restarts the timer (for example rrWhile in ROOT_PORT). A tick
+// that only does this leaves everything as it was, so we count it as quiet and hold the timer at its value.
+static unsigned int GetHeldTimers (const PORT_TREE* portTree, const START_VALUES& sv)
+{
+	if (!portTree->GetSelected() || portTree->GetUpdtInfo())
+		return 0;
+
+	switch (portTree->portRoleTransitionsState)
+	{
+		case PortRoleTransitions::ROOT_PORT:
+			return (portTree->GetRrWhile() == sv.fwdDelay) ? HELD_RR_WHILE : 0;
+
+		case PortRoleTransitions::DISABLED_PORT:
+			return (portTree->GetFdWhile() == sv.maxAge) ? HELD_FD_WHILE : 0;
+
+		case PortRoleTransitions::ALTERNATE_PORT:
+		{
+			unsigned int res = 0;
+			if (portTree->GetFdWhile() == sv.forwardDelay)
+				res |= HELD_FD_WHILE;
+
+			if ((portTree->role == STP_PORT_ROLE_BACKUP) && (portTree->GetRbWhile() == sv.twiceHelloTime))
+				res |= HELD_RB_WHILE;
+
+			return res;
+		}
+
+		default:
+			return 0;
+	}
+}
+
+// Same as above, for the Port Protocol Migration state machine, which on a disabled port holds mDelayWhile
+// at MigrateTime by re-entering CHECKING_RSTP.
+static bool IsMDelayWhileHeld (const STP_BRIDGE* bridge, const PORT* port)
+{
+	return (port->portProtocolMigrationState == PortProtocolMigration::CHECKING_RSTP)
+		&& !port->portEnabled && (port->mDelayWhile == bridge->MigrateTime)
+		&& !port->mcheck && (port->sendRSTP == rstpVersion (bridge));
+}
+
+unsigned int PortTimers::GetQuietTickCount (const STP_BRIDGE* bridge, PortIndex givenPort)
+{
+	const PORT* port = bridge->ports[givenPort];
+
+	unsigned int res = 0xFFFFFFFF;
+	Min (res, TicksBeforeValue (port->helloWhen, 1));
+	Min (res, TicksBeforeValue (port->edgeDelayWhile, 1));
+	Min (res, TicksBeforeValue (port->pseudoInfoHelloWhen, 1));
+	Min (res, TicksBeforeValue (port->txCount, bridge->TxHoldCount));
+
+	if (!IsMDelayWhileHeld (bridge, port))
+	{
+		Min (res, TicksBeforeValue (port->mDelayWhile, 1));
+
+		// Only the conditions for disabled ports compare mDelayWhile with MigrateTime.
+		if (!port->portEnabled)
+			Min (res, TicksBeforeValue (port->mDelayWhile, bridge->MigrateTime));
+	}
+
+	// Only the global condition of the Port Receive state machine compares edgeDelayWhile with MigrateTime,
+	// on disabled ports, and it has no effect in the DISCARD state.
+	if (!port->portEnabled && (port->portReceiveState != PortReceive::DISCARD))
+		Min (res, TicksBeforeValue (port->edgeDelayWhile, bridge->MigrateTime));
+
+	START_VALUES sv (bridge, givenPort);
+
+	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+	{
+		const PORT_TREE* portTree = port->trees [treeIndex];
+		unsigned int held = GetHeldTimers (portTree, sv);
+
+		Min (res, TicksBeforeValue (portTree->GetTcWhile(), 1));
+		Min (res, TicksBeforeValue (portTree->GetRcvdInfoWhile(), 1));
+		Min (res, TicksBeforeValue (portTree->GetTcDetected(), 1));
+
+		if ((held & HELD_FD_WHILE) == 0)
+		{
+			Min (res, TicksBeforeValue (portTree->GetFdWhile(), 1));
+			Min (res, TicksBeforeValue (portTree->GetFdWhile(), sv.maxAge));
+			Min (res, TicksBeforeValue (portTree->GetFdWhile(), sv.forwardDelay));
+		}
+
+		if ((held & HELD_RR_WHILE) == 0)
+		{
+			Min (res, TicksBeforeValue (portTree->GetRrWhile(), 1));
+			Min (res, TicksBeforeValue (portTree->GetRrWhile(), sv.fwdDelay));
+		}
+
+		if ((held & HELD_RB_WHILE) == 0)
 		{
-			PORT_TREE* portTree = port->trees [treeIndex];
-
-			if (portTree->tcWhile       > 0) portTree->tcWhile--;
-			if (portTree->fdWhile       > 0) portTree->fdWhile--;
-			if (portTree->rcvdInfoWhile > 0) portTree->rcvdInfoWhile--;
-			if (portTree->rrWhile       > 0) portTree->rrWhile--;
-			if (portTree->tcDetected    > 0) portTree->tcDetected--;
-			if (portTree->rbWhile       > 0) portTree->rbWhile--;
+			Min (res, TicksBeforeValue (portTree->GetRbWhile(), 1));
+			Min (res, TicksBeforeValue (portTree->GetRbWhile(), sv.twiceHelloTime));
 		}
 	}
+
+	return res;
 }
 
+static void Decrement (unsigned short& timer, unsigned int tickCount)
+{
+	timer = (timer > tickCount) ? (unsigned short)(timer - tickCount) : 0;
+}
+
+static void Decrement (PORT_TREE* portTree, TREE_TIMER timer, unsigned int tickCount)
+{
+	unsigned int value = portTree->GetTimer (timer);
+	portTree->SetTimer (timer, (value > tickCount) ? (value - tickCount) : 0);
+}
+
+void PortTimers::SkipQuietTicks (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int tickCount)
+{
+	PORT* port = bridge->ports[givenPort];
+	assert (tickCount <= GetQuietTickCount (bridge, givenPort));
+
+	if (!IsMDelayWhileHeld (bridge, port))
+		Decrement (port->mDelayWhile, tickCount);
+
+	Decrement (port->helloWhen, tickCount);
+	Decrement (port->edgeDelayWhile, tickCount);
+	Decrement (port->txCount, tickCount);
+	Decrement (port->pseudoInfoHelloWhen, tickCount);
+
+	START_VALUES sv (bridge, givenPort);
+
+	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+	{
+		PORT_TREE* portTree = port->trees [treeIndex];
+		unsigned int held = GetHeldTimers (portTree, sv);
+
+		Decrement (portTree, TREE_TIMER_TC_WHILE, tickCount);
+		Decrement (portTree, TREE_TIMER_RCVD_INFO_WHILE, tickCount);
+		Decrement (portTree, TREE_TIMER_TC_DETECTED, tickCount);
+
+		if ((held & HELD_FD_WHILE) == 0)
+			Decrement (portTree, TREE_TIMER_FD_WHILE, tickCount);
+
+		if ((held & HELD_RR_WHILE) == 0)
+			Decrement (portTree, TREE_TIMER_RR_WHILE, tickCount);
+
+		if ((held & HELD_RB_WHILE) == 0)
+			Decrement (portTree, TREE_TIMER_RB_WHILE, tickCount);
+	}
+}
+
+// ============================================================================
+
 const StateMachine<State, PortIndex> PortTimers::sm =
 {
 #if STP_USE_LOG
 	"PortTimers",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_TIMERS,
 #endif
 	&CheckConditions,
 	&InitState
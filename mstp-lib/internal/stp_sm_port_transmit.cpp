@@ -99,6 +99,23 @@ static State CheckConditions (const STP_BRIDGE* bridge, PortIndex givenPort, Sta
 
 // ============================================================================
 
+// Not in the standard. With hello staggering enabled (see STP_SetHelloStaggering), the periodic transmissions of a
+// port happen in the ticks whose number modulo HelloTime is the slot of the port, so helloWhen is started with the
+// number of ticks until the next such tick. This is HelloTime in steady state, and less than HelloTime only after a
+// transmission triggered by newInfo, so the time between two transmissions never exceeds HelloTime.
+static unsigned int GetHelloWhenStartValue (const STP_BRIDGE* bridge, PortIndex givenPort)
+{
+	unsigned int helloTime = HelloTime (bridge, givenPort);
+	if (!bridge->helloStaggering || (helloTime == 0))
+		return helloTime;
+
+	unsigned int slot = (givenPort + bridge->helloStaggeringPhase) % helloTime;
+	unsigned int res = (slot + helloTime - bridge->tickCounter % helloTime) % helloTime;
+	return (res == 0) ? helloTime : res;
+}
+
+// ============================================================================
+
 static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, unsigned int timestamp)
 {
 	PORT* port = bridge->ports[givenPort];
@@ -111,7 +128,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 	else if (state == TRANSMIT_PERIODIC)
 	{
 		// Note AG: Not clear in the standard: tcWhile of which tree? I'll assume they meant "CIST's tcWhile", since the whole expression is about the CIST.
-		port->newInfo = port->newInfo || (cistDesignatedPort (bridge, givenPort) || (cistRootPort (bridge, givenPort) && (port->trees[CIST_INDEX]->tcWhile != 0)));
+		port->newInfo = port->newInfo || (cistDesignatedPort (bridge, givenPort) || (cistRootPort (bridge, givenPort) && (port->trees[CIST_INDEX]->GetTcWhile() != 0)));
 
 		port->newInfoMsti = port->newInfoMsti || mstiDesignatedOrTCpropagatingRootPort (bridge, givenPort);
 	}
@@ -141,7 +158,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 	}
 	else if (state == IDLE)
 	{
-		port->helloWhen = HelloTime (bridge, givenPort);
+		port->helloWhen = GetHelloWhenStartValue (bridge, givenPort);
 	}
 	else
 		assert (false);
@@ -152,6 +169,9 @@ const StateMachine<PortTransmit::State, PortIndex> PortTransmit::sm =
 #if STP_USE_LOG
 	"PortTransmit",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_PORT_TRANSMIT,
 #endif
 	&CheckConditions,
 	&InitState
@@ -70,7 +70,7 @@ static TopologyChange::State CheckConditions (const STP_BRIDGE* bridge, PortAndT
 		if (portTree->rcvdTc)
 			return NOTIFIED_TC;
 
-		if (portTree->tcProp && !port->operEdge)
+		if (portTree->GetTcProp() && !port->operEdge)
 			return PROPAGATING;
 
 		if (port->rcvdTcAck)
@@ -92,10 +92,10 @@ static TopologyChange::State CheckConditions (const STP_BRIDGE* bridge, PortAndT
 		if (((portTree->role == STP_PORT_ROLE_ROOT) || (portTree->role == STP_PORT_ROLE_DESIGNATED) || (portTree->role == STP_PORT_ROLE_MASTER)) && portTree->forward && !port->operEdge)
 			return DETECTED;
 
-		if ((portTree->role != STP_PORT_ROLE_ROOT) && (portTree->role != STP_PORT_ROLE_DESIGNATED) && (portTree->role != STP_PORT_ROLE_MASTER) && !(portTree->learn || portTree->learning) && !(portTree->rcvdTc || port->rcvdTcn || port->rcvdTcAck || portTree->tcProp))
+		if ((portTree->role != STP_PORT_ROLE_ROOT) && (portTree->role != STP_PORT_ROLE_DESIGNATED) && (portTree->role != STP_PORT_ROLE_MASTER) && !(portTree->learn || portTree->learning) && !(portTree->rcvdTc || port->rcvdTcn || port->rcvdTcAck || portTree->GetTcProp()))
 			return INACTIVE;
 
-		if (portTree->rcvdTc || port->rcvdTcn || port->rcvdTcAck || portTree->tcProp)
+		if (portTree->rcvdTc || port->rcvdTcn || port->rcvdTcAck || portTree->GetTcProp())
 			return LEARNING;
 
 		return (TopologyChange::State) 0;
@@ -156,11 +156,12 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, TopologyChange::State
 		{
 			FLUSH_LOG (bridge);
 
+			COUNT_STATISTIC (bridge->trees [givenTree]->statistics.fdbFlushes);
 			bridge->callbacks.flushFdb (bridge, givenPort, givenTree, rstpVersion (bridge) ? STP_FLUSH_FDB_TYPE_IMMEDIATE : STP_FLUSH_FDB_TYPE_RAPID_AGEING, timestamp);
 		}
 
-		portTree->tcDetected = 0;
-		portTree->tcWhile = 0;
+		portTree->SetTcDetected (0);
+		portTree->SetTcWhile (0);
 		if (givenTree == CIST_INDEX)
 			port->tcAck = false;
 	}
@@ -169,7 +170,8 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, TopologyChange::State
 		if (givenTree == CIST_INDEX)
 			portTree->rcvdTc = port->rcvdTcn = port->rcvdTcAck = false;
 
-		portTree->rcvdTc = portTree->tcProp = false;
+		portTree->rcvdTc = false;
+		portTree->SetTcProp (false);
 	}
 	else if (state == DETECTED)
 	{
@@ -204,14 +206,15 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, TopologyChange::State
 		{
 			FLUSH_LOG (bridge);
 
+			COUNT_STATISTIC (bridge->trees [givenTree]->statistics.fdbFlushes);
 			bridge->callbacks.flushFdb (bridge, givenPort, givenTree, rstpVersion (bridge) ? STP_FLUSH_FDB_TYPE_IMMEDIATE : STP_FLUSH_FDB_TYPE_RAPID_AGEING, timestamp);
 		}
 
-		portTree->tcProp = false;
+		portTree->SetTcProp (false);
 	}
 	else if (state == ACKNOWLEDGED)
 	{
-		portTree->tcWhile = 0;
+		portTree->SetTcWhile (0);
 		port->rcvdTcAck = false;
 	}
 	else
@@ -223,6 +226,9 @@ const StateMachine<TopologyChange::State, PortAndTree> TopologyChange::sm =
 #if STP_USE_LOG
 	"TopologyChange",
 	&GetStateName,
+#endif
+#if STP_USE_STATISTICS
+	STP_STATE_MACHINE_TOPOLOGY_CHANGE,
 #endif
 	&CheckConditions,
 	&InitState
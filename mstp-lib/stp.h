@@ -16,6 +16,24 @@
 	#define STP_USE_LOG 1
 #endif
 
+// Define STP_USE_STATISTICS=0 in the compiler options to leave out the counters returned by STP_GetStatistics
+// and the related functions. The functions are still there, and return zeroes.
+#ifndef STP_USE_STATISTICS
+	#define STP_USE_STATISTICS 1
+#endif
+
+// Define STP_USE_TRANSMIT_BATCH=0 in the compiler options to leave out support for the transmitBatch callback,
+// together with the memory where the batched BPDUs are built (see STP_BRIDGE_MEMORY_SIZE). The transmitBatch
+// member of STP_CALLBACKS must then be NULL.
+#ifndef STP_USE_TRANSMIT_BATCH
+	#define STP_USE_TRANSMIT_BATCH 1
+#endif
+
+// When the port count and the MSTI count of the device are known at build time, define STP_FIXED_PORT_COUNT
+// and STP_FIXED_MSTI_COUNT to them in the compiler options (for instance STP_FIXED_PORT_COUNT=5 and STP_FIXED_MSTI_COUNT=0).
+// The library then loops over the ports and trees with compile-time bounds, and STP_CreateBridge asserts that
+// it is called with these same values. See also stp_fixed_bridge.h.
+
 struct STP_BRIDGE;
 
 enum STP_FLUSH_FDB_TYPE
@@ -47,6 +65,17 @@ typedef void  (*STP_CALLBACK_PORT_ROLE_CHANGED)             (const struct STP_BR
 typedef void* (*STP_CALLBACK_ALLOC_AND_ZERO_MEMORY) (unsigned int size);
 typedef void  (*STP_CALLBACK_FREE_MEMORY) (void* p);
 
+// One BPDU handed to the transmitBatch callback. bpdu points into memory owned by the library,
+// valid until the callback returns.
+struct STP_TRANSMIT_BATCH_ENTRY
+{
+	unsigned int portIndex;
+	const unsigned char* bpdu;
+	unsigned int bpduSize;
+};
+
+typedef void  (*STP_CALLBACK_TRANSMIT_BATCH)                (const struct STP_BRIDGE* bridge, const struct STP_TRANSMIT_BATCH_ENTRY* entries, unsigned int entryCount, unsigned int timestamp);
+
 struct STP_CALLBACKS
 {
 	STP_CALLBACK_ENABLE_BPDU_TRAPPING        enableBpduTrapping;
@@ -60,6 +89,11 @@ struct STP_CALLBACKS
 	STP_CALLBACK_PORT_ROLE_CHANGED           onPortRoleChanged;
 	STP_CALLBACK_ALLOC_AND_ZERO_MEMORY       allocAndZeroMemory;
 	STP_CALLBACK_FREE_MEMORY                 freeMemory;
+
+	// Optional. When not NULL, the BPDUs are not transmitted through transmitGetBuffer and transmitReleaseBuffer,
+	// but collected while the state machines run and handed to this callback all at once. Must be NULL if the
+	// library was compiled with STP_USE_TRANSMIT_BATCH=0.
+	STP_CALLBACK_TRANSMIT_BATCH              transmitBatch;
 };
 
 // 11.3 Point-to-point parameters in 802.1AC-2016 (values correspond to ieee8021BridgeBasePortAdminPointToPoint)
@@ -103,6 +137,56 @@ struct STP_BRIDGE_ADDRESS
 	#endif
 };
 
+// Size of the memory block that STP_CreateBridge allocates (the same as returned by STP_GetBridgeMemorySize),
+// written as a constant expression so that it can size a static array (see stp_fixed_bridge.h).
+// The internal structures of the library are not visible here, so the block reserves for each of them a size
+// written in pointers and bytes; stp.cpp checks at compile time that each structure fits in its reservation.
+#define STP_ALIGN_MEMORY_SIZE(size) (((size) + 7) & ~7u)
+
+#define STP_RESERVED_BRIDGE_SIZE    (27 * sizeof (void*) + 144 + (STP_USE_LOG ? 4 * sizeof (void*) + 64 : 0) + (STP_USE_STATISTICS ? 56 : 0))
+#define STP_RESERVED_TREE_SIZE      (2 * sizeof (void*) + 104 + (STP_USE_STATISTICS ? 104 : 0))
+#define STP_RESERVED_PORT_SIZE      (7 * sizeof (void*) + 96 + (STP_USE_STATISTICS ? 44 : 0))
+#define STP_RESERVED_PORT_TREE_SIZE (5 * sizeof (void*) + 184)
+#define STP_RESERVED_PORT_FLAG_COUNT  9
+#define STP_RESERVED_TREE_TIMER_COUNT 6
+#define STP_RESERVED_BPDU_SIZE(mstiCount) (102 + (mstiCount) * 16)
+
+#define STP_PORT_MEMORY_SIZE(mstiCount) \
+	(STP_ALIGN_MEMORY_SIZE (STP_RESERVED_PORT_SIZE) \
+	+ STP_ALIGN_MEMORY_SIZE ((1 + (mstiCount)) * sizeof (void*)) \
+	+ (1 + (mstiCount)) * STP_ALIGN_MEMORY_SIZE (STP_RESERVED_PORT_TREE_SIZE) \
+	+ STP_ALIGN_MEMORY_SIZE (STP_RESERVED_TREE_TIMER_COUNT * (1 + (mstiCount)) * sizeof (unsigned short)) \
+	+ 2 * STP_ALIGN_MEMORY_SIZE (STP_RESERVED_BPDU_SIZE (mstiCount)))
+
+#if STP_USE_LOG
+	#define STP_LOG_MEMORY_SIZE(debugLogBufferSize) STP_ALIGN_MEMORY_SIZE (debugLogBufferSize)
+#else
+	#define STP_LOG_MEMORY_SIZE(debugLogBufferSize) 0
+#endif
+
+// The batch has one entry and one maximum-size BPDU for each port, so it costs portCount * (118 + 16 * mstiCount)
+// bytes or more, whether or not the application sets the transmitBatch callback. STP_USE_TRANSMIT_BATCH=0 saves them.
+#if STP_USE_TRANSMIT_BATCH
+	#define STP_TRANSMIT_BATCH_MEMORY_SIZE(portCount, mstiCount) \
+		(STP_ALIGN_MEMORY_SIZE ((portCount) * sizeof (struct STP_TRANSMIT_BATCH_ENTRY)) \
+		+ STP_ALIGN_MEMORY_SIZE ((portCount) * STP_RESERVED_BPDU_SIZE (mstiCount)))
+#else
+	#define STP_TRANSMIT_BATCH_MEMORY_SIZE(portCount, mstiCount) 0
+#endif
+
+#define STP_BRIDGE_MEMORY_SIZE(portCount, mstiCount, maxVlanNumber, debugLogBufferSize) \
+	(STP_ALIGN_MEMORY_SIZE (STP_RESERVED_BRIDGE_SIZE) \
+	+ STP_ALIGN_MEMORY_SIZE ((1 + (mstiCount)) * sizeof (void*)) \
+	+ STP_ALIGN_MEMORY_SIZE ((portCount) * sizeof (void*)) \
+	+ STP_ALIGN_MEMORY_SIZE (2 * (((portCount) + 31) / 32) * sizeof (unsigned int)) \
+	+ (1 + (mstiCount)) * STP_ALIGN_MEMORY_SIZE (STP_RESERVED_TREE_SIZE) \
+	+ STP_ALIGN_MEMORY_SIZE ((1 + (mstiCount)) * STP_RESERVED_PORT_FLAG_COUNT * (((portCount) + 31) / 32) * sizeof (unsigned int)) \
+	+ (portCount) * STP_PORT_MEMORY_SIZE (mstiCount) \
+	+ STP_TRANSMIT_BATCH_MEMORY_SIZE (portCount, mstiCount) \
+	+ STP_ALIGN_MEMORY_SIZE ((1 + (maxVlanNumber)) * 2) \
+	+ ((2 * (1 + (maxVlanNumber)) + 63) / 64) * 4 * sizeof (unsigned int) \
+	+ STP_LOG_MEMORY_SIZE (debugLogBufferSize))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -114,14 +198,53 @@ struct STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
                                      const unsigned char bridgeAddress[6],
                                      unsigned int debugLogBufferSize);
 void STP_DestroyBridge (struct STP_BRIDGE* bridge);
+unsigned int STP_GetBridgeMemorySize (unsigned int portCount,
+                                      unsigned int mstiCount,
+                                      unsigned int maxVlanNumber,
+                                      unsigned int debugLogBufferSize);
 
 void STP_StartBridge (struct STP_BRIDGE* bridge, unsigned int timestamp);
 void STP_StopBridge (struct STP_BRIDGE* bridge, unsigned int timestamp);
 bool STP_IsBridgeStarted (const struct STP_BRIDGE* bridge);
 
+void STP_BeginConfigTransaction (struct STP_BRIDGE* bridge, unsigned int timestamp);
+void STP_CommitConfigTransaction (struct STP_BRIDGE* bridge, unsigned int timestamp);
+bool STP_IsConfigTransactionActive (const struct STP_BRIDGE* bridge);
+
 void STP_EnableLogging (struct STP_BRIDGE* bridge, bool enable);
 bool STP_IsLoggingEnabled (const struct STP_BRIDGE* bridge);
 
+// Categories of debug log output that can be turned off individually, see STP_SetLogCategories.
+enum STP_LOG_CATEGORY
+{
+	STP_LOG_CATEGORY_TRANSITIONS      = 1, // state machine transitions
+	STP_LOG_CATEGORY_RX_BPDU_DUMP     = 2, // contents of received BPDUs
+	STP_LOG_CATEGORY_TX_BPDU_DUMP     = 4, // transmitted BPDUs and their contents
+	STP_LOG_CATEGORY_ROLE_COMPUTATION = 8, // priority vectors compared and roles selected by the Port Role Selection state machine
+	STP_LOG_CATEGORY_ALL              = 15,
+};
+
+void STP_SetLogCategories (struct STP_BRIDGE* bridge, unsigned int categories);
+unsigned int STP_GetLogCategories (const struct STP_BRIDGE* bridge);
+void STP_EnablePortLogging (struct STP_BRIDGE* bridge, unsigned int portIndex, bool enable);
+void STP_EnableTreeLogging (struct STP_BRIDGE* bridge, unsigned int treeIndex, bool enable);
+
+// Binary trace of the debug log, see STP_StartTrace. Entries are multiples of STP_TRACE_RECORD_SIZE bytes
+// and never larger than STP_TRACE_MAX_ENTRY_SIZE.
+#define STP_TRACE_RECORD_SIZE    32
+#define STP_TRACE_MAX_ENTRY_SIZE 256
+void STP_StartTrace (struct STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize);
+void STP_StopTrace (struct STP_BRIDGE* bridge);
+bool STP_IsTraceActive (const struct STP_BRIDGE* bridge);
+unsigned int STP_ReadTrace (struct STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize, unsigned int* lostEntryCountOutOrNull);
+void STP_DecodeTrace (struct STP_BRIDGE* bridge, const void* trace, unsigned int traceSize);
+
+// Deferred delivery of the debug log, see STP_EnableDeferredLog.
+void STP_EnableDeferredLog (struct STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize);
+void STP_DisableDeferredLog (struct STP_BRIDGE* bridge);
+bool STP_IsLogDeferred (const struct STP_BRIDGE* bridge);
+unsigned int STP_DrainLog (struct STP_BRIDGE* bridge, unsigned int maxSize, unsigned int* lostSizeOutOrNull);
+
 unsigned int STP_GetPortCount (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetMstiCount (const struct STP_BRIDGE* bridge);
 
@@ -132,6 +255,30 @@ void STP_SetStpVersion (struct STP_BRIDGE* bridge, enum STP_VERSION version, uns
 // Call this when you receive a BPDU.
 void STP_OnBpduReceived (struct STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp);
 
+// Alternative to calling STP_OnBpduReceived for each of several BPDUs received at about the same time.
+// See the documentation of STP_OnBpdusReceived.
+struct STP_RECEIVED_BPDU
+{
+	unsigned int portIndex;
+	const unsigned char* bpdu;
+	unsigned int bpduSize;
+	unsigned int timestamp;
+};
+void STP_OnBpdusReceived (struct STP_BRIDGE* bridge, const struct STP_RECEIVED_BPDU* bpdus, unsigned int bpduCount);
+
+// Alternatives to stripping the Ethernet and LLC headers yourself before calling STP_OnBpduReceived.
+// See the documentation of STP_GetBpduFromFrame.
+enum STP_FRAME_TAG_FORMAT
+{
+	STP_FRAME_TAG_FORMAT_NONE, // optional 802.1Q / 802.1ad tags only
+	STP_FRAME_TAG_FORMAT_DSA,  // Marvell DSA tag (4 bytes) after the source address
+	STP_FRAME_TAG_FORMAT_EDSA, // Marvell EtherType DSA tag (8 bytes) after the source address
+};
+const unsigned char* STP_GetBpduFromFrame (const unsigned char* frame, unsigned int frameSize, enum STP_FRAME_TAG_FORMAT tagFormat,
+                                           unsigned int* bpduSizeOut, unsigned int* dsaSourcePortOutOrNull);
+bool STP_OnFrameReceived (struct STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* frame, unsigned int frameSize,
+                          enum STP_FRAME_TAG_FORMAT tagFormat, unsigned int timestamp);
+
 // Call this every time the bridge's MAC address changes while STP is running.
 void STP_SetBridgeAddress (struct STP_BRIDGE* bridge, const unsigned char* address, unsigned int timestamp);
 const struct STP_BRIDGE_ADDRESS* STP_GetBridgeAddress (const struct STP_BRIDGE* bridge);
@@ -143,6 +290,11 @@ void STP_OnPortDisabled (struct STP_BRIDGE* bridge, unsigned int portIndex, unsi
 // Call this once a second.
 void STP_OnOneSecondTick (struct STP_BRIDGE* bridge, unsigned int timestamp);
 
+// Alternative to calling STP_OnOneSecondTick every second. See the documentation of STP_GetNextTimerDeadline.
+#define STP_NO_TIMER_DEADLINE 0xFFFFFFFFu
+unsigned int STP_GetNextTimerDeadline (const struct STP_BRIDGE* bridge);
+void STP_AdvanceTime (struct STP_BRIDGE* bridge, unsigned int seconds, unsigned int timestamp);
+
 // ieee8021SpanningTreePriority / dot1dStpPriority (0-61440 in steps of 4096)
 void           STP_SetBridgePriority (struct STP_BRIDGE* bridge, unsigned int treeIndex, unsigned short bridgePriority, unsigned int timestamp);
 unsigned short STP_GetBridgePriority (const struct STP_BRIDGE* bridge, unsigned int treeIndex);
@@ -258,6 +410,78 @@ void STP_SetTxHoldCount (struct STP_BRIDGE* bridge, unsigned int txHoldCound, un
 unsigned int STP_GetTxHoldCount (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetTxCount (const struct STP_BRIDGE* bridge, unsigned int portIndex);
 
+// Not in the standard. Spreads the periodic BPDU transmissions of the ports over the Hello Time,
+// to avoid transmitting from all ports in the same second. See the documentation of STP_SetHelloStaggering.
+void STP_SetHelloStaggering (struct STP_BRIDGE* bridge, bool enable, unsigned int phaseOffset, unsigned int timestamp);
+bool STP_GetHelloStaggering (const struct STP_BRIDGE* bridge);
+
+// Not in the standard. Element N counts the state machine runs that transmitted between 2^N and 2^(N+1)-1 BPDUs
+// (the last element counts also the larger bursts). See the documentation of STP_GetTransmitBurstHistogram.
+#define STP_TRANSMIT_BURST_HISTOGRAM_SIZE 13
+void STP_GetTransmitBurstHistogram (const struct STP_BRIDGE* bridge, unsigned int histogramOut[STP_TRANSMIT_BURST_HISTOGRAM_SIZE]);
+void STP_ClearTransmitBurstHistogram (struct STP_BRIDGE* bridge);
+
+// Not in the standard. Counters kept by the library, see the documentation of STP_GetStatistics.
+enum STP_STATE_MACHINE
+{
+	STP_STATE_MACHINE_PORT_TIMERS,
+	STP_STATE_MACHINE_PORT_RECEIVE,
+	STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION,
+	STP_STATE_MACHINE_BRIDGE_DETECTION,
+	STP_STATE_MACHINE_PORT_TRANSMIT,
+	STP_STATE_MACHINE_PORT_INFORMATION,
+	STP_STATE_MACHINE_PORT_ROLE_SELECTION,
+	STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS,
+	STP_STATE_MACHINE_PORT_STATE_TRANSITION,
+	STP_STATE_MACHINE_TOPOLOGY_CHANGE,
+	STP_STATE_MACHINE_L2G_PORT_RECEIVE,
+	STP_STATE_MACHINE_COUNT,
+};
+
+struct STP_BRIDGE_STATISTICS
+{
+	unsigned int transitions [STP_STATE_MACHINE_COUNT]; // state transitions, indexed by STP_STATE_MACHINE
+	unsigned int stateMachineRuns;          // evaluations of the state machines until no more transitions happen
+	unsigned int stateMachineIterations;    // passes over the state machines, summed over all runs
+	unsigned int maxStateMachineIterations; // the most passes done by a single run
+};
+
+struct STP_PORT_STATISTICS
+{
+	unsigned int rxConfigBpdus;
+	unsigned int rxRstBpdus;
+	unsigned int rxMstBpdus;       // SPT BPDUs included, as they are processed as MST BPDUs
+	unsigned int rxTcnBpdus;
+	unsigned int rxInvalidBpdus;   // rejected by the validation of 14.4 in 802.1Q-2018
+	unsigned int rxDiscardedBpdus; // received while the port was disabled or the bridge stopped
+	unsigned int txConfigBpdus;
+	unsigned int txRstBpdus;
+	unsigned int txMstBpdus;
+	unsigned int txTcnBpdus;
+	unsigned int txGetBufferFailures; // transmitGetBuffer returned NULL
+};
+
+#define STP_CONVERGENCE_HISTOGRAM_SIZE 20
+
+struct STP_TREE_STATISTICS
+{
+	unsigned int topologyChanges; // the events reported by the onTopologyChange callback
+	unsigned int fdbFlushes;      // calls to the flushFdb callback
+
+	// Reconvergences, timed from the first event that changes the tree (a port enabled or disabled, a superior BPDU,
+	// aged information, a priority or path cost change) until all its ports are again in a stable state.
+	// Element N counts the times from 2^N to 2^(N+1)-1 (element 0 also counts the zero times, the last element
+	// also the longer ones). The times are in the units of the timestamp parameters. See STP_GetTreeStatistics.
+	unsigned int convergenceHistogram [STP_CONVERGENCE_HISTOGRAM_SIZE];
+	unsigned int lastConvergenceTime;
+	unsigned int maxConvergenceTime;
+};
+
+void STP_GetStatistics (const struct STP_BRIDGE* bridge, struct STP_BRIDGE_STATISTICS* statisticsOut);
+void STP_GetPortStatistics (const struct STP_BRIDGE* bridge, unsigned int portIndex, struct STP_PORT_STATISTICS* statisticsOut);
+void STP_GetTreeStatistics (const struct STP_BRIDGE* bridge, unsigned int treeIndex, struct STP_TREE_STATISTICS* statisticsOut);
+void STP_ResetStatistics (struct STP_BRIDGE* bridge);
+
 void  STP_SetApplicationContext (struct STP_BRIDGE* bridge, void* applicationContext);
 void* STP_GetApplicationContext (const struct STP_BRIDGE* bridge);
 
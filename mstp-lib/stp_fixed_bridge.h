@@ -0,0 +1,81 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+//
+// Optional C++ helper for devices whose port count, MSTI count and maximum VLAN number are known at build time.
+// STP_FIXED_BRIDGE keeps the memory of the bridge in a static array sized at compile time, so that no heap is
+// needed. For the library itself to loop with compile-time bounds, also compile it (and the application) with
+// STP_FIXED_PORT_COUNT and STP_FIXED_MSTI_COUNT defined to the same values as PortCount and MstiCount.
+//
+// Example:
+//     typedef STP_FIXED_BRIDGE<5, 0, 16> BRIDGE;
+//     STP_BRIDGE* bridge = BRIDGE::Create (&callbacks, macAddress);
+//     ...
+//     STP_DestroyBridge (bridge);
+//
+// Each instantiation of the template owns a single memory block, so it can hold a single bridge at a time.
+// All functions from stp.h work as usual with the returned STP_BRIDGE*.
+
+#ifndef MSTP_LIB_FIXED_BRIDGE_H
+#define MSTP_LIB_FIXED_BRIDGE_H
+
+#include "stp.h"
+#include <string.h>
+#include <assert.h>
+
+template<unsigned int PortCount, unsigned int MstiCount, unsigned int MaxVlanNumber, unsigned int DebugLogBufferSize = 256>
+class STP_FIXED_BRIDGE
+{
+	// Compile-time checks written as array sizes, since the library doesn't rely on static_assert.
+#ifdef STP_FIXED_PORT_COUNT
+	typedef char PortCountMustEqualStpFixedPortCount [(PortCount == STP_FIXED_PORT_COUNT) ? 1 : -1];
+#endif
+#ifdef STP_FIXED_MSTI_COUNT
+	typedef char MstiCountMustEqualStpFixedMstiCount [(MstiCount == STP_FIXED_MSTI_COUNT) ? 1 : -1];
+#endif
+
+	union MEMORY
+	{
+		unsigned char bytes [STP_BRIDGE_MEMORY_SIZE (PortCount, MstiCount, MaxVlanNumber, DebugLogBufferSize)];
+		double alignment;
+		void* pointerAlignment;
+	};
+
+	static MEMORY memory;
+	static bool allocated;
+
+	static void* AllocAndZeroMemory (unsigned int size)
+	{
+		assert (!allocated);
+		assert (size == sizeof (memory.bytes));
+		allocated = true;
+		memset (memory.bytes, 0, size);
+		return memory.bytes;
+	}
+
+	static void FreeMemory (void* p)
+	{
+		assert (allocated && (p == memory.bytes));
+		allocated = false;
+	}
+
+public:
+	static const unsigned int MemorySize = sizeof (MEMORY);
+
+	// Same as STP_CreateBridge, except that the allocAndZeroMemory and freeMemory members of the callbacks are not used.
+	static STP_BRIDGE* Create (const STP_CALLBACKS* callbacks, const unsigned char bridgeAddress[6])
+	{
+		STP_CALLBACKS fixedCallbacks = *callbacks;
+		fixedCallbacks.allocAndZeroMemory = &AllocAndZeroMemory;
+		fixedCallbacks.freeMemory = &FreeMemory;
+		return STP_CreateBridge (PortCount, MstiCount, MaxVlanNumber, &fixedCallbacks, bridgeAddress, DebugLogBufferSize);
+	}
+};
+
+template<unsigned int PortCount, unsigned int MstiCount, unsigned int MaxVlanNumber, unsigned int DebugLogBufferSize>
+typename STP_FIXED_BRIDGE<PortCount, MstiCount, MaxVlanNumber, DebugLogBufferSize>::MEMORY STP_FIXED_BRIDGE<PortCount, MstiCount, MaxVlanNumber, DebugLogBufferSize>::memory;
+
+template<unsigned int PortCount, unsigned int MstiCount, unsigned int MaxVlanNumber, unsigned int DebugLogBufferSize>
+bool STP_FIXED_BRIDGE<PortCount, MstiCount, MaxVlanNumber, DebugLogBufferSize>::allocated;
+
+#endif
@@ -0,0 +1,262 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "benchmarks.h"
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+void* bench_bridge::StpCallback_AllocAndZeroMemory (unsigned int size)
+{
+	void* res = malloc(size);
+	memset (res, 0, size);
+	return res;
+}
+
+void bench_bridge::StpCallback_FreeMemory (void* p)
+{
+	free(p);
+}
+
+void* bench_bridge::StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	bench_bridge* bb = static_cast<bench_bridge*>(STP_GetApplicationContext(bridge));
+	bb->tx_buffer_port_index = portIndex;
+	bb->tx_buffer.resize(bpduSize);
+	return bb->tx_buffer.data();
+}
+
+void bench_bridge::StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	bench_bridge* bb = static_cast<bench_bridge*>(STP_GetApplicationContext(bridge));
+	if (bb->on_transmit)
+		bb->on_transmit (bb->tx_buffer_port_index, std::move(bb->tx_buffer));
+}
+
+static void StpCallback_EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp)
+{
+}
+
+static void StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+}
+
+static void StpCallback_OnTopologyChange (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
+{
+}
+
+static void StpCallback_OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp)
+{
+}
+
+const STP_CALLBACKS bench_bridge::callbacks =
+{
+	&StpCallback_EnableBpduTrapping,
+	&StpCallback_EnableLearning,
+	&StpCallback_EnableForwarding,
+	&StpCallback_TransmitGetBuffer,
+	&StpCallback_TransmitReleaseBuffer,
+	&StpCallback_FlushFdb,
+	&StpCallback_DebugStrOut,
+	&StpCallback_OnTopologyChange,
+	&StpCallback_OnPortRoleChanged,
+	&StpCallback_AllocAndZeroMemory,
+	&StpCallback_FreeMemory,
+};
+
+bench_bridge::bench_bridge (unsigned int port_count, unsigned int msti_count, unsigned int max_vlan_number, const std::array<uint8_t, 6>& bridge_address)
+{
+	stp_bridge = STP_CreateBridge (port_count, msti_count, max_vlan_number, &callbacks, bridge_address.data(), 256);
+	STP_SetApplicationContext (stp_bridge, this);
+}
+
+bench_bridge::~bench_bridge()
+{
+	STP_DestroyBridge (stp_bridge);
+	stp_bridge = nullptr;
+}
+
+// ============================================================================
+
+void configure_region (STP_BRIDGE* bridge)
+{
+	STP_SetStpVersion (bridge, STP_VERSION_MSTP, 0);
+	STP_SetMstConfigName (bridge, "benchmark", 0);
+
+	unsigned int entry_count;
+	const STP_CONFIG_TABLE_ENTRY* current = STP_GetMstConfigTable (bridge, &entry_count);
+	std::vector<STP_CONFIG_TABLE_ENTRY> entries (current, current + entry_count);
+	for (unsigned int vlan = 1; (vlan < entry_count) && (vlan < 4095); vlan++)
+		entries[vlan].treeIndex = vlan % (1 + STP_GetMstiCount(bridge));
+	STP_SetMstConfigTable (bridge, entries.data(), entry_count, 0);
+}
+
+// ============================================================================
+
+size_t sim_network::add_bridge (unsigned int port_count, unsigned int msti_count, const std::array<uint8_t, 6>& bridge_address)
+{
+	size_t bridge_index = _bridges.size();
+	_bridges.push_back (std::make_unique<bench_bridge>(port_count, msti_count, 64, bridge_address));
+	_peers.push_back (std::vector<wire_end>(port_count, wire_end { SIZE_MAX, 0 }));
+
+	_bridges.back()->on_transmit = [this, bridge_index] (unsigned int port_index, std::vector<uint8_t>&& bpdu)
+	{
+		const wire_end& peer = _peers[bridge_index][port_index];
+		if (peer.bridge_index != SIZE_MAX)
+			_pending.push_back (pending_bpdu { peer, std::move(bpdu) });
+	};
+
+	return bridge_index;
+}
+
+void sim_network::connect (wire_end one, wire_end other)
+{
+	assert (_peers[one.bridge_index][one.port_index].bridge_index == SIZE_MAX);
+	assert (_peers[other.bridge_index][other.port_index].bridge_index == SIZE_MAX);
+	_peers[one.bridge_index][one.port_index] = other;
+	_peers[other.bridge_index][other.port_index] = one;
+}
+
+void sim_network::start()
+{
+	for (size_t bi = 0; bi < _bridges.size(); bi++)
+		STP_StartBridge (*_bridges[bi], _timestamp);
+
+	for (size_t bi = 0; bi < _bridges.size(); bi++)
+	{
+		for (unsigned int pi = 0; pi < (unsigned int)_peers[bi].size(); pi++)
+		{
+			if (_peers[bi][pi].bridge_index != SIZE_MAX)
+			{
+				if (on_event)
+					on_event (bi, trace_event { trace_event::type::port_enabled, _timestamp, pi, { } });
+				STP_OnPortEnabled (*_bridges[bi], pi, 1000, true, _timestamp);
+			}
+		}
+	}
+
+	deliver_pending();
+}
+
+void sim_network::deliver_pending()
+{
+	while (!_pending.empty())
+	{
+		pending_bpdu p = std::move(_pending.front());
+		_pending.pop_front();
+
+		if (on_event)
+			on_event (p.to.bridge_index, trace_event { trace_event::type::bpdu_received, _timestamp, p.to.port_index, p.bpdu });
+		STP_OnBpduReceived (*_bridges[p.to.bridge_index], p.to.port_index, p.bpdu.data(), (unsigned int)p.bpdu.size(), _timestamp);
+	}
+}
+
+void sim_network::run (unsigned int seconds)
+{
+	for (unsigned int s = 0; s < seconds; s++)
+	{
+		_timestamp += 1000;
+
+		for (size_t bi = 0; bi < _bridges.size(); bi++)
+		{
+			if (on_event)
+				on_event (bi, trace_event { trace_event::type::one_second_tick, _timestamp, 0, { } });
+			STP_OnOneSecondTick (*_bridges[bi], _timestamp);
+		}
+
+		deliver_pending();
+	}
+}
+
+// ============================================================================
+
+std::vector<trace_event> record_trace (sim_network& network, size_t bridge_index, unsigned int seconds)
+{
+	std::vector<trace_event> trace;
+
+	network.on_event = [&trace, bridge_index] (size_t bi, const trace_event& event)
+	{
+		if (bi == bridge_index)
+			trace.push_back(event);
+	};
+
+	network.start();
+	network.run(seconds);
+	network.on_event = nullptr;
+	return trace;
+}
+
+replay_result replay_trace (bench_bridge& bridge, const std::vector<trace_event>& trace, const std::function<void(STP_BRIDGE*)>& before_bpdu)
+{
+	replay_result result = { };
+	result.tx_checksum = 14695981039346656037ull;
+
+	bridge.on_transmit = [&result] (unsigned int port_index, std::vector<uint8_t>&& bpdu)
+	{
+		result.tx_count++;
+		result.tx_checksum = fnv1a (result.tx_checksum, &port_index, sizeof(port_index));
+		result.tx_checksum = fnv1a (result.tx_checksum, bpdu.data(), bpdu.size());
+	};
+
+	using clock = std::chrono::steady_clock;
+	clock::duration bpdu_time = clock::duration::zero();
+	auto start_time = clock::now();
+
+	STP_StartBridge (bridge, 0);
+
+	for (const trace_event& event : trace)
+	{
+		switch (event.event_type)
+		{
+			case trace_event::type::port_enabled:
+				STP_OnPortEnabled (bridge, event.port_index, 1000, true, event.timestamp);
+				break;
+
+			case trace_event::type::one_second_tick:
+				STP_OnOneSecondTick (bridge, event.timestamp);
+				break;
+
+			case trace_event::type::bpdu_received:
+			{
+				if (before_bpdu)
+					before_bpdu (bridge);
+				auto t = clock::now();
+				STP_OnBpduReceived (bridge, event.port_index, event.bpdu.data(), (unsigned int)event.bpdu.size(), event.timestamp);
+				bpdu_time += clock::now() - t;
+				result.bpdu_count++;
+				break;
+			}
+		}
+	}
+
+	STP_StopBridge (bridge, trace.empty() ? 0 : trace.back().timestamp);
+
+	result.total_seconds = std::chrono::duration<double>(clock::now() - start_time).count();
+	result.bpdu_seconds = std::chrono::duration<double>(bpdu_time).count();
+	bridge.on_transmit = nullptr;
+	return result;
+}
+
+uint64_t fnv1a (uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,118 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#pragma once
+#include "stp.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// One input to a bridge, as recorded from a sim_network and replayed by the benchmarks.
+struct trace_event
+{
+	enum class type { port_enabled, one_second_tick, bpdu_received };
+
+	type         event_type;
+	uint32_t     timestamp;
+	unsigned int port_index; // not used for one_second_tick
+	std::vector<uint8_t> bpdu; // used only for bpdu_received
+};
+
+class bench_bridge
+{
+	STP_BRIDGE* stp_bridge;
+
+	static void* StpCallback_AllocAndZeroMemory (unsigned int size);
+	static void  StpCallback_FreeMemory (void* p);
+	static void* StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp);
+	static void  StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer);
+	static const STP_CALLBACKS callbacks;
+
+	std::vector<uint8_t> tx_buffer;
+	unsigned int tx_buffer_port_index;
+
+public:
+	bench_bridge (unsigned int port_count, unsigned int msti_count, unsigned int max_vlan_number, const std::array<uint8_t, 6>& bridge_address);
+	bench_bridge (const bench_bridge&) = delete;
+	bench_bridge& operator= (const bench_bridge&) = delete;
+	~bench_bridge();
+
+	operator STP_BRIDGE* () const { return stp_bridge; }
+
+	std::function<void(unsigned int port_index, std::vector<uint8_t>&& bpdu)> on_transmit;
+};
+
+// Puts the bridge in MSTP mode, in the MST Region used by all benchmarks, and maps VLANs to all of its trees.
+void configure_region (STP_BRIDGE* bridge);
+
+// Bridges connected with point-to-point wires. BPDUs are delivered in the order in which they were transmitted.
+class sim_network
+{
+public:
+	struct wire_end
+	{
+		size_t       bridge_index;
+		unsigned int port_index;
+	};
+
+private:
+	struct pending_bpdu
+	{
+		wire_end             to;
+		std::vector<uint8_t> bpdu;
+	};
+
+	std::vector<std::unique_ptr<bench_bridge>> _bridges;
+	std::vector<std::vector<wire_end>> _peers; // indexed by bridge, then by port; bridge_index == SIZE_MAX for unconnected ports
+	std::deque<pending_bpdu> _pending;
+	uint32_t _timestamp = 0;
+
+	void deliver_pending();
+
+public:
+	size_t add_bridge (unsigned int port_count, unsigned int msti_count, const std::array<uint8_t, 6>& bridge_address);
+	void connect (wire_end one, wire_end other);
+	STP_BRIDGE* bridge (size_t bridge_index) const { return *_bridges[bridge_index]; }
+
+	// Starts all bridges and enables their connected ports.
+	void start();
+
+	// Sends one-second ticks to all bridges and delivers all BPDUs, until the given number of seconds elapsed.
+	void run (unsigned int seconds);
+
+	// Called for each input given to a bridge, to let benchmarks record traces.
+	std::function<void(size_t bridge_index, const trace_event& event)> on_event;
+};
+
+// Records the inputs of the bridge with the given index while running the network for the given number of seconds.
+std::vector<trace_event> record_trace (sim_network& network, size_t bridge_index, unsigned int seconds);
+
+struct replay_result
+{
+	double   total_seconds;
+	double   bpdu_seconds;    // time spent in STP_OnBpduReceived
+	size_t   bpdu_count;
+	size_t   tx_count;
+	uint64_t tx_checksum;     // over all transmitted BPDUs, to check that two replays behaved the same
+};
+
+// Feeds a trace to a newly started bridge. before_bpdu, if set, is called before each STP_OnBpduReceived.
+replay_result replay_trace (bench_bridge& bridge, const std::vector<trace_event>& trace, const std::function<void(STP_BRIDGE*)>& before_bpdu = nullptr);
+
+uint64_t fnv1a (uint64_t hash, const void* data, size_t size);
+
+int bpdu_rx_benchmark (int argc, char* argv[]);
+int md5_benchmark (int argc, char* argv[]);
+
+struct HMAC_MD5_CONTEXT;
+
+namespace md5_reference
+{
+	void Init (HMAC_MD5_CONTEXT* context);
+	void Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int text_len);
+	void End (HMAC_MD5_CONTEXT* context);
+}
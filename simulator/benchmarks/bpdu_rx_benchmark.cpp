@@ -0,0 +1,76 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Measures the cost of STP_OnBpduReceived on a bridge that receives BPDUs on many ports in the steady state.
+// The same input trace is replayed twice: once normally, with evaluation starting from the receiving port,
+// and once with all state machines marked dirty before each BPDU, which is how the library behaved before
+// it tracked dirty ports. Both replays must transmit the same BPDUs.
+
+#include "benchmarks.h"
+#include "internal/stp_bridge.h"
+#include <cstdio>
+#include <cstdlib>
+
+static std::array<uint8_t, 6> make_address (unsigned int n)
+{
+	return { 0x02, 0x00, 0x00, 0x00, (uint8_t)(n >> 8), (uint8_t)n };
+}
+
+int bpdu_rx_benchmark (int argc, char* argv[])
+{
+	unsigned int port_count = (argc > 0) ? (unsigned int)atoi(argv[0]) : 48;
+	unsigned int msti_count = (argc > 1) ? (unsigned int)atoi(argv[1]) : 16;
+	unsigned int seconds    = (argc > 2) ? (unsigned int)atoi(argv[2]) : 600;
+
+	// The device under test (DUT) has the worst bridge priority. Each of its ports connects to a distribution
+	// bridge D_i, and all distribution bridges connect to the root. All D_i are designated towards the DUT,
+	// so in the steady state the DUT receives one BPDU on each of its ports every HelloTime.
+	sim_network network;
+	size_t dut = network.add_bridge (port_count, msti_count, make_address(0));
+	size_t root = network.add_bridge (port_count, msti_count, make_address(1));
+	for (unsigned int i = 0; i < port_count; i++)
+	{
+		size_t d = network.add_bridge (2, msti_count, make_address(2 + i));
+		network.connect ({ root, i }, { d, 0 });
+		network.connect ({ dut, i }, { d, 1 });
+	}
+
+	for (size_t bi = 0; bi < 2 + port_count; bi++)
+	{
+		configure_region (network.bridge(bi));
+		for (unsigned int ti = 0; ti <= msti_count; ti++)
+			STP_SetBridgePriority (network.bridge(bi), ti, (bi == dut) ? 0xF000 : (bi == root) ? 0x1000 : 0x8000, 0);
+	}
+
+	std::vector<trace_event> trace = record_trace (network, dut, seconds);
+
+	auto make_dut = [&]()
+	{
+		auto b = std::make_unique<bench_bridge>(port_count, msti_count, 64, make_address(0));
+		configure_region (*b);
+		for (unsigned int ti = 0; ti <= msti_count; ti++)
+			STP_SetBridgePriority (*b, ti, 0xF000, 0);
+		return b;
+	};
+
+	auto scoped_bridge = make_dut();
+	replay_result scoped = replay_trace (*scoped_bridge, trace);
+
+	auto full_bridge = make_dut();
+	replay_result full = replay_trace (*full_bridge, trace, [](STP_BRIDGE* bridge) { bridge->MarkAllDirty(); });
+
+	printf ("bpdu-rx: %u ports, %u MSTIs, %u seconds, %zu BPDUs received, %zu BPDUs transmitted\n",
+		port_count, msti_count, seconds, scoped.bpdu_count, scoped.tx_count);
+	printf ("  port-scoped: %8.3f us/BPDU (total %.3f s)\n", scoped.bpdu_seconds * 1e6 / scoped.bpdu_count, scoped.total_seconds);
+	printf ("  all ports:   %8.3f us/BPDU (total %.3f s)\n", full.bpdu_seconds * 1e6 / full.bpdu_count, full.total_seconds);
+	printf ("  speedup:     %8.2fx\n", full.bpdu_seconds / scoped.bpdu_seconds);
+
+	if ((scoped.tx_count != full.tx_count) || (scoped.tx_checksum != full.tx_checksum))
+	{
+		printf ("  MISMATCH: the two replays transmitted different BPDUs\n");
+		return 1;
+	}
+
+	printf ("  transmitted BPDUs match (checksum %016llx)\n", (unsigned long long)scoped.tx_checksum);
+	return 0;
+}
@@ -0,0 +1,36 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "benchmarks.h"
+#include <cstdio>
+#include <cstring>
+
+struct benchmark
+{
+	const char* name;
+	const char* args;
+	int (*run) (int argc, char* argv[]);
+};
+
+static const benchmark benchmarks[] =
+{
+	{ "bpdu-rx", "[ports=48] [mstis=16] [seconds=600]", &bpdu_rx_benchmark },
+	{ "md5",     "[iterations=2000]",                   &md5_benchmark },
+};
+
+int main (int argc, char* argv[])
+{
+	if (argc >= 2)
+	{
+		for (const benchmark& b : benchmarks)
+		{
+			if (strcmp(argv[1], b.name) == 0)
+				return b.run (argc - 2, argv + 2);
+		}
+	}
+
+	printf ("Usage: %s <benchmark> [args...]\n", argv[0]);
+	for (const benchmark& b : benchmarks)
+		printf ("  %s %s\n", b.name, b.args);
+	return 2;
+}
@@ -0,0 +1,106 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Measures the HMAC-MD5 used for the MST Configuration Digest, on inputs the size of a full MST Configuration
+// Table (8192 bytes) and on small inputs, against the byte-oriented code the library used before (md5_reference.cpp).
+// Both must produce the same digests. Cycles are read from the time-stamp counter, where the processor has one.
+
+#include "benchmarks.h"
+#include "internal/stp_md5.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	#include <intrin.h>
+	#define HAVE_RDTSC 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	#include <x86intrin.h>
+	#define HAVE_RDTSC 1
+#else
+	#define HAVE_RDTSC 0
+#endif
+
+static uint64_t read_cycles()
+{
+	#if HAVE_RDTSC
+		return __rdtsc();
+	#else
+		return 0;
+	#endif
+}
+
+struct md5_result
+{
+	double   seconds;
+	uint64_t cycles;
+	uint8_t  digest[16];
+};
+
+template<typename init_t, typename update_t, typename end_t>
+static md5_result measure (init_t init, update_t update, end_t end, const uint8_t* data, unsigned int size, unsigned int chunk_size, unsigned int iterations)
+{
+	md5_result res = { };
+	HMAC_MD5_CONTEXT context;
+	auto start_time = std::chrono::steady_clock::now();
+	uint64_t start_cycles = read_cycles();
+	for (unsigned int it = 0; it < iterations; it++)
+	{
+		init (&context);
+		for (unsigned int offset = 0; offset < size; offset += chunk_size)
+			update (&context, data + offset, std::min (chunk_size, size - offset));
+		end (&context);
+	}
+
+	res.cycles = read_cycles() - start_cycles;
+	res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	memcpy (res.digest, context.digest, 16);
+	return res;
+}
+
+int md5_benchmark (int argc, char* argv[])
+{
+	unsigned int iterations = (argc > 0) ? (unsigned int)atoi(argv[0]) : 2000;
+
+	std::vector<uint8_t> data (8192);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = (uint8_t)(i * 7 + (i >> 8));
+
+	struct test_case
+	{
+		const char*  name;
+		unsigned int size;
+		unsigned int chunk_size;
+	};
+
+	static const test_case test_cases[] =
+	{
+		{ "8192 bytes, one update",         8192, 8192 },
+		{ "8192 bytes, 2-byte updates",     8192,    2 },
+		{ "8192 bytes, 100-byte updates",   8192,  100 },
+		{ "16 bytes, one update",             16,   16 },
+	};
+
+	printf ("md5: %u iterations%s\n", iterations, HAVE_RDTSC ? "" : " (no cycle counter on this processor)");
+
+	bool mismatch = false;
+	for (const test_case& tc : test_cases)
+	{
+		unsigned int n = (tc.size < 1024) ? iterations * 64 : iterations;
+		md5_result ref = measure (&md5_reference::Init, &md5_reference::Update, &md5_reference::End, data.data(), tc.size, tc.chunk_size, n);
+		md5_result opt = measure (&HMAC_MD5_Init, &HMAC_MD5_Update, &HMAC_MD5_End, data.data(), tc.size, tc.chunk_size, n);
+
+		double bytes = (double)tc.size * n;
+		printf ("  %-30s reference: %7.2f ns/byte %7.2f cycles/byte   optimized: %7.2f ns/byte %7.2f cycles/byte   speedup: %5.2fx\n",
+			tc.name, ref.seconds * 1e9 / bytes, ref.cycles / bytes, opt.seconds * 1e9 / bytes, opt.cycles / bytes, ref.seconds / opt.seconds);
+
+		if (memcmp (ref.digest, opt.digest, 16) != 0)
+		{
+			printf ("  MISMATCH: different digests\n");
+			mismatch = true;
+		}
+	}
+
+	return mismatch ? 1 : 0;
+}
@@ -250,7 +250,7 @@ void bridge::ProcessReceivedPackets()
 					// It's a BPDU.
 					if (_bpdu_trapping_enabled)
 					{
-						STP_OnBpduReceived (_stpBridge, (unsigned int) rxPortIndex, &fsd.data[21], (unsigned int) (fsd.data.size() - 21), fsd.timestamp);
+						STP_OnFrameReceived (_stpBridge, (unsigned int) rxPortIndex, fsd.data.data(), (unsigned int) fsd.data.size(), STP_FRAME_TAG_FORMAT_NONE, fsd.timestamp);
 					}
 					else
 					{
@@ -857,12 +857,17 @@ void* bridge::StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned
 	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
 	auto txPort = b->_ports[portIndex].get();
 
-	b->_txPacketData.resize (bpduSize + 21);
+	b->_txPacketData.resize (bpduSize + 17);
 	memcpy (&b->_txPacketData[0], BpduDestAddress, 6);
 	memcpy (&b->_txPacketData[6], &b->GetPortAddress(portIndex)[0], 6);
+	b->_txPacketData[12] = (uint8_t) ((bpduSize + 3) >> 8);
+	b->_txPacketData[13] = (uint8_t) (bpduSize + 3);
+	b->_txPacketData[14] = 0x42;
+	b->_txPacketData[15] = 0x42;
+	b->_txPacketData[16] = 0x03;
 	b->_txTransmittingPort = txPort;
 	b->_txTimestamp = timestamp;
-	return &b->_txPacketData[21];
+	return &b->_txPacketData[17];
 }
 
 void bridge::StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
@@ -218,4 +218,67 @@ TEST_CLASS(bpdu_tests)
 		type = STP_GetValidatedBpduType (STP_VERSION_MSTP, mstp_bpdu_with_mstis, sizeof(mstp_bpdu_with_mstis));
 		Assert::AreEqual<int> (VALIDATED_BPDU_TYPE_MST, type);
 	}
+
+	// ===========================================================================================
+
+	TEST_METHOD(get_bpdu_from_frames_with_and_without_tags)
+	{
+		static constexpr uint8_t headers[] = {
+			0x01, 0x80, 0xC2, 0, 0, 0, // DA
+			0x10, 0x20, 0x30, 0x40, 0x50, 0x60, // SA
+			0xDA, 0xDA, 0, 0, 0x00, 0x18, 0x00, 0x00, // EDSA tag, source port 3
+			0x81, 0x00, 0x00, 0x01, // 802.1Q tag
+			0, 3 + sizeof(rstp_bpdu), // Length
+			0x42, 0x42, 0x03, // LLC
+		};
+
+		// DA, SA and the tags we want to keep, then Length, LLC, the BPDU and some padding.
+		auto make_frame = [](std::initializer_list<std::pair<size_t, size_t>> ranges)
+		{
+			std::vector<uint8_t> frame;
+			for (auto& r : ranges)
+				frame.insert (frame.end(), &headers[r.first], &headers[r.second]);
+			frame.insert (frame.end(), &headers[24], &headers[sizeof(headers)]);
+			frame.insert (frame.end(), rstp_bpdu, rstp_bpdu + sizeof(rstp_bpdu));
+			frame.resize (frame.size() + 10);
+			return frame;
+		};
+
+		unsigned int bpdu_size;
+		unsigned int port;
+
+		auto plain = make_frame({ { 0, 12 } });
+		auto bpdu = STP_GetBpduFromFrame (plain.data(), (unsigned int)plain.size(), STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr);
+		Assert::IsTrue (bpdu == &plain[17]);
+		Assert::AreEqual ((unsigned int)sizeof(rstp_bpdu), bpdu_size);
+
+		auto vlan = make_frame({ { 0, 12 }, { 20, 24 } });
+		bpdu = STP_GetBpduFromFrame (vlan.data(), (unsigned int)vlan.size(), STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr);
+		Assert::IsTrue (bpdu == &vlan[21]);
+
+		auto edsa = make_frame({ { 0, 20 } });
+		bpdu = STP_GetBpduFromFrame (edsa.data(), (unsigned int)edsa.size(), STP_FRAME_TAG_FORMAT_EDSA, &bpdu_size, &port);
+		Assert::IsTrue (bpdu == &edsa[25]);
+		Assert::AreEqual (3u, port);
+		Assert::AreEqual<int> (VALIDATED_BPDU_TYPE_RST, STP_GetValidatedBpduType (STP_VERSION_RSTP, bpdu, bpdu_size));
+
+		// Without the tag format, the EDSA tag looks like an EtherType.
+		Assert::IsNull (STP_GetBpduFromFrame (edsa.data(), (unsigned int)edsa.size(), STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr));
+
+		// Bad LLC, and a Length past the end of the frame.
+		auto bad = plain;
+		bad[16] = 0x13;
+		Assert::IsNull (STP_GetBpduFromFrame (bad.data(), (unsigned int)bad.size(), STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr));
+		Assert::IsNull (STP_GetBpduFromFrame (plain.data(), (unsigned int)(17 + sizeof(rstp_bpdu) - 1), STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr));
+
+		// Values above 1500 are not a Length, even in a frame long enough to hold that many bytes.
+		auto jumbo = plain;
+		jumbo.resize (2000);
+		for (uint16_t length_or_type : { 1501, 1535, 0x0600 })
+		{
+			jumbo[12] = (uint8_t)(length_or_type >> 8);
+			jumbo[13] = (uint8_t)length_or_type;
+			Assert::IsNull (STP_GetBpduFromFrame (jumbo.data(), (unsigned int)jumbo.size(), STP_FRAME_TAG_FORMAT_NONE, &bpdu_size, nullptr));
+		}
+	}
 };
@@ -5,6 +5,7 @@
 #include "pch.h"
 #include "bridge.h"
 #include "test_helpers.h"
+#include "stp_fixed_bridge.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -18,6 +19,37 @@ TEST_CLASS(bridge_tests)
 		auto b = std::make_unique<bridge>(port_count, msti_count, address);
 	}
 
+	TEST_METHOD(create_bridge_in_static_buffer)
+	{
+		// STP_CreateBridge must make a single allocation of the size returned by STP_GetBridgeMemorySize,
+		// so that an application without a heap can give it a static buffer.
+		alignas(8) static unsigned char buffer[64 * 1024];
+		static unsigned int alloc_count;
+		static unsigned int alloc_size;
+		alloc_count = 0;
+		alloc_size = 0;
+
+		STP_CALLBACKS callbacks = { };
+		callbacks.allocAndZeroMemory = [](unsigned int size) -> void*
+		{
+			alloc_count++;
+			alloc_size = size;
+			memset (buffer, 0, sizeof(buffer));
+			return buffer;
+		};
+		callbacks.freeMemory = [](void* p) { Assert::IsTrue (p == buffer); };
+
+		unsigned int size = STP_GetBridgeMemorySize (8, 4, 16, 256);
+		Assert::IsTrue (size <= sizeof(buffer));
+
+		mac_address address = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+		STP_BRIDGE* bridge = STP_CreateBridge (8, 4, 16, &callbacks, address.data(), 256);
+		Assert::AreEqual (1u, alloc_count);
+		Assert::AreEqual (size, alloc_size);
+		Assert::IsTrue ((void*)bridge == buffer);
+		STP_DestroyBridge (bridge);
+	}
+
 	TEST_METHOD(disable_stp_test1)
 	{
 		uint32_t port_count = 4;
@@ -87,4 +119,553 @@ TEST_CLASS(bridge_tests)
 		memcpy (&root_id, rpv, 8);
 		Assert::AreEqual (0ull, root_id);
 	}
+
+	TEST_METHOD(config_transaction_same_result_as_individual_calls)
+	{
+		auto configure = [](STP_BRIDGE* bridge)
+		{
+			STP_SetMstConfigName (bridge, "ABC", 0);
+			for (unsigned int vlan = 1; vlan <= 100; vlan++)
+				STP_SetMstConfigTableEntry (bridge, vlan, vlan % 5, 0);
+			STP_SetBridgePriority (bridge, 0, 0x4000, 0);
+			STP_SetBridgePriority (bridge, 2, 0x2000, 0);
+			STP_SetPortPriority (bridge, 1, 3, 0x40, 0);
+		};
+
+		test_bridge direct (4, 4, 100, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		STP_SetStpVersion (direct, STP_VERSION_MSTP, 0);
+		STP_StartBridge (direct, 0);
+		STP_OnPortEnabled (direct, 0, 100, true, 0);
+		configure (direct);
+
+		test_bridge transacted (4, 4, 100, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		STP_SetStpVersion (transacted, STP_VERSION_MSTP, 0);
+		STP_StartBridge (transacted, 0);
+		STP_OnPortEnabled (transacted, 0, 100, true, 0);
+		STP_BeginConfigTransaction (transacted, 0);
+		Assert::IsTrue (STP_IsConfigTransactionActive (transacted));
+		configure (transacted);
+		STP_CommitConfigTransaction (transacted, 0);
+		Assert::IsFalse (STP_IsConfigTransactionActive (transacted));
+
+		Assert::IsTrue (*STP_GetMstConfigId (direct) == *STP_GetMstConfigId (transacted));
+
+		for (unsigned int treeIndex = 0; treeIndex < 5; treeIndex++)
+		{
+			unsigned char rpv_direct[36];
+			unsigned char rpv_transacted[36];
+			STP_GetRootPriorityVector (direct, treeIndex, rpv_direct);
+			STP_GetRootPriorityVector (transacted, treeIndex, rpv_transacted);
+			Assert::IsTrue (memcmp (rpv_direct, rpv_transacted, 36) == 0);
+
+			for (unsigned int portIndex = 0; portIndex < 4; portIndex++)
+				Assert::AreEqual (STP_GetPortRole (direct, portIndex, treeIndex), STP_GetPortRole (transacted, portIndex, treeIndex));
+		}
+	}
+
+	TEST_METHOD(empty_config_transaction_recomputes_nothing)
+	{
+		test_bridge bridge (2, 1, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		STP_SetStpVersion (bridge, STP_VERSION_MSTP, 0);
+		STP_StartBridge (bridge, 0);
+		STP_OnPortEnabled (bridge, 0, 100, true, 0);
+
+		// A change to an MSTI that stops being used within the same transaction must not stay pending.
+		STP_BeginConfigTransaction (bridge, 1);
+		STP_SetBridgePriority (bridge, 1, 0x2000, 1);
+		STP_SetStpVersion (bridge, STP_VERSION_RSTP, 1);
+		STP_CommitConfigTransaction (bridge, 1);
+		STP_SetStpVersion (bridge, STP_VERSION_MSTP, 2);
+
+		STP_EnableLogging (bridge, true);
+		STP_BeginConfigTransaction (bridge, 3);
+		STP_CommitConfigTransaction (bridge, 3);
+		Assert::IsTrue (bridge.log_text.find ("Tree 1:") == std::string::npos);
+	}
+
+	TEST_METHOD(advance_time_same_result_as_one_second_ticks)
+	{
+		test_bridge ticked (4, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		test_bridge tickless (4, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		for (STP_BRIDGE* bridge : { (STP_BRIDGE*)ticked, (STP_BRIDGE*)tickless })
+		{
+			STP_StartBridge (bridge, 0);
+			STP_OnPortEnabled (bridge, 0, 100, true, 0);
+			STP_OnPortEnabled (bridge, 1, 100, true, 0);
+		}
+
+		unsigned int pending_seconds = 0;
+		unsigned int advance_count = 0;
+		for (unsigned int second = 1; second <= 60; second++)
+		{
+			STP_OnOneSecondTick (ticked, second);
+
+			pending_seconds++;
+			Assert::IsTrue (pending_seconds <= STP_GetNextTimerDeadline (tickless));
+			if (pending_seconds == STP_GetNextTimerDeadline (tickless))
+			{
+				STP_AdvanceTime (tickless, pending_seconds, second);
+				pending_seconds = 0;
+				advance_count++;
+
+				for (unsigned int portIndex = 0; portIndex < 4; portIndex++)
+				{
+					Assert::AreEqual (ticked.tx_queues[portIndex].size(), tickless.tx_queues[portIndex].size());
+					Assert::AreEqual (STP_GetPortRole (ticked, portIndex, 0), STP_GetPortRole (tickless, portIndex, 0));
+					Assert::AreEqual (STP_GetPortForwarding (ticked, portIndex, 0), STP_GetPortForwarding (tickless, portIndex, 0));
+				}
+			}
+		}
+
+		// The two designated ports transmit every HelloTime (2 seconds), so about half of the ticks can be skipped.
+		Assert::IsTrue (advance_count < 40);
+	}
+
+	TEST_METHOD(hello_staggering_spreads_periodic_transmissions)
+	{
+		test_bridge bridge (8, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		STP_SetHelloStaggering (bridge, true, 0, 0);
+		STP_StartBridge (bridge, 0);
+		for (unsigned int portIndex = 0; portIndex < 8; portIndex++)
+			STP_OnPortEnabled (bridge, portIndex, 100, true, 0);
+
+		STP_ClearTransmitBurstHistogram (bridge);
+
+		// Without staggering all eight designated ports would transmit every other second.
+		// With it, half of them transmit in each second, and each of them still every HelloTime.
+		for (unsigned int second = 1; second <= 20; second++)
+		{
+			size_t before = 0;
+			for (auto& q : bridge.tx_queues)
+				before += q.second.size();
+
+			STP_OnOneSecondTick (bridge, second);
+
+			size_t after = 0;
+			for (auto& q : bridge.tx_queues)
+				after += q.second.size();
+
+			Assert::AreEqual ((size_t)4, after - before);
+		}
+
+		unsigned int histogram[STP_TRANSMIT_BURST_HISTOGRAM_SIZE];
+		STP_GetTransmitBurstHistogram (bridge, histogram);
+		Assert::AreEqual (20u, histogram[2]);
+	}
+
+	TEST_METHOD(transmitted_bpdu_reflects_priority_changes)
+	{
+		test_bridge bridge (2, 2, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+		STP_SetStpVersion (bridge, STP_VERSION_MSTP, 0);
+		STP_StartBridge (bridge, 0);
+		STP_OnPortEnabled (bridge, 0, 100, true, 0);
+		for (unsigned int second = 1; second <= 4; second++)
+			STP_OnOneSecondTick (bridge, second);
+
+		STP_SetBridgePriority (bridge, 2, 0x6000, 4);
+		STP_SetPortPriority (bridge, 0, 2, 0x40, 4);
+		STP_SetMstConfigRevisionLevel (bridge, 0x1234, 4);
+
+		auto& queue = bridge.tx_queues[0];
+		while (!queue.empty())
+			queue.pop();
+		for (unsigned int second = 5; queue.empty(); second++)
+			STP_OnOneSecondTick (bridge, second);
+
+		// 102 octets of CIST information, followed by one 16-octet MSTI Configuration Message per MSTI (14.4.1 in 802.1Q-2018).
+		const std::vector<uint8_t>& bpdu = queue.back();
+		Assert::AreEqual ((size_t)(102 + 2 * 16), bpdu.size());
+		Assert::AreEqual ((uint8_t)0x12, bpdu[38 + 33]);
+		Assert::AreEqual ((uint8_t)0x34, bpdu[38 + 34]);
+		Assert::AreEqual ((uint8_t)0x60, bpdu[102 + 16 + 13]);
+		Assert::AreEqual ((uint8_t)0x40, bpdu[102 + 16 + 14]);
+	}
+
+	TEST_METHOD(transmit_batch_collects_bpdus_of_one_run)
+	{
+		static std::vector<std::vector<STP_TRANSMIT_BATCH_ENTRY>> batches;
+		batches.clear();
+
+		STP_CALLBACKS callbacks = { };
+		callbacks.enableBpduTrapping = [](const STP_BRIDGE*, bool, unsigned int) { };
+		callbacks.enableLearning     = [](const STP_BRIDGE*, unsigned int, unsigned int, bool, unsigned int) { };
+		callbacks.enableForwarding   = [](const STP_BRIDGE*, unsigned int, unsigned int, bool, unsigned int) { };
+		callbacks.flushFdb           = [](const STP_BRIDGE*, unsigned int, unsigned int, STP_FLUSH_FDB_TYPE, unsigned int) { };
+		callbacks.debugStrOut        = [](const STP_BRIDGE*, int, int, const char*, unsigned int, unsigned int) { };
+		callbacks.onTopologyChange   = [](const STP_BRIDGE*, unsigned int, unsigned int) { };
+		callbacks.onPortRoleChanged  = [](const STP_BRIDGE*, unsigned int, unsigned int, STP_PORT_ROLE, unsigned int) { };
+		callbacks.allocAndZeroMemory = [](unsigned int size) { return calloc (1, size); };
+		callbacks.freeMemory         = [](void* p) { free (p); };
+		callbacks.transmitBatch      = [](const STP_BRIDGE*, const STP_TRANSMIT_BATCH_ENTRY* entries, unsigned int entryCount, unsigned int)
+		{
+			batches.emplace_back (entries, entries + entryCount);
+		};
+
+		mac_address address = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+		STP_BRIDGE* bridge = STP_CreateBridge (4, 0, 0, &callbacks, address.data(), 256);
+		STP_StartBridge (bridge, 0);
+		for (unsigned int portIndex = 0; portIndex < 4; portIndex++)
+			STP_OnPortEnabled (bridge, portIndex, 100, true, 0);
+
+		// All four ports are designated and send their periodic BPDUs in the same tick; they must come in a single batch.
+		batches.clear();
+		STP_OnOneSecondTick (bridge, 1);
+		STP_OnOneSecondTick (bridge, 2);
+		Assert::AreEqual ((size_t)1, batches.size());
+		Assert::AreEqual ((size_t)4, batches[0].size());
+		for (unsigned int portIndex = 0; portIndex < 4; portIndex++)
+		{
+			Assert::AreEqual (portIndex, batches[0][portIndex].portIndex);
+			Assert::AreEqual (36u, batches[0][portIndex].bpduSize);
+		}
+
+		STP_DestroyBridge (bridge);
+	}
+
+	TEST_METHOD(bpdu_batch_transmits_only_final_information)
+	{
+		test_bridge root1 (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+		test_bridge root2 (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xC0 });
+		STP_SetBridgePriority (root1, 0, 0x4000, 0);
+		STP_SetBridgePriority (root2, 0, 0x1000, 0);
+
+		test_bridge bridge (4, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		for (STP_BRIDGE* b : { (STP_BRIDGE*)root1, (STP_BRIDGE*)root2, (STP_BRIDGE*)bridge })
+		{
+			STP_StartBridge (b, 0);
+			for (unsigned int portIndex = 0; portIndex < STP_GetPortCount(b); portIndex++)
+				STP_OnPortEnabled (b, portIndex, 100, true, 0);
+		}
+
+		for (auto& q : bridge.tx_queues)
+			q.second = { };
+
+		// Port 0 first hears of root1, then of the better root2. Port by port, only the information about
+		// root2 must be transmitted, where calling STP_OnBpduReceived twice would transmit both.
+		const std::vector<uint8_t>& bpdu1 = root1.tx_queues[0].back();
+		const std::vector<uint8_t>& bpdu2 = root2.tx_queues[0].back();
+		STP_RECEIVED_BPDU bpdus[2] =
+		{
+			{ 0, bpdu1.data(), (unsigned int)bpdu1.size(), 1 },
+			{ 0, bpdu2.data(), (unsigned int)bpdu2.size(), 1 },
+		};
+		STP_OnBpdusReceived (bridge, bpdus, 2);
+
+		Assert::AreEqual (STP_PORT_ROLE_ROOT, STP_GetPortRole (bridge, 0, 0));
+		for (unsigned int portIndex = 0; portIndex < 4; portIndex++)
+			Assert::AreEqual ((size_t)1, bridge.tx_queues[portIndex].size());
+
+		unsigned char rpv[36];
+		STP_GetRootPriorityVector (bridge, 0, rpv);
+		Assert::AreEqual ((unsigned char)0x10, rpv[0]);
+	}
+
+	TEST_METHOD(repeated_bpdus_same_result_with_and_without_fast_path)
+	{
+		test_bridge root (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+
+		// Logging disables the repeated-BPDU fast path, so "slow" runs all state machines for every BPDU.
+		test_bridge fast (4, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		test_bridge slow (4, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		STP_EnableLogging (slow, true);
+
+		start_root_and_bridges (root, { &fast, &slow });
+		run_root_and_bridges (root, { &fast, &slow }, 1, 30, [&](unsigned int)
+		{
+			for (unsigned int portIndex = 0; portIndex < 4; portIndex++)
+			{
+				Assert::AreEqual (STP_GetPortRole (slow, portIndex, 0), STP_GetPortRole (fast, portIndex, 0));
+				Assert::AreEqual (STP_GetPortForwarding (slow, portIndex, 0), STP_GetPortForwarding (fast, portIndex, 0));
+				Assert::IsTrue (slow.tx_queues[portIndex] == fast.tx_queues[portIndex]);
+			}
+		});
+
+		Assert::AreEqual (STP_PORT_ROLE_ROOT, STP_GetPortRole (fast, 0, 0));
+	}
+
+	TEST_METHOD(decoded_trace_same_as_text_log)
+	{
+		test_bridge root (1, 1, 100, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+		test_bridge text (3, 1, 100, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		test_bridge trace (3, 1, 100, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+
+		// Small enough that the ring wraps around many times, large enough that no entry is lost between reads.
+		std::vector<uint8_t> trace_buffer (32768);
+		STP_StartTrace (trace, trace_buffer.data(), (unsigned int)trace_buffer.size());
+
+		std::vector<uint8_t> read_buffer (STP_TRACE_MAX_ENTRY_SIZE);
+		auto decode_trace = [&]
+		{
+			unsigned int size;
+			unsigned int lost;
+			while ((size = STP_ReadTrace (trace, read_buffer.data(), (unsigned int)read_buffer.size(), &lost)) > 0)
+			{
+				Assert::AreEqual (0u, lost);
+				STP_DecodeTrace (trace, read_buffer.data(), size);
+			}
+		};
+
+		for (STP_BRIDGE* b : { (STP_BRIDGE*)root, (STP_BRIDGE*)text, (STP_BRIDGE*)trace })
+		{
+			STP_SetStpVersion (b, STP_VERSION_MSTP, 0);
+			STP_EnableLogging (b, b != root);
+		}
+
+		start_root_and_bridges (root, { &text, &trace });
+		decode_trace();
+		run_root_and_bridges (root, { &text, &trace }, 1, 20, [&](unsigned int) { decode_trace(); });
+
+		STP_SetBridgePriority (text, 1, 0x2000, 21);
+		STP_SetBridgePriority (trace, 1, 0x2000, 21);
+		decode_trace();
+
+		Assert::IsTrue (text.log_text.size() > 10000);
+		Assert::IsTrue (text.log_text == trace.log_text);
+		STP_StopTrace (trace);
+	}
+
+	TEST_METHOD(decode_trace_rejects_unknown_entries)
+	{
+		test_bridge bridge (2, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		STP_EnableLogging (bridge, true);
+
+		std::vector<uint8_t> trace_buffer (4096);
+		STP_StartTrace (bridge, trace_buffer.data(), (unsigned int)trace_buffer.size());
+		STP_StartBridge (bridge, 0);
+
+		std::vector<uint8_t> trace (trace_buffer.size());
+		unsigned int lost;
+		unsigned int size = STP_ReadTrace (bridge, trace.data(), (unsigned int)trace.size(), &lost);
+		Assert::IsTrue (size > STP_TRACE_RECORD_SIZE);
+
+		auto decode_modified = [&](const std::function<void(std::vector<uint8_t>& trace)>& modify)
+		{
+			std::vector<uint8_t> copy (trace.begin(), trace.begin() + size);
+			modify (copy);
+			bridge.log_text.clear();
+			STP_DecodeTrace (bridge, copy.data(), size);
+			return bridge.log_text;
+		};
+
+		// An entry starts with the format ID (4 bytes), the timestamp (4), the port (2), the tree (2) and the size
+		// of the arguments (2). Entries this build can't decode, or that would trip the asserts of the text writer,
+		// give a line saying so: an unknown format ID, a port this bridge doesn't have, a control character in a string.
+		std::string text = decode_modified ([](std::vector<uint8_t>& t) { t[0] ^= 0xFF; });
+		Assert::IsTrue (text.find ("Unknown trace entry") != std::string::npos);
+
+		text = decode_modified ([](std::vector<uint8_t>& t) { t[8] = 5; t[9] = 0; });
+		Assert::IsTrue (text.find ("Unknown trace entry") != std::string::npos);
+
+		text = decode_modified ([](std::vector<uint8_t>& t)
+		{
+			static const char state[] = "ONE_SECOND";
+			auto it = std::search (t.begin(), t.end(), state, state + sizeof(state) - 1);
+			Assert::IsTrue (it != t.end());
+			*it = '\n';
+		});
+		Assert::IsTrue (text.find ("Unknown trace entry") != std::string::npos);
+
+		// An entry that claims to go past the end of the trace stops the decoding.
+		text = decode_modified ([](std::vector<uint8_t>& t) { t[12] = 0xFF; t[13] = 0xFF; });
+		Assert::IsTrue (text.empty());
+
+		STP_StopTrace (bridge);
+	}
+
+	TEST_METHOD(log_filters_drop_lines_but_not_behavior)
+	{
+		test_bridge root (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+		test_bridge full (2, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		test_bridge filtered (2, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		STP_EnableLogging (full, true);
+		STP_EnableLogging (filtered, true);
+		STP_EnablePortLogging (filtered, 1, false);
+		STP_SetLogCategories (filtered, STP_LOG_CATEGORY_ALL & ~STP_LOG_CATEGORY_RX_BPDU_DUMP);
+
+		start_root_and_bridges (root, { &full, &filtered });
+		run_root_and_bridges (root, { &full, &filtered }, 1, 10);
+
+		Assert::IsTrue (full.log_text.find ("Port 2: PortTimers: -> ") != std::string::npos);
+		Assert::IsTrue (full.log_text.find ("RSTP BPDU:") != std::string::npos);
+		Assert::IsTrue (filtered.log_text.find ("Port 1: PortTimers: -> ") != std::string::npos);
+		Assert::IsTrue (filtered.log_text.find ("Port 2: PortTimers: -> ") == std::string::npos);
+		Assert::IsTrue (full.log_text.find ("Port 2 designated priority") != std::string::npos);
+		Assert::IsTrue (filtered.log_text.find ("Port 1 designated priority") != std::string::npos);
+		Assert::IsTrue (filtered.log_text.find ("Port 2 designated priority") == std::string::npos);
+		Assert::IsTrue (filtered.log_text.find ("RSTP BPDU:") == std::string::npos);
+
+		for (unsigned int portIndex = 0; portIndex < 2; portIndex++)
+		{
+			Assert::AreEqual (STP_GetPortRole (full, portIndex, 0), STP_GetPortRole (filtered, portIndex, 0));
+			Assert::IsTrue (full.tx_queues[portIndex] == filtered.tx_queues[portIndex]);
+		}
+	}
+
+	TEST_METHOD(deferred_log_same_as_synchronous_log)
+	{
+		test_bridge root (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+		test_bridge direct (2, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		test_bridge deferred (2, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+
+		// Small enough that the ring wraps around many times, large enough that nothing is lost between drains.
+		std::vector<uint8_t> ring (16384);
+		STP_EnableDeferredLog (deferred, ring.data(), (unsigned int)ring.size());
+		Assert::IsTrue (STP_IsLogDeferred (deferred));
+
+		auto drain = [&]
+		{
+			// Nothing reaches the callback before the application asks for it.
+			Assert::IsTrue (direct.log_text.size() > deferred.log_text.size());
+
+			unsigned int lost;
+			while (STP_DrainLog (deferred, 100, &lost) > 0)
+				Assert::AreEqual (0u, lost);
+			Assert::AreEqual (0u, lost);
+		};
+
+		STP_EnableLogging (direct, true);
+		STP_EnableLogging (deferred, true);
+		start_root_and_bridges (root, { &direct, &deferred });
+		drain();
+		run_root_and_bridges (root, { &direct, &deferred }, 1, 10, [&](unsigned int) { drain(); });
+
+		Assert::IsTrue (direct.log_text.size() > 10000);
+		Assert::IsTrue (direct.log_text == deferred.log_text);
+
+		// Without draining, the ring fills up; what didn't fit is reported by the next drain.
+		run_root_and_bridges (root, { &direct, &deferred }, 11, 30);
+
+		unsigned int lost;
+		STP_DrainLog (deferred, 0xFFFFFFFF, &lost);
+		Assert::IsTrue (lost > 0);
+		Assert::AreEqual (direct.log_text.size(), deferred.log_text.size() + lost);
+		STP_DrainLog (deferred, 0xFFFFFFFF, &lost);
+		Assert::AreEqual (0u, lost);
+
+		STP_DisableDeferredLog (deferred);
+		Assert::IsFalse (STP_IsLogDeferred (deferred));
+	}
+
+	TEST_METHOD(deferred_log_on_fixed_bridge)
+	{
+		// The ring is given by the application, so that a bridge whose memory is a single
+		// static block (STP_FIXED_BRIDGE) can defer its log too.
+		static unsigned char tx_buffer[256];
+		static std::string log_text;
+		log_text.clear();
+
+		STP_CALLBACKS callbacks = { };
+		callbacks.enableBpduTrapping = [](const STP_BRIDGE*, bool, unsigned int) { };
+		callbacks.enableLearning = [](const STP_BRIDGE*, unsigned int, unsigned int, bool, unsigned int) { };
+		callbacks.enableForwarding = [](const STP_BRIDGE*, unsigned int, unsigned int, bool, unsigned int) { };
+		callbacks.transmitGetBuffer = [](const STP_BRIDGE*, unsigned int, unsigned int, unsigned int) -> void* { return tx_buffer; };
+		callbacks.transmitReleaseBuffer = [](const STP_BRIDGE*, void*) { };
+		callbacks.flushFdb = [](const STP_BRIDGE*, unsigned int, unsigned int, enum STP_FLUSH_FDB_TYPE, unsigned int) { };
+		callbacks.debugStrOut = [](const STP_BRIDGE*, int, int, const char* str, unsigned int len, unsigned int) { log_text.append (str, len); };
+		callbacks.onTopologyChange = [](const STP_BRIDGE*, unsigned int, unsigned int) { };
+		callbacks.onPortRoleChanged = [](const STP_BRIDGE*, unsigned int, unsigned int, STP_PORT_ROLE, unsigned int) { };
+
+		typedef STP_FIXED_BRIDGE<2, 0, 16> fixed_bridge;
+		mac_address address = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+		STP_BRIDGE* bridge = fixed_bridge::Create (&callbacks, address.data());
+
+		static unsigned char ring[4096];
+		STP_EnableDeferredLog (bridge, ring, sizeof(ring));
+		STP_EnableLogging (bridge, true);
+		STP_StartBridge (bridge, 0);
+		STP_OnPortEnabled (bridge, 0, 100, true, 0);
+		Assert::IsTrue (log_text.empty());
+
+		unsigned int lost;
+		Assert::IsTrue (STP_DrainLog (bridge, 0xFFFFFFFF, &lost) > 0);
+		Assert::AreEqual (0u, lost);
+		Assert::IsTrue (log_text.find ("Bridge started.") != std::string::npos);
+
+		STP_DisableDeferredLog (bridge);
+		STP_DestroyBridge (bridge);
+
+		// The fixed bridge's block is free again.
+		bridge = fixed_bridge::Create (&callbacks, address.data());
+		STP_DestroyBridge (bridge);
+	}
+
+	TEST_METHOD(statistics_count_bpdus_and_state_machine_work)
+	{
+		test_bridge root (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+		test_bridge bridge (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		start_root_and_bridges (root, { &bridge });
+		unsigned int received = run_root_and_bridges (root, { &bridge }, 1, 10);
+
+		static const uint8_t too_short[] = { 0, 0, 2, 2 };
+		STP_OnBpduReceived (bridge, 0, too_short, sizeof(too_short), 11);
+
+		STP_PORT_STATISTICS port;
+		STP_GetPortStatistics (bridge, 0, &port);
+		Assert::IsTrue (received > 0);
+		Assert::AreEqual (received, port.rxRstBpdus);
+		Assert::AreEqual (0u, port.rxConfigBpdus + port.rxMstBpdus + port.rxTcnBpdus + port.rxDiscardedBpdus);
+		Assert::AreEqual (1u, port.rxInvalidBpdus);
+		Assert::AreEqual ((unsigned int)bridge.tx_queues[0].size(), port.txRstBpdus);
+		Assert::AreEqual (0u, port.txGetBufferFailures);
+
+		// BPDUs received on a disabled port are discarded.
+		STP_OnPortDisabled (bridge, 0, 12);
+		unsigned int discarded = run_root_and_bridges (root, { &bridge }, 13, 15);
+		STP_GetPortStatistics (bridge, 0, &port);
+		Assert::IsTrue (discarded > 0);
+		Assert::AreEqual (discarded, port.rxDiscardedBpdus);
+		Assert::AreEqual (received, port.rxRstBpdus);
+
+		STP_BRIDGE_STATISTICS stats;
+		STP_GetStatistics (bridge, &stats);
+		Assert::IsTrue (stats.transitions[STP_STATE_MACHINE_PORT_RECEIVE] >= received);
+		Assert::IsTrue (stats.transitions[STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS] > 0);
+		Assert::IsTrue (stats.stateMachineRuns > received);
+		Assert::IsTrue (stats.stateMachineIterations >= stats.stateMachineRuns);
+		Assert::IsTrue (stats.maxStateMachineIterations >= 2);
+
+		// The root port went to Forwarding, which is a topology change.
+		STP_TREE_STATISTICS tree;
+		STP_GetTreeStatistics (bridge, 0, &tree);
+		Assert::AreEqual (1u, tree.topologyChanges);
+
+		STP_ResetStatistics (bridge);
+		STP_GetStatistics (bridge, &stats);
+		STP_GetPortStatistics (bridge, 0, &port);
+		STP_GetTreeStatistics (bridge, 0, &tree);
+		Assert::AreEqual (0u, stats.stateMachineRuns + stats.transitions[STP_STATE_MACHINE_PORT_RECEIVE]);
+		Assert::AreEqual (0u, port.rxDiscardedBpdus);
+		Assert::AreEqual (0u, tree.topologyChanges);
+	}
+
+	TEST_METHOD(statistics_measure_convergence_time)
+	{
+		test_bridge root (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xA0 });
+		test_bridge bridge (1, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0xB0 });
+		start_root_and_bridges (root, { &bridge });
+
+		// Timestamps in milliseconds. The bridge learns of the root with the first BPDU,
+		// and its port becomes a forwarding Root Port right away.
+		run_root_and_bridges (root, { &bridge }, 1, 10, nullptr, 1000);
+		STP_TREE_STATISTICS tree;
+		STP_GetTreeStatistics (bridge, 0, &tree);
+		Assert::AreEqual (1000u, tree.lastConvergenceTime);
+		Assert::AreEqual (1u, tree.convergenceHistogram[9]);
+
+		// Losing its only port makes the bridge stable immediately, with no port.
+		STP_ResetStatistics (bridge);
+		STP_OnPortDisabled (bridge, 0, 20500);
+		STP_GetTreeStatistics (bridge, 0, &tree);
+		Assert::AreEqual (1u, tree.convergenceHistogram[0]);
+		Assert::AreEqual (0u, tree.lastConvergenceTime);
+
+		// With the port enabled again in the middle of a second, convergence waits for the next Hello from the root,
+		// which is unaware of the link going down and comes at second 32.
+		STP_OnPortEnabled (bridge, 0, 100, true, 30500);
+		run_root_and_bridges (root, { &bridge }, 31, 40, nullptr, 1000);
+		STP_GetTreeStatistics (bridge, 0, &tree);
+		Assert::AreEqual (1500u, tree.lastConvergenceTime);
+		Assert::AreEqual (1u, tree.convergenceHistogram[10]);
+		Assert::AreEqual (1500u, tree.maxConvergenceTime);
+	}
 };
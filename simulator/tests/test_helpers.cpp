@@ -47,8 +47,10 @@ static void StpCallback_FlushFdb (const STP_BRIDGE* bridge, unsigned int portInd
 {
 }
 
-static void StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+void test_bridge::StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
 {
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	tb->log_text.append (nullTerminatedString, stringLength);
 }
 
 static void StpCallback_OnTopologyChange (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
@@ -113,3 +115,46 @@ bool exchange_bpdus (test_bridge& one, size_t one_port, test_bridge& other, size
 	}
 	return exchanged;
 };
+
+void start_root_and_bridges (test_bridge& root, const std::vector<test_bridge*>& bridges)
+{
+	STP_SetBridgePriority (root, 0, 0x1000, 0);
+
+	std::vector<test_bridge*> all = bridges;
+	all.insert (all.begin(), &root);
+	for (test_bridge* b : all)
+	{
+		STP_StartBridge (*b, 0);
+		for (unsigned int portIndex = 0; portIndex < STP_GetPortCount(*b); portIndex++)
+			STP_OnPortEnabled (*b, portIndex, 100, true, 0);
+	}
+}
+
+unsigned int run_root_and_bridges (test_bridge& root, const std::vector<test_bridge*>& bridges,
+	unsigned int first_second, unsigned int last_second,
+	const std::function<void(unsigned int second)>& after_second, unsigned int timestamps_per_second)
+{
+	unsigned int delivered = 0;
+	for (unsigned int second = first_second; second <= last_second; second++)
+	{
+		unsigned int timestamp = second * timestamps_per_second;
+
+		STP_OnOneSecondTick (root, timestamp);
+		for (test_bridge* b : bridges)
+			STP_OnOneSecondTick (*b, timestamp);
+
+		while (!root.tx_queues[0].empty())
+		{
+			const std::vector<uint8_t>& bpdu = root.tx_queues[0].front();
+			for (test_bridge* b : bridges)
+				STP_OnBpduReceived (*b, 0, bpdu.data(), (unsigned int)bpdu.size(), timestamp);
+			root.tx_queues[0].pop();
+			delivered++;
+		}
+
+		if (after_second)
+			after_second (second);
+	}
+
+	return delivered;
+}
@@ -34,6 +34,7 @@ class test_bridge
 	static void* StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp);
 	static void  StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer);
 	static void  StpCallback_OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp);
+	static void  StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush);
 	static const STP_CALLBACKS callbacks;
 
 	std::vector<uint8_t> tx_buffer;
@@ -50,6 +51,17 @@ public:
 	using tx_queue = std::queue<std::vector<uint8_t>>;
 	std::unordered_map<size_t, tx_queue> tx_queues;
 	std::function<void(size_t portIndex, size_t treeIndex, STP_PORT_ROLE role)> port_role_changed;
+	std::string log_text;
 };
 
 bool exchange_bpdus (test_bridge& one, size_t one_port, test_bridge& other, size_t other_port);
+
+// Gives "root" the best bridge priority, then starts it and the bridges with all their ports enabled.
+void start_root_and_bridges (test_bridge& root, const std::vector<test_bridge*>& bridges);
+
+// For each second from first_second to last_second, ticks "root" and the bridges with the timestamp
+// second * timestamps_per_second, delivers the BPDUs transmitted by "root" on its port 0 to port 0 of each bridge,
+// and calls after_second, if any. Returns the number of BPDUs delivered to each bridge.
+unsigned int run_root_and_bridges (test_bridge& root, const std::vector<test_bridge*>& bridges,
+	unsigned int first_second, unsigned int last_second,
+	const std::function<void(unsigned int second)>& after_second = nullptr, unsigned int timestamps_per_second = 1);